@@ -3,8 +3,12 @@
 in vec3 position;
 in layout(location=1) vec4 color;
 in layout(location=2) vec3 normal;
-uniform mat4 t_mat;
-uniform mat4 model_mat;
+// Written by RenderQueue into a uniform ring buffer, with a slice bound for every draw
+layout(std140, binding=0) uniform Transforms
+{
+    mat4 t_mat;
+    mat4 model_mat;
+};
 
 out layout(location=1) vec4 ex_color;
 out layout(location=2) vec3 ex_normal;
@@ -0,0 +1,28 @@
+#version 450 core
+#extension GL_ARB_shader_draw_parameters : require
+
+in vec3 position;
+in layout(location=1) vec4 color;
+in layout(location=2) vec3 normal;
+
+// Written by cull.comp, one entry per draw of the multi-draw call
+struct Instance
+{
+    mat4 t_mat;
+    mat4 model_mat;
+};
+layout(std430, binding=0) readonly buffer Draws
+{
+    Instance draws[];
+};
+
+out layout(location=1) vec4 ex_color;
+out layout(location=2) vec3 ex_normal;
+void main()
+{
+    Instance draw = draws[gl_DrawIDARB];
+    vec4 new_pos = draw.t_mat*vec4(position, 1.0);
+    gl_Position = new_pos;
+    ex_color = color;
+    ex_normal = normalize(mat3(draw.model_mat) *normal);
+}
@@ -0,0 +1,29 @@
+#version 450 core
+
+in vec3 position;
+in layout(location=1) vec4 color;
+in layout(location=2) vec3 normal;
+
+// Filled by InstancedRenderer, with the instances of every draw call of the frame one after another
+struct Instance
+{
+    mat4 t_mat;
+    mat4 model_mat;
+};
+layout(std430, binding=0) readonly buffer Instances
+{
+    Instance instances[];
+};
+// Where the instances of the current draw call start
+uniform uint instance_offset;
+
+out layout(location=1) vec4 ex_color;
+out layout(location=2) vec3 ex_normal;
+void main()
+{
+    Instance instance = instances[instance_offset + uint(gl_InstanceID)];
+    vec4 new_pos = instance.t_mat*vec4(position, 1.0);
+    gl_Position = new_pos;
+    ex_color = color;
+    ex_normal = normalize(mat3(instance.model_mat) *normal);
+}
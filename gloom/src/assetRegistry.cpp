@@ -0,0 +1,116 @@
+#include <algorithm>
+#include "assetRegistry.hpp"
+
+bool AssetRegistry::request(const AssetKey &key, ReadyCallback onReady, FailedCallback onFailed)
+{
+    std::map<AssetKey, std::weak_ptr<GPUMesh>>::iterator resident = mResident.find(key);
+    if (resident != mResident.end()) {
+        std::shared_ptr<GPUMesh> mesh = resident->second.lock();
+        if (mesh) {
+            onReady(mesh);
+            return false;
+        }
+        mResident.erase(resident);
+    }
+
+    Waiter waiter;
+    waiter.ready = std::move(onReady);
+    waiter.failed = std::move(onFailed);
+    std::map<AssetKey, std::vector<Waiter>>::iterator waiting = mWaiting.find(key);
+    if (waiting != mWaiting.end()) {
+        waiting->second.push_back(std::move(waiter));
+        return false;
+    }
+    mWaiting[key].push_back(std::move(waiter));
+    return true;
+}
+
+std::shared_ptr<GPUMesh> AssetRegistry::publish(const AssetKey &key, const EncodedMesh &mesh, MeshArena *arena)
+{
+    std::shared_ptr<GPUMesh> gpuMesh = find(key);
+    if (!gpuMesh) {
+        gpuMesh = uploadMesh(mesh);
+        mResident[key] = gpuMesh;
+        if (mResident.size() >= mSweepSize) {
+            sweepReleased();
+        }
+        if (arena != nullptr) {
+            std::map<AssetKey, unsigned int>::iterator slot = mArenaMeshes.find(key);
+            if (slot == mArenaMeshes.end()) {
+                slot = mArenaMeshes.insert(std::make_pair(key, arena->add(mesh))).first;
+            }
+            gpuMesh->arenaMesh = slot->second;
+        }
+    }
+
+    std::map<AssetKey, std::vector<Waiter>>::iterator waiting = mWaiting.find(key);
+    if (waiting != mWaiting.end()) {
+        // Callbacks may request more assets, so take them out of the map first
+        std::vector<Waiter> waiters = std::move(waiting->second);
+        mWaiting.erase(waiting);
+        for (Waiter &waiter : waiters) {
+            waiter.ready(gpuMesh);
+        }
+    }
+    return gpuMesh;
+}
+
+void AssetRegistry::abandon(const AssetKey &key)
+{
+    std::map<AssetKey, std::vector<Waiter>>::iterator waiting = mWaiting.find(key);
+    if (waiting == mWaiting.end()) {
+        return;
+    }
+    // Callbacks may request key again, so take them out of the map first
+    std::vector<Waiter> waiters = std::move(waiting->second);
+    mWaiting.erase(waiting);
+    for (Waiter &waiter : waiters) {
+        if (waiter.failed) {
+            waiter.failed();
+        }
+    }
+}
+
+void AssetRegistry::sweepReleased()
+{
+    for (std::map<AssetKey, std::weak_ptr<GPUMesh>>::iterator resident = mResident.begin(); resident != mResident.end();) {
+        if (resident->second.expired()) {
+            resident = mResident.erase(resident);
+        } else {
+            ++resident;
+        }
+    }
+    mSweepSize = std::max(size_t(ASSET_REGISTRY_MIN_SWEEP_SIZE), mResident.size() * 2);
+}
+
+std::shared_ptr<GPUMesh> AssetRegistry::find(const AssetKey &key) const
+{
+    std::map<AssetKey, std::weak_ptr<GPUMesh>>::const_iterator resident = mResident.find(key);
+    if (resident == mResident.end()) {
+        return std::shared_ptr<GPUMesh>();
+    }
+    return resident->second.lock();
+}
+
+size_t AssetRegistry::residentCount() const
+{
+    size_t count = 0;
+    for (const std::pair<const AssetKey, std::weak_ptr<GPUMesh>> &resident : mResident) {
+        if (!resident.second.expired()) {
+            count++;
+        }
+    }
+    return count;
+}
+
+size_t AssetRegistry::residentBytes() const
+{
+    size_t bytes = 0;
+    for (const std::pair<const AssetKey, std::weak_ptr<GPUMesh>> &resident : mResident) {
+        std::shared_ptr<GPUMesh> mesh = resident.second.lock();
+        if (mesh) {
+            bytes += mesh->byteSize;
+        }
+    }
+    return bytes;
+}
@@ -0,0 +1,72 @@
+#ifndef GLOOM_ASSET_REGISTRY_HPP
+#define GLOOM_ASSET_REGISTRY_HPP
+
+#include <functional>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+#include <lib/vertexEncoding.hpp>
+#include "meshArena.hpp"
+#include "vao.hpp"
+
+// Entries of released assets are swept out once the map has grown to twice its size after the
+// last sweep, but never below this many entries
+#define ASSET_REGISTRY_MIN_SWEEP_SIZE 64
+
+// Identifies a mesh by the file it comes from and its name within that file
+typedef std::pair<std::string, std::string> AssetKey;
+
+// Hands out one shared GPUMesh per asset, however many scene nodes use it.
+//
+// The registry only keeps weak references, so an asset's GL objects are released as soon
+// as the last node using it lets go, and are uploaded again if it is requested later.
+// Requests for an asset that is still loading wait for that load instead of starting
+// another one. All functions must be called on the GL thread.
+class AssetRegistry {
+public:
+    AssetRegistry() : mSweepSize(ASSET_REGISTRY_MIN_SWEEP_SIZE) { }
+
+    typedef std::function<void(const std::shared_ptr<GPUMesh> &)> ReadyCallback;
+    typedef std::function<void()> FailedCallback;
+
+    // Runs onReady right away if key is resident, otherwise once it is published. If the
+    // load is abandoned instead, onFailed runs, if given.
+    // Returns true if the caller has to load key, i.e. it is neither resident nor loading.
+    bool request(const AssetKey &key, ReadyCallback onReady, FailedCallback onFailed = FailedCallback());
+
+    // Uploads mesh as key unless it is already resident, and hands it to everyone waiting.
+    // If arena is given, the mesh is also copied into it the first time key is published,
+    // and the uploaded mesh records its slot there.
+    std::shared_ptr<GPUMesh> publish(const AssetKey &key, const EncodedMesh &mesh, MeshArena *arena = nullptr);
+
+    // Gives up on key after its load failed, so that a later request tries again, and tells
+    // everyone waiting for it
+    void abandon(const AssetKey &key);
+
+    // Returns the resident mesh for key, or an empty pointer
+    std::shared_ptr<GPUMesh> find(const AssetKey &key) const;
+
+    // Number of assets currently on the GPU, and the video memory they take up
+    size_t residentCount() const;
+    size_t residentBytes() const;
+
+private:
+    // Erases the entries of assets that were released since they were published
+    void sweepReleased();
+
+    struct Waiter {
+        ReadyCallback ready;
+        FailedCallback failed;
+    };
+
+    // Also holds entries of released assets until they are looked up or swept
+    std::map<AssetKey, std::weak_ptr<GPUMesh>> mResident;
+    size_t mSweepSize;
+    std::map<AssetKey, std::vector<Waiter>> mWaiting;
+    // Arena slots outlive the meshes, so that an asset uploaded again keeps its slot
+    std::map<AssetKey, unsigned int> mArenaMeshes;
+};
+
+#endif //GLOOM_ASSET_REGISTRY_HPP
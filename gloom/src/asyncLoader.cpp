@@ -0,0 +1,285 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <lib/OBJLoader.hpp>
+#include "asyncLoader.hpp"
+#include "vao.hpp"
+
+// Object names in the helicopter OBJ file, in the order of the parts in HelicopterView
+static const char *const helicopterPartNames[] = {
+    "Body_body", "Main_Rotor_main_rotor", "Tail_Rotor_tail_rotor", "Door_door"
+};
+#define HELICOPTER_PART_COUNT 4
+
+AsyncLoader::AsyncLoader(AssetRegistry &registry, const VertexFormat &format, unsigned int workerCount,
+                         size_t uploadQueueCapacity, unsigned int parseThreads)
+    : mRegistry(registry),
+      mFormat(format),
+      mParseThreads(parseThreads),
+      mArena(nullptr),
+      mUploadQueueCapacity(std::max<size_t>(uploadQueueCapacity, 1)),
+      mActiveJobs(0),
+      mStopping(false)
+{
+    workerCount = resolveWorkerCount(workerCount);
+    for (unsigned int i = 0; i < workerCount; i++) {
+        mWorkers.emplace_back(&AsyncLoader::workerLoop, this);
+    }
+}
+
+AsyncLoader::~AsyncLoader()
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mStopping = true;
+    }
+    mJobAvailable.notify_all();
+    mUploadSpace.notify_all();
+    for (std::thread &worker : mWorkers) {
+        worker.join();
+    }
+}
+
+void AsyncLoader::submit(std::function<void()> job)
+{
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mJobs.push_back(std::move(job));
+        mActiveJobs++;
+    }
+    mJobAvailable.notify_one();
+}
+
+void AsyncLoader::queueUpload(std::function<void()> upload)
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mUploadSpace.wait(lock, [this]() { return mStopping || mUploads.size() < mUploadQueueCapacity; });
+    if (!mStopping) {
+        mUploads.push_back(std::move(upload));
+    }
+}
+
+void AsyncLoader::queueCleanup(std::function<void()> cleanup)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    if (!mStopping) {
+        mCleanups.push_back(std::move(cleanup));
+    }
+}
+
+void AsyncLoader::workerLoop()
+{
+    while (true) {
+        std::function<void()> job;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mJobAvailable.wait(lock, [this]() { return mStopping || !mJobs.empty(); });
+            if (mStopping) {
+                return;
+            }
+            job = std::move(mJobs.front());
+            mJobs.pop_front();
+        }
+
+        try {
+            job();
+        } catch (...) {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (!mError) {
+                mError = std::current_exception();
+            }
+        }
+
+        std::lock_guard<std::mutex> lock(mMutex);
+        mActiveJobs--;
+    }
+}
+
+unsigned int AsyncLoader::processUploads(double budgetSeconds)
+{
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    unsigned int uploaded = 0;
+
+    // Cleanups of failed jobs run whatever the budget
+    runCleanups();
+
+    while (true) {
+        std::function<void()> upload;
+        std::exception_ptr error;
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            error = mError;
+            mError = nullptr;
+        }
+        if (error) {
+            // The job queued its cleanup before recording its error, so it is queued by now
+            runCleanups();
+            std::rethrow_exception(error);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            if (mUploads.empty()) {
+                // Nothing is waiting for the shared caches any more, so unmap them
+                if (mActiveJobs == 0) {
+                    mCaches.clear();
+                }
+                break;
+            }
+            upload = std::move(mUploads.front());
+            mUploads.pop_front();
+        }
+        mUploadSpace.notify_one();
+
+        upload();
+        uploaded++;
+
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+        if (elapsed >= budgetSeconds) {
+            break;
+        }
+    }
+
+    return uploaded;
+}
+
+void AsyncLoader::runCleanups()
+{
+    // Run without the lock, since cleanups may request assets again
+    std::vector<std::function<void()>> cleanups;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        cleanups.swap(mCleanups);
+    }
+    for (std::function<void()> &cleanup : cleanups) {
+        cleanup();
+    }
+}
+
+bool AsyncLoader::idle()
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mActiveJobs == 0 && mUploads.empty() && mCleanups.empty();
+}
+
+std::shared_ptr<MeshCache> AsyncLoader::sharedCache(std::string const &srcFile,
+                                                    std::function<void(MeshCache &)> open)
+{
+    std::promise<std::shared_ptr<MeshCache>> promise;
+    std::shared_future<std::shared_ptr<MeshCache>> future;
+    bool opener = false;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        std::map<std::string, std::shared_future<std::shared_ptr<MeshCache>>>::iterator it = mCaches.find(srcFile);
+        if (it == mCaches.end()) {
+            future = promise.get_future().share();
+            mCaches[srcFile] = future;
+            opener = true;
+        } else {
+            future = it->second;
+        }
+    }
+
+    if (opener) {
+        try {
+            std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+            open(*cache);
+            promise.set_value(cache);
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+        }
+    }
+    return future.get();
+}
+
+void AsyncLoader::queueEncodedUpload(const AssetKey &key, const MeshView &view, bool staticMesh)
+{
+    // The encoded copy no longer refers to the cache, which can be unmapped once every job is done
+    std::shared_ptr<EncodedMesh> mesh = std::make_shared<EncodedMesh>(encodeMesh(view, mFormat));
+    // The arena is looked up on the GL thread, which is the only one setting it
+    queueUpload([=]() { mRegistry.publish(key, *mesh, staticMesh ? mArena : nullptr); });
+}
+
+void AsyncLoader::loadHelicopter(std::string const &srcFile, MeshAttachments &attachments, SceneHandle body,
+                                 SceneHandle door, SceneHandle tailRotor, SceneHandle mainRotor)
+{
+    SceneHandle nodes[HELICOPTER_PART_COUNT] = { body, mainRotor, tailRotor, door };
+    std::vector<AssetKey> missing;
+    for (unsigned int part = 0; part < HELICOPTER_PART_COUNT; part++) {
+        SceneHandle node = nodes[part];
+        AssetKey key(srcFile, helicopterPartNames[part]);
+        if (mRegistry.request(key, [&attachments, node](const std::shared_ptr<GPUMesh> &mesh) { attachments.add(node, mesh); })) {
+            missing.push_back(key);
+        }
+    }
+    if (missing.empty()) {
+        return;
+    }
+
+    submit([=]() {
+        try {
+            std::shared_ptr<MeshCache> cache = sharedCache(srcFile, [&](MeshCache &c) {
+                openHelicopterCache(c, srcFile, mParseThreads);
+            });
+            HelicopterView heli = viewHelicopter(*cache);
+            const MeshView *parts[HELICOPTER_PART_COUNT] = { &heli.body, &heli.mainRotor, &heli.tailRotor, &heli.door };
+            for (unsigned int part = 0; part < HELICOPTER_PART_COUNT; part++) {
+                AssetKey key(srcFile, helicopterPartNames[part]);
+                if (std::find(missing.begin(), missing.end(), key) == missing.end()) {
+                    continue;
+                }
+                queueEncodedUpload(key, *parts[part], true);
+            }
+        } catch (...) {
+            queueCleanup([=]() {
+                for (const AssetKey &key : missing) {
+                    mRegistry.abandon(key);
+                }
+            });
+            throw;
+        }
+    });
+}
+
+void AsyncLoader::loadTile(const std::shared_ptr<MeshCache> &tiles, std::string const &srcFile, size_t index,
+                           AssetRegistry::ReadyCallback onReady, AssetRegistry::FailedCallback onFailed)
+{
+    const MeshView &view = tiles->meshes().at(index);
+    AssetKey key(srcFile, view.name);
+    if (!mRegistry.request(key, std::move(onReady), std::move(onFailed))) {
+        return;
+    }
+
+    submit([=]() {
+        try {
+            queueEncodedUpload(key, tiles->meshes()[index], false);
+            // The encoded copy is all that is uploaded, the mapped arrays can go until the tile is loaded again
+            tiles->releaseMesh(index);
+        } catch (...) {
+            queueCleanup([=]() { mRegistry.abandon(key); });
+            throw;
+        }
+    });
+}
+
+void attachMesh(SceneStore &scene, SceneHandle node, const std::shared_ptr<GPUMesh> &mesh)
+{
+    scene.setMesh(node, mesh, mesh->boundsMin, mesh->boundsMax);
+}
+
+void MeshAttachments::add(SceneHandle node, const std::shared_ptr<GPUMesh> &mesh)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mPending.push_back(std::make_pair(node, mesh));
+}
+
+void MeshAttachments::apply(SceneStore &scene)
+{
+    std::vector<std::pair<SceneHandle, std::shared_ptr<GPUMesh>>> pending;
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        pending.swap(mPending);
+    }
+    for (const std::pair<SceneHandle, std::shared_ptr<GPUMesh>> &attachment : pending) {
+        attachMesh(scene, attachment.first, attachment.second);
+    }
+}
@@ -0,0 +1,131 @@
+#ifndef GLOOM_ASYNC_LOADER_HPP
+#define GLOOM_ASYNC_LOADER_HPP
+
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <utility>
+#include <thread>
+#include <vector>
+#include <lib/meshCache.hpp>
+#include <lib/sceneStore.hpp>
+#include "assetRegistry.hpp"
+
+// Meshes uploaded on the GL thread for the nodes of a scene another thread owns. Upload
+// callbacks add them, and the thread owning the scene attaches them with apply() while it is
+// not updating it.
+class MeshAttachments {
+public:
+    void add(SceneHandle node, const std::shared_ptr<GPUMesh> &mesh);
+    // Attaches every mesh added since the last call to its node of scene
+    void apply(SceneStore &scene);
+
+private:
+    std::mutex mMutex;
+    std::vector<std::pair<SceneHandle, std::shared_ptr<GPUMesh>>> mPending;
+};
+
+// Loads assets on background threads so that the GL thread never blocks on file parsing.
+//
+// Jobs run on worker threads and hand their results to the GL thread as upload tasks.
+// The upload queue is bounded, so workers wait instead of piling up parsed meshes while
+// the GL thread is busy. processUploads() is called once per frame and runs upload
+// tasks until the queue is empty or its time budget is used up.
+//
+// Uploaded meshes go through registry, so every asset is loaded once no matter how many
+// nodes ask for it.
+class AsyncLoader {
+public:
+    // parseThreads is passed on to the OBJ parser of every job, 0 uses every hardware thread
+    // Meshes are converted to format on the worker threads, before they are queued for upload
+    AsyncLoader(AssetRegistry &registry, const VertexFormat &format, unsigned int workerCount,
+                size_t uploadQueueCapacity, unsigned int parseThreads);
+    ~AsyncLoader();
+
+    AsyncLoader(const AsyncLoader &) = delete;
+    AsyncLoader &operator=(const AsyncLoader &) = delete;
+
+    // Runs job on a worker thread
+    void submit(std::function<void()> job);
+
+    // Queues work for the GL thread. Called from jobs; blocks while the queue is full.
+    void queueUpload(std::function<void()> upload);
+    // Queues work for the GL thread that undoes a failed job, such as giving up on its assets.
+    // Never blocks, and processUploads() runs it before rethrowing the job's error.
+    void queueCleanup(std::function<void()> cleanup);
+
+    // Loads the helicopter model unless it is resident or already loading, and hands the
+    // nodes their shared meshes through attachments once they are uploaded. Nodes destroyed
+    // in the meantime are skipped. Must be called on the GL thread.
+    void loadHelicopter(std::string const &srcFile, MeshAttachments &attachments, SceneHandle body, SceneHandle door,
+                        SceneHandle tailRotor, SceneHandle mainRotor);
+
+    // Loads mesh index of an open terrain tile cache, which is keyed by srcFile and the
+    // tile's name, and hands it to onReady once it is uploaded, or runs onFailed if the load
+    // fails. Releases the tile's pages of the cache once it is encoded. Must be called on the
+    // GL thread.
+    void loadTile(const std::shared_ptr<MeshCache> &tiles, std::string const &srcFile, size_t index,
+                  AssetRegistry::ReadyCallback onReady, AssetRegistry::FailedCallback onFailed);
+
+    // Must be called on the GL thread. Runs every queued cleanup, then at least one queued
+    // upload, and keeps going until the queue is empty or budgetSeconds have passed.
+    // Rethrows errors from jobs once their cleanups have run.
+    unsigned int processUploads(double budgetSeconds);
+
+    // True when no jobs, uploads or cleanups are left
+    bool idle();
+
+    // Format meshes are converted to before they are uploaded
+    const VertexFormat &format() const { return mFormat; }
+
+    // Also copies the helicopter parts uploaded from now on into arena, which must have been
+    // created with format(). Terrain tiles come and go, so they are never put in the arena.
+    // Must be called on the GL thread.
+    void setMeshArena(MeshArena *arena) { mArena = arena; }
+
+private:
+    void workerLoop();
+    // Runs the cleanups queued so far, on the GL thread
+    void runCleanups();
+
+    // Opens the mesh cache of srcFile once, however many jobs ask for it at the same time
+    std::shared_ptr<MeshCache> sharedCache(std::string const &srcFile,
+                                           std::function<void(MeshCache &)> open);
+
+    // Converts view to mFormat and queues its upload as key, copying it into mArena as well
+    // if it is a static mesh
+    void queueEncodedUpload(const AssetKey &key, const MeshView &view, bool staticMesh);
+
+    AssetRegistry &mRegistry;
+    VertexFormat mFormat;
+    unsigned int mParseThreads;
+    MeshArena *mArena;
+    size_t mUploadQueueCapacity;
+
+    std::mutex mMutex;
+    std::condition_variable mJobAvailable;
+    std::condition_variable mUploadSpace;
+    std::deque<std::function<void()>> mJobs;
+    std::deque<std::function<void()>> mUploads;
+    // Not bounded like the uploads, so that a failing job never waits to queue its cleanup
+    std::vector<std::function<void()>> mCleanups;
+    // Jobs that have been submitted but not finished yet
+    size_t mActiveJobs;
+    bool mStopping;
+    std::exception_ptr mError;
+
+    std::map<std::string, std::shared_future<std::shared_ptr<MeshCache>>> mCaches;
+
+    std::vector<std::thread> mWorkers;
+};
+
+// Makes node draw mesh, sharing it with any other node that uses it
+void attachMesh(SceneStore &scene, SceneHandle node, const std::shared_ptr<GPUMesh> &mesh);
+
+#endif //GLOOM_ASYNC_LOADER_HPP
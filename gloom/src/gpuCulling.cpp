@@ -0,0 +1,176 @@
+#include <GLFW/glfw3.h>
+#include <algorithm>
+#include <stdexcept>
+#include <glm/gtc/type_ptr.hpp>
+#include <lib/frustum.hpp>
+#include "gpuCulling.hpp"
+#include "instancing.hpp"
+#include "vao.hpp"
+
+// Part of GL 4.6 and GL_ARB_indirect_parameters, which the GL 4.5 headers do not know about
+#ifndef GL_PARAMETER_BUFFER
+#define GL_PARAMETER_BUFFER 0x80EE
+#endif
+
+static bool contextVersionAtLeast(int major, int minor)
+{
+    GLint contextMajor = 0;
+    GLint contextMinor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &contextMajor);
+    glGetIntegerv(GL_MINOR_VERSION, &contextMinor);
+    return contextMajor > major || (contextMajor == major && contextMinor >= minor);
+}
+
+bool GPUSceneRenderer::supported()
+{
+    return glfwExtensionSupported("GL_ARB_shader_draw_parameters") == GLFW_TRUE;
+}
+
+GPUSceneRenderer::GPUSceneRenderer(const std::string &cullShader, const std::string &vertexShader,
+                                   const std::string &fragmentShader, float maxPixelError, float minDistance)
+    : mMultiDrawCount(nullptr),
+      mUploaded(false),
+      mArenaVersion(0),
+      mSceneVersion(0),
+      mNodeCount(0) {
+    mCullShader.attach(cullShader);
+    mCullShader.link();
+    mDrawShader.makeBasicShader(vertexShader, fragmentShader);
+
+    mViewProjectionLoc = mCullShader.getUniformLocation("view_projection");
+    mFrustumPlanesLoc = mCullShader.getUniformLocation("frustum_planes");
+    mCameraPositionLoc = mCullShader.getUniformLocation("camera_position");
+    mPixelsPerUnitLoc = mCullShader.getUniformLocation("pixels_per_unit");
+    mObjectCountLoc = mCullShader.getUniformLocation("object_count");
+    GLint maxPixelErrorLoc = mCullShader.getUniformLocation("max_pixel_error");
+    GLint minDistanceLoc = mCullShader.getUniformLocation("min_distance");
+    if (mViewProjectionLoc == -1 || mFrustumPlanesLoc == -1 || mCameraPositionLoc == -1 || mPixelsPerUnitLoc == -1 ||
+        mObjectCountLoc == -1 || maxPixelErrorLoc == -1 || minDistanceLoc == -1) {
+        throw std::runtime_error("Could not find uniform locations");
+    }
+    glProgramUniform1f(mCullShader.get(), maxPixelErrorLoc, maxPixelError);
+    glProgramUniform1f(mCullShader.get(), minDistanceLoc, minDistance);
+
+    if (contextVersionAtLeast(4, 6)) {
+        mMultiDrawCount = reinterpret_cast<MultiDrawElementsIndirectCountProc>(
+                glfwGetProcAddress("glMultiDrawElementsIndirectCount"));
+    } else if (glfwExtensionSupported("GL_ARB_indirect_parameters")) {
+        mMultiDrawCount = reinterpret_cast<MultiDrawElementsIndirectCountProc>(
+                glfwGetProcAddress("glMultiDrawElementsIndirectCountARB"));
+    }
+
+    unsigned int buffers[6];
+    glCreateBuffers(6, buffers);
+    mMatrixBufferID = buffers[0];
+    mObjectBufferID = buffers[1];
+    mMeshBufferID = buffers[2];
+    mLODBufferID = buffers[3];
+    mCommandBufferID = buffers[4];
+    mDrawBufferID = buffers[5];
+    glCreateBuffers(1, &mDrawCountBufferID);
+    glNamedBufferStorage(mDrawCountBufferID, sizeof(GLuint), nullptr, GL_DYNAMIC_STORAGE_BIT);
+}
+
+GPUSceneRenderer::~GPUSceneRenderer() {
+    unsigned int buffers[7] = { mMatrixBufferID, mObjectBufferID, mMeshBufferID, mLODBufferID, mCommandBufferID,
+                                mDrawBufferID, mDrawCountBufferID };
+    glDeleteBuffers(7, buffers);
+    mCullShader.destroy();
+    mDrawShader.destroy();
+}
+
+void GPUSceneRenderer::uploadArena(const MeshArena &arena) {
+    const std::vector<ArenaMeshData> &meshes = arena.meshes();
+    const std::vector<ArenaLODData> &lods = arena.lods();
+    // Empty buffers can not be bound, so both get room for at least one entry
+    glNamedBufferData(mMeshBufferID, GLsizeiptr(std::max<size_t>(meshes.size(), 1) * sizeof(ArenaMeshData)),
+                      meshes.empty() ? nullptr : meshes.data(), GL_STATIC_DRAW);
+    glNamedBufferData(mLODBufferID, GLsizeiptr(std::max<size_t>(lods.size(), 1) * sizeof(ArenaLODData)),
+                      lods.empty() ? nullptr : lods.data(), GL_STATIC_DRAW);
+    mArenaVersion = arena.version();
+}
+
+void GPUSceneRenderer::uploadObjects(const SceneSnapshot &scene) {
+    const std::vector<const GPUMesh *> &meshes = scene.meshes;
+    mObjects.clear();
+    for (size_t node = 0; node < meshes.size(); node++) {
+        if (meshes[node] && meshes[node]->arenaMesh != NO_ARENA_MESH) {
+            mObjects.push_back(GPUSceneObject{ unsigned(node), meshes[node]->arenaMesh });
+        }
+    }
+
+    size_t objectCount = std::max<size_t>(mObjects.size(), 1);
+    glNamedBufferData(mObjectBufferID, GLsizeiptr(objectCount * sizeof(GPUSceneObject)),
+                      mObjects.empty() ? nullptr : mObjects.data(), GL_STATIC_DRAW);
+    glNamedBufferData(mCommandBufferID, GLsizeiptr(objectCount * sizeof(DrawElementsIndirectCommand)), nullptr, GL_DYNAMIC_DRAW);
+    glNamedBufferData(mDrawBufferID, GLsizeiptr(objectCount * sizeof(InstanceData)), nullptr, GL_DYNAMIC_DRAW);
+    mNodeCount = scene.nodeCount();
+    mSceneVersion = scene.structureVersion;
+}
+
+void GPUSceneRenderer::draw(const SceneSnapshot &scene, const MeshArena &arena, const glm::mat4 &viewProjection,
+                            const LODSelection &selection) {
+    if (!mUploaded || arena.version() != mArenaVersion) {
+        uploadArena(arena);
+    }
+    if (!mUploaded || scene.structureVersion != mSceneVersion || scene.nodeCount() != mNodeCount) {
+        uploadObjects(scene);
+    }
+    mUploaded = true;
+    if (mObjects.empty()) {
+        return;
+    }
+
+    // Orphaned first, so that the copy does not wait for the previous frame's draws
+    const std::vector<glm::mat4> &worldMatrices = scene.worldMatrices;
+    GLsizeiptr matrixBytes = GLsizeiptr(worldMatrices.size() * sizeof(glm::mat4));
+    glNamedBufferData(mMatrixBufferID, matrixBytes, nullptr, GL_STREAM_DRAW);
+    glNamedBufferSubData(mMatrixBufferID, 0, matrixBytes, worldMatrices.data());
+
+    GLuint zero = 0;
+    glClearNamedBufferData(mDrawCountBufferID, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    if (mMultiDrawCount == nullptr) {
+        // Every command past the count then draws nothing
+        glClearNamedBufferData(mCommandBufferID, GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &zero);
+    }
+
+    Frustum frustum = extractFrustum(viewProjection);
+    GLuint objectCount = GLuint(mObjects.size());
+    mCullShader.activate();
+    glUniformMatrix4fv(mViewProjectionLoc, 1, GL_FALSE, glm::value_ptr(viewProjection));
+    glUniform4fv(mFrustumPlanesLoc, 6, glm::value_ptr(frustum.planes[0]));
+    glUniform3fv(mCameraPositionLoc, 1, glm::value_ptr(selection.cameraPosition));
+    glUniform1f(mPixelsPerUnitLoc, selection.pixelsPerUnit);
+    glUniform1ui(mObjectCountLoc, objectCount);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_DRAW_BUFFER_BINDING, mDrawBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_MATRIX_BUFFER_BINDING, mMatrixBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_OBJECT_BUFFER_BINDING, mObjectBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_MESH_BUFFER_BINDING, mMeshBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_LOD_BUFFER_BINDING, mLODBufferID);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, GPU_COMMAND_BUFFER_BINDING, mCommandBufferID);
+    glBindBufferBase(GL_ATOMIC_COUNTER_BUFFER, GPU_DRAW_COUNT_BINDING, mDrawCountBufferID);
+    glDispatchCompute((objectCount + CULL_WORKGROUP_SIZE - 1) / CULL_WORKGROUP_SIZE, 1, 1);
+    // The commands and the count are read by the draw call, the matrices by the vertex shader
+    glMemoryBarrier(GL_COMMAND_BARRIER_BIT | GL_SHADER_STORAGE_BARRIER_BIT);
+
+    mDrawShader.activate();
+    glBindVertexArray(arena.vertexArray());
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, mCommandBufferID);
+    if (mMultiDrawCount != nullptr) {
+        glBindBuffer(GL_PARAMETER_BUFFER, mDrawCountBufferID);
+        mMultiDrawCount(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, 0, GLsizei(objectCount), 0);
+    } else {
+        glMultiDrawElementsIndirect(GL_TRIANGLES, GL_UNSIGNED_INT, nullptr, GLsizei(objectCount), 0);
+    }
+}
+
+unsigned int GPUSceneRenderer::readDrawCount() const {
+    if (mObjects.empty()) {
+        return 0;
+    }
+    // Atomic counter writes only become visible to buffer reads after a barrier
+    glMemoryBarrier(GL_BUFFER_UPDATE_BARRIER_BIT);
+    GLuint count = 0;
+    glGetNamedBufferSubData(mDrawCountBufferID, 0, sizeof(GLuint), &count);
+    return count;
+}
@@ -0,0 +1,120 @@
+#ifndef GLOOM_GPU_CULLING_HPP
+#define GLOOM_GPU_CULLING_HPP
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <gloom/shader.hpp>
+#include <lib/sceneStore.hpp>
+#include "meshArena.hpp"
+#include "program.hpp"
+
+// Shader storage bindings of the buffers read and written by cull.comp and simple_indirect.vert
+#define GPU_DRAW_BUFFER_BINDING 0
+#define GPU_MATRIX_BUFFER_BINDING 1
+#define GPU_OBJECT_BUFFER_BINDING 2
+#define GPU_MESH_BUFFER_BINDING 3
+#define GPU_LOD_BUFFER_BINDING 4
+#define GPU_COMMAND_BUFFER_BINDING 5
+// Atomic counter binding of the number of draws cull.comp wrote
+#define GPU_DRAW_COUNT_BINDING 0
+// Objects tested by one work group of cull.comp, its local_size_x
+#define CULL_WORKGROUP_SIZE 64
+
+// Draw parameters read by glMultiDrawElementsIndirect, laid out like DrawCommand in cull.comp
+struct DrawElementsIndirectCommand {
+    unsigned int count;
+    unsigned int instanceCount;
+    unsigned int firstIndex;
+    int baseVertex;
+    unsigned int baseInstance;
+};
+
+// A scene node drawing a mesh of the arena, laid out like SceneObject in cull.comp
+struct GPUSceneObject {
+    unsigned int node;
+    unsigned int mesh;
+};
+
+// Culls and draws every scene node whose mesh is in a MeshArena without any per object work
+// on the CPU.
+//
+// The world matrices of the scene go to a shader storage buffer in one copy per frame, next
+// to tables of the nodes with arena meshes and of the meshes and their levels of detail,
+// which are only uploaded again when the scene structure or the arena changes. cull.comp
+// then tests every object's box against the frustum on the GPU, picks its level of detail
+// like selectLOD does, and appends a draw command and the object's matrices to two buffers,
+// counting them with an atomic counter. A single glMultiDrawElementsIndirectCount draws
+// them all, sourcing the count from that counter, and simple_indirect.vert finds the
+// matrices of its draw through gl_DrawID. Without GL_ARB_indirect_parameters the command
+// buffer is cleared on the GPU every frame and glMultiDrawElementsIndirect runs a command
+// per object, of which the ones past the count draw nothing.
+//
+// Must be created, used and destroyed on the GL thread.
+class GPUSceneRenderer {
+public:
+    // Whether the context has what the renderer needs beyond GL 4.5, which is gl_DrawIDARB
+    // from GL_ARB_shader_draw_parameters. A GL 4.6 context has gl_DrawID in core, but does
+    // not have to list the extension simple_indirect.vert requires.
+    static bool supported();
+
+    // Builds the culling program out of cullShader and the drawing program out of
+    // vertexShader and fragmentShader. Levels of detail are picked as with selectLOD, for an
+    // error of at most maxPixelError, clamping the distance to minDistance.
+    GPUSceneRenderer(const std::string &cullShader, const std::string &vertexShader, const std::string &fragmentShader,
+                     float maxPixelError, float minDistance);
+    ~GPUSceneRenderer();
+
+    GPUSceneRenderer(const GPUSceneRenderer &) = delete;
+    GPUSceneRenderer &operator=(const GPUSceneRenderer &) = delete;
+
+    // Culls the nodes of scene whose meshes are in arena and draws the visible ones with one
+    // draw call, leaving the drawing program active
+    void draw(const SceneSnapshot &scene, const MeshArena &arena, const glm::mat4 &viewProjection,
+              const LODSelection &selection);
+
+    // Nodes the last draw() culled on the GPU
+    unsigned int objectCount() const { return unsigned(mObjects.size()); }
+    // Draws the last draw() made. Reads the count back from the GPU, which waits for it to
+    // finish culling, so this is only meant for occasional reports.
+    unsigned int readDrawCount() const;
+
+    // Whether the draw count is read from the GPU by glMultiDrawElementsIndirectCount
+    bool usesDrawCount() const { return mMultiDrawCount != nullptr; }
+
+private:
+    typedef void (APIENTRYP MultiDrawElementsIndirectCountProc)(GLenum mode, GLenum type, const void *indirect,
+                                                                GLintptr drawCount, GLsizei maxDrawCount, GLsizei stride);
+
+    // Uploads the mesh and level of detail tables of arena
+    void uploadArena(const MeshArena &arena);
+    // Lists the nodes of scene with arena meshes, and makes room for their draws
+    void uploadObjects(const SceneSnapshot &scene);
+
+    Gloom::Shader mCullShader;
+    Gloom::Shader mDrawShader;
+    GLint mViewProjectionLoc;
+    GLint mFrustumPlanesLoc;
+    GLint mCameraPositionLoc;
+    GLint mPixelsPerUnitLoc;
+    GLint mObjectCountLoc;
+    MultiDrawElementsIndirectCountProc mMultiDrawCount;
+
+    unsigned int mMatrixBufferID;
+    unsigned int mObjectBufferID;
+    unsigned int mMeshBufferID;
+    unsigned int mLODBufferID;
+    unsigned int mCommandBufferID;
+    unsigned int mDrawBufferID;
+    unsigned int mDrawCountBufferID;
+
+    // What the tables on the GPU were built from, to tell when they are stale
+    bool mUploaded;
+    unsigned int mArenaVersion;
+    unsigned int mSceneVersion;
+    size_t mNodeCount;
+    std::vector<GPUSceneObject> mObjects;
+};
+
+#endif //GLOOM_GPU_CULLING_HPP
@@ -1,127 +1,167 @@
 #include <GLFW/glfw3.h>
-#include <lib/sceneGraph.hpp>
 #include "inputs.hpp"
 
-#define TRANS_SPEED 1.0f
-#define ROT_SPEED 0.03f
+// Units and radians per second, what used to be moved every frame at 60 frames per second
+#define TRANS_SPEED 60.0f
+#define ROT_SPEED 1.8f
 
-void handleInputsHeli(GLFWwindow* window, SceneNode* sceneNode)
+// Keys the simulation reacts to, bit i of an InputState standing for entry i
+static const int sampledKeys[] = {
+    GLFW_KEY_W, GLFW_KEY_A, GLFW_KEY_S, GLFW_KEY_D, GLFW_KEY_LEFT_SHIFT, GLFW_KEY_SPACE, GLFW_KEY_L,
+    GLFW_KEY_H, GLFW_KEY_J, GLFW_KEY_K, GLFW_KEY_R, GLFW_KEY_T, GLFW_KEY_ENTER, GLFW_KEY_C
+};
+#define SAMPLED_KEY_COUNT (sizeof(sampledKeys) / sizeof(sampledKeys[0]))
+
+static bool held(InputState keys, int key)
+{
+    for (unsigned int i = 0; i < SAMPLED_KEY_COUNT; i++)
+    {
+        if (sampledKeys[i] == key)
+        {
+            return (keys >> i) & 1u;
+        }
+    }
+    return false;
+}
+
+InputState sampleInputs(GLFWwindow* window)
+{
+    InputState keys = 0;
+    for (unsigned int i = 0; i < SAMPLED_KEY_COUNT; i++)
+    {
+        if (glfwGetKey(window, sampledKeys[i]) == GLFW_PRESS)
+        {
+            keys |= InputState(1) << i;
+        }
+    }
+    return keys;
+}
+
+void handleInputsHeli(InputState keys, glm::vec3 &position, glm::vec3 &rotation, float stepSeconds)
 {
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    float distance = TRANS_SPEED * stepSeconds;
+    float angle = ROT_SPEED * stepSeconds;
+
+    if (held(keys, GLFW_KEY_W))
     {
-        sceneNode->position.x -= std::sin(sceneNode->rotation.x) * TRANS_SPEED;
-        sceneNode->position.z -= std::cos(sceneNode->rotation.x) * TRANS_SPEED;
+        position.x -= std::sin(rotation.x) * distance;
+        position.z -= std::cos(rotation.x) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_S))
     {
-        sceneNode->position.x += std::sin(sceneNode->rotation.x) * TRANS_SPEED;
-        sceneNode->position.z += std::cos(sceneNode->rotation.x) * TRANS_SPEED;
+        position.x += std::sin(rotation.x) * distance;
+        position.z += std::cos(rotation.x) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_LEFT_SHIFT))
     {
-        sceneNode->position.y -= TRANS_SPEED;
+        position.y -= distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_SPACE))
     {
-        sceneNode->position.y += TRANS_SPEED;
+        position.y += distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_D))
     {
-        sceneNode->rotation.x -= ROT_SPEED;
+        rotation.x -= angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_A))
     {
-        sceneNode->rotation.x += ROT_SPEED;
+        rotation.x += angle;
     }
 }
 
-void handleInputsCamera(GLFWwindow* window, Camera &cam)
+void handleInputsCamera(InputState keys, Camera &cam, float stepSeconds)
 {
-    if (glfwGetKey(window, GLFW_KEY_A) == GLFW_PRESS)
+    float distance = TRANS_SPEED * stepSeconds;
+    float angle = ROT_SPEED * stepSeconds;
+    if (held(keys, GLFW_KEY_A))
     {
-        cam.x += std::cos(cam.phi) * TRANS_SPEED;
-        cam.z += std::sin(cam.phi) * TRANS_SPEED;
+        cam.x += std::cos(cam.phi) * distance;
+        cam.z += std::sin(cam.phi) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_D) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_D))
     {
-        cam.x -= std::cos(cam.phi) * TRANS_SPEED;
-        cam.z -= std::sin(cam.phi) * TRANS_SPEED;
+        cam.x -= std::cos(cam.phi) * distance;
+        cam.z -= std::sin(cam.phi) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_W) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_W))
     {
-        cam.x -= std::sin(cam.phi) * TRANS_SPEED;
-        cam.z += std::cos(cam.phi) * TRANS_SPEED;
+        cam.x -= std::sin(cam.phi) * distance;
+        cam.z += std::cos(cam.phi) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_S) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_S))
     {
-        cam.x += std::sin(cam.phi) * TRANS_SPEED;
-        cam.z -= std::cos(cam.phi) * TRANS_SPEED;
+        cam.x += std::sin(cam.phi) * distance;
+        cam.z -= std::cos(cam.phi) * distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_LEFT_SHIFT) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_LEFT_SHIFT))
     {
-        cam.y += TRANS_SPEED;
+        cam.y += distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_SPACE) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_SPACE))
     {
-        cam.y -= TRANS_SPEED;
+        cam.y -= distance;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_L) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_L))
     {
-        cam.phi += ROT_SPEED;
+        cam.phi += angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_H) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_H))
     {
-        cam.phi -= ROT_SPEED;
+        cam.phi -= angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_J) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_J))
     {
-        cam.theta += ROT_SPEED;
+        cam.theta += angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_K) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_K))
     {
-        cam.theta -= ROT_SPEED;
+        cam.theta -= angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_R) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_R))
     {
-        cam.psi += ROT_SPEED;
+        cam.psi += angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_T) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_T))
     {
-        cam.psi -= ROT_SPEED;
+        cam.psi -= angle;
     }
 
-    if (glfwGetKey(window, GLFW_KEY_ENTER) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_ENTER))
     {
         cam = Camera{1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, false};
     }
 }
 
-void handleInputsOther(GLFWwindow * window, Camera &cam)
+void handleInputsOther(InputState keys, Camera &cam)
 {
-    // Use escape key for terminating the GLFW window
-    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
+    if (held(keys, GLFW_KEY_C))
     {
-        glfwSetWindowShouldClose(window, GL_TRUE);
+        cam.chase = !cam.chase;
     }
+}
 
-    if (glfwGetKey(window, GLFW_KEY_C) == GLFW_PRESS)
+void handleInputsWindow(GLFWwindow* window)
+{
+    // Use escape key for terminating the GLFW window
+    if (glfwGetKey(window, GLFW_KEY_ESCAPE) == GLFW_PRESS)
     {
-        cam.chase = !cam.chase;
+        glfwSetWindowShouldClose(window, GL_TRUE);
     }
 }
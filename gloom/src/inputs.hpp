@@ -3,9 +3,21 @@
 
 #include "program.hpp"
 
-// Function for handling key presses
-void handleInputsCamera(GLFWwindow* window, Camera &cam);
-void handleInputsHeli(GLFWwindow* window, SceneNode* sceneNode);
-void handleInputsOther(GLFWwindow* window, Camera &cam);
+// Keys held down, one bit for each key the simulation reacts to. Sampled from the window on
+// the thread polling its events, so that the simulation can run on a thread of its own.
+typedef unsigned int InputState;
+
+// Reads which of the keys below are held down. Must be called on the thread polling the
+// events of window.
+InputState sampleInputs(GLFWwindow* window);
+
+// Function for handling key presses. The camera and the helicopter move as far as the keys
+// held down move them in stepSeconds.
+void handleInputsCamera(InputState keys, Camera &cam, float stepSeconds);
+void handleInputsHeli(InputState keys, glm::vec3 &position, glm::vec3 &rotation, float stepSeconds);
+// Toggles the chase camera while C is held down
+void handleInputsOther(InputState keys, Camera &cam);
+// Closes window when escape is pressed. Must be called on the thread polling its events.
+void handleInputsWindow(GLFWwindow* window);
 
 #endif //GLOOM_INPUTS_HPP
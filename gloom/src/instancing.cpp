@@ -0,0 +1,84 @@
+#include <algorithm>
+#include "instancing.hpp"
+#include "vao.hpp"
+
+// Instances the buffer starts out with room for. It doubles whenever a frame needs more.
+#define INITIAL_INSTANCE_CAPACITY 256
+
+// Orders draws by mesh and then by level of detail, so that each group is contiguous
+static bool drawsBefore(const DrawItem *a, const DrawItem *b) {
+    if (a->mesh != b->mesh) {
+        return std::less<const GPUMesh *>()(a->mesh, b->mesh);
+    }
+    return a->lod.indexOffset < b->lod.indexOffset;
+}
+
+static bool sameGroup(const DrawItem *a, const DrawItem *b) {
+    return a->mesh == b->mesh && a->lod.indexOffset == b->lod.indexOffset;
+}
+
+InstancedRenderer::InstancedRenderer()
+    : mBufferID(0),
+      mCapacity(0) {
+    glCreateBuffers(1, &mBufferID);
+    orphan(INITIAL_INSTANCE_CAPACITY);
+}
+
+InstancedRenderer::~InstancedRenderer() {
+    glDeleteBuffers(1, &mBufferID);
+}
+
+void InstancedRenderer::orphan(size_t instanceCount) {
+    if (instanceCount > mCapacity) {
+        mCapacity = std::max<size_t>(mCapacity * 2, instanceCount);
+    }
+    glNamedBufferData(mBufferID, GLsizeiptr(mCapacity * sizeof(InstanceData)), nullptr, GL_STREAM_DRAW);
+}
+
+unsigned int InstancedRenderer::draw(const SceneSnapshot &scene, const std::vector<std::vector<DrawItem>> &drawLists,
+                                     const glm::mat4 &viewProjection, GLint instanceOffsetLoc) {
+    mSorted.clear();
+    for (const std::vector<DrawItem> &draws : drawLists) {
+        for (const DrawItem &draw : draws) {
+            mSorted.push_back(&draw);
+        }
+    }
+    if (mSorted.empty()) {
+        return 0;
+    }
+    // Stable, so instances keep the order of the scene within their group
+    std::stable_sort(mSorted.begin(), mSorted.end(), drawsBefore);
+
+    const std::vector<glm::mat4> &worldMatrices = scene.worldMatrices;
+    mInstances.resize(mSorted.size());
+    for (size_t i = 0; i < mSorted.size(); i++) {
+        const DrawItem &draw = *mSorted[i];
+        const glm::mat4 &model = worldMatrices[draw.node];
+        // Dequantisation only applies to positions, normals just need the model matrix
+        mInstances[i].tMat = viewProjection * model * draw.mesh->positionTransform;
+        mInstances[i].modelMat = model;
+    }
+
+    orphan(mInstances.size());
+    glNamedBufferSubData(mBufferID, 0, GLsizeiptr(mInstances.size() * sizeof(InstanceData)), mInstances.data());
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, INSTANCE_BUFFER_BINDING, mBufferID);
+
+    unsigned int drawCalls = 0;
+    size_t first = 0;
+    while (first < mSorted.size()) {
+        size_t end = first + 1;
+        while (end < mSorted.size() && sameGroup(mSorted[first], mSorted[end])) {
+            end++;
+        }
+
+        const DrawItem &draw = *mSorted[first];
+        size_t indexSize = draw.mesh->shortIndices ? sizeof(unsigned short) : sizeof(unsigned int);
+        glUniform1ui(instanceOffsetLoc, GLuint(first));
+        glBindVertexArray(draw.mesh->vertexArrayObjectID);
+        glDrawElementsInstanced(GL_TRIANGLES, draw.lod.indexCount, draw.mesh->shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                                reinterpret_cast<const void *>(draw.lod.indexOffset * indexSize), GLsizei(end - first));
+        drawCalls++;
+        first = end;
+    }
+    return drawCalls;
+}
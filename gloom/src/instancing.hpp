@@ -0,0 +1,56 @@
+#ifndef GLOOM_INSTANCING_HPP
+#define GLOOM_INSTANCING_HPP
+
+#include <vector>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <lib/sceneStore.hpp>
+#include "program.hpp"
+
+// Shader storage binding the instance buffer is read from, see simple_instanced.vert
+#define INSTANCE_BUFFER_BINDING 0
+
+// One entry of the instance buffer, laid out like Instance in simple_instanced.vert
+struct InstanceData {
+    glm::mat4 tMat;
+    glm::mat4 modelMat;
+};
+
+// Draws every node sharing a mesh and level of detail with a single instanced draw call.
+//
+// Each frame the draw items are grouped by mesh and level of detail, and the matrices of
+// every instance are written to one shader storage buffer, group after group. The buffer is
+// orphaned before it is refilled, so the driver never waits for the previous frame to stop
+// reading it. Each group then takes one glDrawElementsInstanced, telling the shader where
+// its instances start, so the number of draw calls only depends on how many different
+// meshes are visible.
+//
+// Must be created, used and destroyed on the GL thread.
+class InstancedRenderer {
+public:
+    InstancedRenderer();
+    ~InstancedRenderer();
+
+    InstancedRenderer(const InstancedRenderer &) = delete;
+    InstancedRenderer &operator=(const InstancedRenderer &) = delete;
+
+    // Draws the items of every list with the current shader, which has to be
+    // simple_instanced.vert or read its instances the same way. instanceOffsetLoc is the
+    // location of its instance_offset uniform. The items refer to the nodes of scene.
+    // Returns the number of draw calls made.
+    unsigned int draw(const SceneSnapshot &scene, const std::vector<std::vector<DrawItem>> &drawLists,
+                      const glm::mat4 &viewProjection, GLint instanceOffsetLoc);
+
+private:
+    // Makes room for instanceCount instances and gives the buffer fresh storage
+    void orphan(size_t instanceCount);
+
+    unsigned int mBufferID;
+    // Instances the buffer can hold
+    size_t mCapacity;
+    // Kept between frames to reuse the allocations
+    std::vector<const DrawItem *> mSorted;
+    std::vector<InstanceData> mInstances;
+};
+
+#endif //GLOOM_INSTANCING_HPP
@@ -1,9 +1,22 @@
 #include "OBJLoader.hpp"
 #include <algorithm>
 #include <exception>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdint>
+#include <atomic>
+#include <thread>
+#include "mappedFile.hpp"
+#include "meshCache.hpp"
+#include "meshOptimiser.hpp"
+#include "meshSimplifier.hpp"
 #include "sceneGraph.hpp"
 #include "toolbox.hpp"
 
+// Files are only split up if every worker gets at least this much to parse
+#define OBJ_MIN_CHUNK_BYTES (1 << 20)
+
 void split(std::string &target, const char delimiter, std::vector<std::string> &res, unsigned int* outLength)
 {
     size_t pos = 0;
@@ -186,6 +199,683 @@ std::vector<VectorMesh> loadWavefront(std::string const srcFile, bool quiet)
 	return meshes;
 }
 
+// --- Memory mapped OBJ parsing ---
+
+static inline bool isBlank(char c) {
+	return c == ' ' || c == '\t' || c == '\r';
+}
+
+static inline const char *skipBlanks(const char *p, const char *end) {
+	while (p < end && isBlank(*p)) {
+		p++;
+	}
+	return p;
+}
+
+// Exact powers of ten representable by a double
+static const double powersOfTen[] = {
+	1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+	1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+};
+
+// Parses a decimal float like "-1.25e-3" starting at p, advancing p past it.
+// Does not allocate and ignores the current locale. Returns false if no digits were found.
+static bool parseFloat(const char *&p, const char *end, float &out) {
+	const char *c = p;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		c++;
+	}
+
+	unsigned long long mantissa = 0;
+	int exponent = 0;
+	int significantDigits = 0;
+	bool anyDigits = false;
+
+	for (; c < end && *c >= '0' && *c <= '9'; c++) {
+		anyDigits = true;
+		if (significantDigits < 19) {
+			mantissa = mantissa * 10 + static_cast<unsigned>(*c - '0');
+			significantDigits += mantissa != 0;
+		} else {
+			exponent++;
+		}
+	}
+	if (c < end && *c == '.') {
+		c++;
+		for (; c < end && *c >= '0' && *c <= '9'; c++) {
+			anyDigits = true;
+			if (significantDigits < 19) {
+				mantissa = mantissa * 10 + static_cast<unsigned>(*c - '0');
+				significantDigits += mantissa != 0;
+				exponent--;
+			}
+		}
+	}
+	if (!anyDigits) {
+		return false;
+	}
+
+	if (c < end && (*c == 'e' || *c == 'E')) {
+		const char *e = c + 1;
+		bool negativeExponent = false;
+		if (e < end && (*e == '-' || *e == '+')) {
+			negativeExponent = *e == '-';
+			e++;
+		}
+		if (e < end && *e >= '0' && *e <= '9') {
+			int value = 0;
+			for (; e < end && *e >= '0' && *e <= '9'; e++) {
+				if (value < 10000) {
+					value = value * 10 + (*e - '0');
+				}
+			}
+			exponent += negativeExponent ? -value : value;
+			c = e;
+		}
+	}
+
+	double value = static_cast<double>(mantissa);
+	if (exponent < 0) {
+		value = (exponent >= -22) ? value / powersOfTen[-exponent] : value * std::pow(10.0, exponent);
+	} else if (exponent > 0) {
+		value = (exponent <= 22) ? value * powersOfTen[exponent] : value * std::pow(10.0, exponent);
+	}
+
+	out = static_cast<float>(negative ? -value : value);
+	p = c;
+	return true;
+}
+
+// Parses up to maxCount blank separated floats, returning how many were found
+static unsigned int parseFloats(const char *&p, const char *end, float *out, unsigned int maxCount) {
+	unsigned int count = 0;
+	while (count < maxCount && parseFloat(p, end, out[count])) {
+		count++;
+		p = skipBlanks(p, end);
+	}
+	return count;
+}
+
+// Parses a signed decimal integer starting at p, advancing p past it
+static bool parseInt(const char *&p, const char *end, long &out) {
+	const char *c = p;
+	bool negative = false;
+	if (c < end && (*c == '-' || *c == '+')) {
+		negative = *c == '-';
+		c++;
+	}
+	if (c == end || *c < '0' || *c > '9') {
+		return false;
+	}
+	long value = 0;
+	for (; c < end && *c >= '0' && *c <= '9'; c++) {
+		value = value * 10 + (*c - '0');
+	}
+	out = negative ? -value : value;
+	p = c;
+	return true;
+}
+
+// One "v/vt/vn" group of a face definition
+struct FaceCorner {
+	long vertex;
+	long normal;
+	unsigned int componentCount;
+	bool valid;
+};
+
+// Parses a single face corner token such as "12//7" or "3/1/2", leaving p at the end of the token
+static void parseFaceCorner(const char *&p, const char *end, FaceCorner &corner) {
+	corner.vertex = 0;
+	corner.normal = 0;
+	corner.componentCount = 0;
+	corner.valid = true;
+
+	while (true) {
+		if (corner.componentCount == 0) {
+			corner.valid = parseInt(p, end, corner.vertex);
+		} else if (corner.componentCount == 2) {
+			corner.valid = corner.valid && parseInt(p, end, corner.normal);
+		}
+		// Skip whatever is left of the component, e.g. texture coordinates
+		while (p < end && *p != '/' && !isBlank(*p)) {
+			p++;
+		}
+		corner.componentCount++;
+		if (p < end && *p == '/') {
+			p++;
+			continue;
+		}
+		break;
+	}
+}
+
+// Converts a parsed OBJ index to the unsigned form stored in ParsedFace.
+// Anything that can not be a valid 1-based index becomes 0, which fails validation later.
+static inline unsigned int toObjIndex(long index) {
+	return (index > 0 && static_cast<unsigned long>(index) <= std::numeric_limits<unsigned int>::max()) ? unsigned(index) : 0;
+}
+
+// A face as read from one chunk of the file. Indices are still 1-based OBJ indices;
+// they are validated against the vertices read so far once all chunks are merged.
+struct ParsedFace {
+	unsigned int vertices[4];
+	unsigned int normals[4];
+	// Number of vertices and normals read earlier in the same chunk
+	unsigned int chunkVertexCount;
+	unsigned int chunkNormalCount;
+	// Start of the face's line, used for warnings
+	const char *line;
+	unsigned char cornerCount;
+	bool hasNormals;
+	bool consistent;
+	// Set while merging if the face passed validation
+	bool emit;
+};
+
+// An "o" line, which starts a new object before faces[firstFace]
+struct ParsedObject {
+	std::string name;
+	size_t firstFace;
+};
+
+// Consecutive faces of a chunk that end up in the same mesh
+struct FaceRun {
+	size_t mesh;
+	size_t firstFace;
+	size_t endFace;
+	// Where the run's first triangle corner goes in the mesh
+	size_t firstCorner;
+};
+
+// Everything read from one line-aligned slice of the file
+struct OBJChunk {
+	const char *begin;
+	const char *end;
+	std::vector<float4> vertices;
+	std::vector<float3> normals;
+	std::vector<ParsedFace> faces;
+	std::vector<ParsedObject> objects;
+
+	// Filled in while merging
+	size_t vertexOffset;
+	size_t normalOffset;
+	std::vector<FaceRun> runs;
+};
+
+// Upper bounds for the number of v, vn and f records in a chunk
+struct RecordCounts {
+	size_t vertices;
+	size_t normals;
+	size_t faces;
+};
+
+// Cheap pass over a chunk that only looks at the keyword of each line, so that
+// parseChunk can size its arrays exactly instead of letting them grow by doubling
+static RecordCounts countRecords(const OBJChunk &chunk) {
+	RecordCounts counts = { 0, 0, 0 };
+	const char *p = chunk.begin;
+
+	while (p < chunk.end) {
+		const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', size_t(chunk.end - p)));
+		if (lineEnd == nullptr) {
+			lineEnd = chunk.end;
+		}
+		const char *c = skipBlanks(p, lineEnd);
+		p = lineEnd + 1;
+
+		if (lineEnd - c < 2) {
+			continue;
+		}
+		if (c[0] == 'v' && isBlank(c[1])) {
+			counts.vertices++;
+		} else if (c[0] == 'v' && c[1] == 'n') {
+			counts.normals++;
+		} else if (c[0] == 'f' && isBlank(c[1])) {
+			counts.faces++;
+		}
+	}
+	return counts;
+}
+
+// Reads the v, vn, o and f records of a chunk. Only depends on the chunk itself,
+// so all chunks can be parsed at the same time.
+static void parseChunk(OBJChunk &chunk) {
+	RecordCounts counts = countRecords(chunk);
+	chunk.vertices.reserve(counts.vertices);
+	chunk.normals.reserve(counts.normals);
+	chunk.faces.reserve(counts.faces);
+
+	const char *p = chunk.begin;
+
+	while (p < chunk.end) {
+		const char *lineStart = p;
+		const char *lineEnd = static_cast<const char *>(std::memchr(p, '\n', size_t(chunk.end - p)));
+		if (lineEnd == nullptr) {
+			lineEnd = chunk.end;
+		}
+		p = lineEnd + 1;
+
+		const char *c = skipBlanks(lineStart, lineEnd);
+		const char *keyword = c;
+		while (c < lineEnd && !isBlank(*c)) {
+			c++;
+		}
+		size_t keywordLength = size_t(c - keyword);
+		c = skipBlanks(c, lineEnd);
+
+		if (keywordLength == 1 && keyword[0] == 'v') {
+			float values[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+			if (parseFloats(c, lineEnd, values, 4) >= 3) {
+				chunk.vertices.emplace_back(values[0], values[1], values[2], values[3]);
+			}
+		} else if (keywordLength == 2 && keyword[0] == 'v' && keyword[1] == 'n') {
+			float values[3];
+			if (parseFloats(c, lineEnd, values, 3) == 3) {
+				chunk.normals.emplace_back(values[0], values[1], values[2]);
+			}
+		} else if (keywordLength == 1 && keyword[0] == 'o') {
+			const char *nameEnd = c;
+			while (nameEnd < lineEnd && !isBlank(*nameEnd)) {
+				nameEnd++;
+			}
+			if (nameEnd != c) {
+				ParsedObject object;
+				object.name = std::string(c, nameEnd);
+				object.firstFace = chunk.faces.size();
+				chunk.objects.push_back(object);
+			}
+		} else if (keywordLength == 1 && keyword[0] == 'f') {
+			// Only the first four corners are used, like loadWavefront does
+			FaceCorner corners[4];
+			unsigned int cornerCount = 0;
+			while (c < lineEnd && cornerCount < 4) {
+				parseFaceCorner(c, lineEnd, corners[cornerCount++]);
+				c = skipBlanks(c, lineEnd);
+			}
+			if (cornerCount < 3) {
+				continue;
+			}
+
+			ParsedFace face;
+			face.line = lineStart;
+			face.cornerCount = static_cast<unsigned char>(cornerCount);
+			face.hasNormals = corners[0].componentCount >= 3;
+			face.consistent = true;
+			face.emit = false;
+			face.chunkVertexCount = static_cast<unsigned int>(chunk.vertices.size());
+			face.chunkNormalCount = static_cast<unsigned int>(chunk.normals.size());
+			for (unsigned int i = 0; i < 4; i++) {
+				face.vertices[i] = i < cornerCount ? toObjIndex(corners[i].vertex) : 0;
+				face.normals[i] = i < cornerCount ? toObjIndex(corners[i].normal) : 0;
+				if (i < cornerCount) {
+					face.consistent = face.consistent && corners[i].valid && corners[i].componentCount == corners[0].componentCount;
+				}
+			}
+			chunk.faces.push_back(face);
+		}
+	}
+}
+
+// Splits the file into at most chunkCount slices that each start at the beginning of a line
+static std::vector<OBJChunk> splitIntoChunks(const char *begin, const char *end, unsigned int chunkCount) {
+	std::vector<OBJChunk> chunks(chunkCount);
+	size_t size = size_t(end - begin);
+	const char *chunkStart = begin;
+	for (unsigned int i = 0; i < chunkCount; i++) {
+		const char *chunkEnd = end;
+		if (i + 1 < chunkCount) {
+			chunkEnd = begin + size * (i + 1) / chunkCount;
+			if (chunkEnd < chunkStart) {
+				chunkEnd = chunkStart;
+			}
+			const char *newline = static_cast<const char *>(std::memchr(chunkEnd, '\n', size_t(end - chunkEnd)));
+			chunkEnd = newline == nullptr ? end : newline + 1;
+		}
+		chunks[i].begin = chunkStart;
+		chunks[i].end = chunkEnd;
+		chunkStart = chunkEnd;
+	}
+	return chunks;
+}
+
+// Runs task(i) for every i in [0, count) on up to workerCount threads
+template <typename Task>
+static void parallelFor(size_t count, unsigned int workerCount, Task task) {
+	if (workerCount <= 1 || count <= 1) {
+		for (size_t i = 0; i < count; i++) {
+			task(i);
+		}
+		return;
+	}
+
+	std::atomic<size_t> next(0);
+	std::vector<std::thread> workers;
+	for (size_t w = 0; w < std::min<size_t>(workerCount, count); w++) {
+		workers.emplace_back([&]() {
+			for (size_t i = next++; i < count; i = next++) {
+				task(i);
+			}
+		});
+	}
+	for (std::thread &worker : workers) {
+		worker.join();
+	}
+}
+
+// Walks the faces of all chunks in file order, creating meshes at object boundaries and
+// validating indices exactly like the serial loader would. Returns the triangle corner count of every mesh.
+static std::vector<size_t> assignFaces(std::vector<OBJChunk> &chunks, std::vector<VectorMesh> &meshes, bool quiet) {
+	std::vector<size_t> cornerCounts;
+
+	for (OBJChunk &chunk : chunks) {
+		size_t nextObject = 0;
+		for (size_t f = 0; f <= chunk.faces.size(); f++) {
+			while (nextObject < chunk.objects.size() && chunk.objects[nextObject].firstFace == f) {
+				meshes.emplace_back(chunk.objects[nextObject].name);
+				cornerCounts.push_back(0);
+				nextObject++;
+			}
+			if (f == chunk.faces.size()) {
+				break;
+			}
+
+			ParsedFace &face = chunk.faces[f];
+			if (meshes.size() == 0) {
+				if (!quiet) {
+					std::cout << "[WARNING] face definition found, but no object" << std::endl;
+					std::cout << "[WARNING] creating object 'noname'" << std::endl;
+				}
+				meshes.emplace_back("noname");
+				cornerCounts.push_back(0);
+			}
+
+			VectorMesh &mesh = meshes.back();
+			bool quadruple = face.cornerCount == 4;
+
+			if (!face.consistent) {
+				if (!quiet) {
+					const char *lineEnd = static_cast<const char *>(std::memchr(face.line, '\n', size_t(chunk.end - face.line)));
+					std::cout << "[WARNING] invalid face defintion '" << std::string(face.line, lineEnd != nullptr ? lineEnd : chunk.end) << "'" << std::endl;
+				}
+				continue;
+			}
+
+			mesh.hasNormals = face.hasNormals;
+
+			size_t vertexLimit = chunk.vertexOffset + face.chunkVertexCount;
+			size_t normalLimit = chunk.normalOffset + face.chunkNormalCount;
+			bool verticesExist = true;
+			bool normalsExist = true;
+			for (unsigned int i = 0; i < face.cornerCount; i++) {
+				verticesExist = verticesExist && size_t(face.vertices[i]) - 1 < vertexLimit;
+				normalsExist = normalsExist && (!face.hasNormals || size_t(face.normals[i]) - 1 < normalLimit);
+			}
+
+			if (!verticesExist) {
+				if (!quiet) {
+					std::cout << "[WARNING] VectorMesh " << mesh.name << " faces vertices(" << size_t(face.vertices[0]) - 1 << ", " << size_t(face.vertices[1]) - 1 << ", " << size_t(face.vertices[2]) - 1;
+					if (quadruple)
+						std::cout << ", " << size_t(face.vertices[3]) - 1;
+					std::cout << ") do not exist!" << std::endl;
+				}
+				continue;
+			}
+			if (!normalsExist) {
+				if (!quiet) {
+					std::cout << "[WARNING] VectorMesh " << mesh.name << " faces normals(" << size_t(face.normals[0]) - 1 << ", " << size_t(face.normals[1]) - 1 << ", " << size_t(face.normals[2]) - 1;
+					if (quadruple)
+						std::cout << ", " << size_t(face.normals[3]) - 1;
+					std::cout << ") do not exist!" << std::endl;
+				}
+				continue;
+			}
+
+			face.emit = true;
+			size_t meshIndex = meshes.size() - 1;
+			if (chunk.runs.empty() || chunk.runs.back().mesh != meshIndex) {
+				FaceRun run;
+				run.mesh = meshIndex;
+				run.firstFace = f;
+				run.firstCorner = cornerCounts[meshIndex];
+				chunk.runs.push_back(run);
+			}
+			chunk.runs.back().endFace = f + 1;
+			cornerCounts[meshIndex] += quadruple ? 6 : 3;
+		}
+	}
+
+	return cornerCounts;
+}
+
+// Marks a triangle corner without a normal in its vertex key
+#define NO_NORMAL 0xFFFFFFFFu
+
+// Identifies a triangle corner by its 0-based position and normal index
+static inline uint64_t cornerKey(unsigned int vertex, unsigned int normal) {
+	return (uint64_t(vertex) << 32) | normal;
+}
+
+// Writes the vertex keys of a chunk's validated faces into the already sized per-mesh key arrays
+static void emitChunk(const OBJChunk &chunk, std::vector<std::vector<uint64_t> > &cornerKeys) {
+	// Quads are split into (1, 3, 4) and (1, 2, 3), in that order
+	static const unsigned int quadOrder[6] = { 0, 2, 3, 0, 1, 2 };
+
+	for (const FaceRun &run : chunk.runs) {
+		std::vector<uint64_t> &keys = cornerKeys[run.mesh];
+		size_t corner = run.firstCorner;
+		for (size_t f = run.firstFace; f < run.endFace; f++) {
+			const ParsedFace &face = chunk.faces[f];
+			if (!face.emit) {
+				continue;
+			}
+			const unsigned int *order = face.cornerCount == 4 ? quadOrder : quadOrder + 3;
+			unsigned int emitted = face.cornerCount == 4 ? 6 : 3;
+			for (unsigned int i = 0; i < emitted; i++, corner++) {
+				keys[corner] = cornerKey(face.vertices[order[i]] - 1, face.hasNormals ? face.normals[order[i]] - 1 : NO_NORMAL);
+			}
+		}
+	}
+}
+
+// Vertex indices are at most 0xFFFFFFFE, so this key never occurs
+static const uint64_t emptyWeldKey = ~uint64_t(0);
+
+// Open addressing hash map from corner keys to welded vertex indices
+class VertexWeldMap {
+public:
+	explicit VertexWeldMap(size_t expectedCount) : mCount(0) {
+		size_t capacity = 16;
+		while (capacity < expectedCount * 2) {
+			capacity *= 2;
+		}
+		mKeys.assign(capacity, emptyWeldKey);
+		mValues.resize(capacity);
+	}
+
+	// Returns the index stored for key, or stores and returns newIndex if key is new
+	unsigned int findOrInsert(uint64_t key, unsigned int newIndex) {
+		size_t mask = mKeys.size() - 1;
+		for (size_t slot = hash(key) & mask;; slot = (slot + 1) & mask) {
+			if (mKeys[slot] == key) {
+				return mValues[slot];
+			}
+			if (mKeys[slot] == emptyWeldKey) {
+				mKeys[slot] = key;
+				mValues[slot] = newIndex;
+				if (++mCount * 2 > mKeys.size()) {
+					grow();
+				}
+				return newIndex;
+			}
+		}
+	}
+
+private:
+	static size_t hash(uint64_t key) {
+		return size_t((key * 0x9E3779B97F4A7C15ull) >> 17);
+	}
+
+	void grow() {
+		std::vector<uint64_t> oldKeys;
+		std::vector<unsigned int> oldValues;
+		oldKeys.swap(mKeys);
+		oldValues.swap(mValues);
+		mKeys.assign(oldKeys.size() * 2, emptyWeldKey);
+		mValues.resize(oldKeys.size() * 2);
+		size_t mask = mKeys.size() - 1;
+		for (size_t i = 0; i < oldKeys.size(); i++) {
+			if (oldKeys[i] == emptyWeldKey) {
+				continue;
+			}
+			size_t slot = hash(oldKeys[i]) & mask;
+			while (mKeys[slot] != emptyWeldKey) {
+				slot = (slot + 1) & mask;
+			}
+			mKeys[slot] = oldKeys[i];
+			mValues[slot] = oldValues[i];
+		}
+	}
+
+	std::vector<uint64_t> mKeys;
+	std::vector<unsigned int> mValues;
+	size_t mCount;
+};
+
+static inline float3 normalFor(uint64_t key, const std::vector<float3> &normals) {
+	unsigned int normal = unsigned(key & 0xFFFFFFFFu);
+	return normal == NO_NORMAL ? float3(0.0f, 0.0f, 0.0f) : normals[normal];
+}
+
+// Turns the corner keys of a mesh into vertex data. When welding, every distinct
+// position/normal pair becomes one vertex, in order of first use, and the index buffer
+// refers back to it. Otherwise every corner gets its own vertex, like loadWavefront.
+// The keys are used up in the process and released.
+static void buildMesh(VectorMesh &mesh, std::vector<uint64_t> &keys,
+					  const std::vector<float4> &vertices, const std::vector<float3> &normals, bool weld) {
+	mesh.indices.resize(keys.size());
+
+	if (!weld) {
+		mesh.vertices.resize(keys.size());
+		mesh.normals.resize(keys.size());
+		for (size_t i = 0; i < keys.size(); i++) {
+			mesh.vertices[i] = vertices[size_t(keys[i] >> 32)];
+			mesh.normals[i] = normalFor(keys[i], normals);
+			mesh.indices[i] = unsigned(i);
+		}
+		std::vector<uint64_t>().swap(keys);
+		return;
+	}
+
+	// The k-th distinct key is never found before position k, so distinct keys can be
+	// compacted to the front of the array they are read from. That way the vertex arrays
+	// are allocated once at their final size rather than grown while welding.
+	size_t uniqueCount = 0;
+	{
+		// Closed meshes share each vertex between about six triangle corners
+		VertexWeldMap weldMap(keys.size() / 4);
+		for (size_t i = 0; i < keys.size(); i++) {
+			unsigned int nextIndex = unsigned(uniqueCount);
+			unsigned int index = weldMap.findOrInsert(keys[i], nextIndex);
+			if (index == nextIndex) {
+				keys[uniqueCount++] = keys[i];
+			}
+			mesh.indices[i] = index;
+		}
+	}
+
+	mesh.vertices.resize(uniqueCount);
+	mesh.normals.resize(uniqueCount);
+	for (size_t i = 0; i < uniqueCount; i++) {
+		mesh.vertices[i] = vertices[size_t(keys[i] >> 32)];
+		mesh.normals[i] = normalFor(keys[i], normals);
+	}
+	std::vector<uint64_t>().swap(keys);
+}
+
+unsigned int resolveWorkerCount(unsigned int workerCount) {
+	if (workerCount == 0) {
+		workerCount = std::thread::hardware_concurrency();
+	}
+	return std::max(workerCount, 1u);
+}
+
+std::vector<VectorMesh> loadWavefrontMapped(std::string const srcFile, bool quiet, unsigned int workerCount, OBJLoadStats *stats, bool weld)
+{
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	MappedFile objFile;
+	try {
+		objFile.open(srcFile);
+	} catch (const std::runtime_error &) {
+		throw std::runtime_error("Reading OBJ file failed. This is usually because the operating system can't find it. Check if the relative path (to your terminal's working directory) is correct.");
+	}
+	objFile.adviseSequential();
+
+	// Small files are not worth spreading over many threads
+	workerCount = resolveWorkerCount(workerCount);
+	size_t maxChunks = std::max<size_t>(1, objFile.size() / OBJ_MIN_CHUNK_BYTES);
+	unsigned int chunkCount = static_cast<unsigned int>(std::min<size_t>(workerCount, maxChunks));
+
+	std::vector<OBJChunk> chunks = splitIntoChunks(objFile.data(), objFile.end(), chunkCount);
+	parallelFor(chunks.size(), workerCount, [&](size_t i) {
+		parseChunk(chunks[i]);
+		// The text is not needed any more, apart from the odd warning
+		objFile.releasePages(chunks[i].begin, chunks[i].end);
+	});
+
+	size_t vertexCount = 0;
+	size_t normalCount = 0;
+	for (OBJChunk &chunk : chunks) {
+		chunk.vertexOffset = vertexCount;
+		chunk.normalOffset = normalCount;
+		vertexCount += chunk.vertices.size();
+		normalCount += chunk.normals.size();
+	}
+
+	std::vector<VectorMesh> meshes;
+	std::vector<size_t> cornerCounts = assignFaces(chunks, meshes, quiet);
+	std::vector<std::vector<uint64_t> > cornerKeys(meshes.size());
+	for (size_t i = 0; i < meshes.size(); i++) {
+		cornerKeys[i].resize(cornerCounts[i]);
+	}
+
+	// Faces may refer to vertices from any earlier chunk, so gather them all first
+	std::vector<float4> vertices(vertexCount);
+	std::vector<float3> normals(normalCount);
+	parallelFor(chunks.size(), workerCount, [&](size_t i) {
+		std::copy(chunks[i].vertices.begin(), chunks[i].vertices.end(), vertices.begin() + chunks[i].vertexOffset);
+		std::copy(chunks[i].normals.begin(), chunks[i].normals.end(), normals.begin() + chunks[i].normalOffset);
+		std::vector<float4>().swap(chunks[i].vertices);
+		std::vector<float3>().swap(chunks[i].normals);
+	});
+	parallelFor(chunks.size(), workerCount, [&](size_t i) {
+		emitChunk(chunks[i], cornerKeys);
+		std::vector<ParsedFace>().swap(chunks[i].faces);
+	});
+	chunks.clear();
+	parallelFor(meshes.size(), workerCount, [&](size_t i) {
+		buildMesh(meshes[i], cornerKeys[i], vertices, normals, weld);
+	});
+
+	if (stats != nullptr) {
+		stats->bytes = objFile.size();
+		stats->seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - startTime).count();
+		stats->workerCount = chunkCount;
+		stats->cornerCount = 0;
+		stats->uniqueVertexCount = 0;
+		for (size_t i = 0; i < meshes.size(); i++) {
+			stats->cornerCount += cornerCounts[i];
+			stats->uniqueVertexCount += meshes[i].vertices.size();
+		}
+		stats->peakResidentBytes = peakResidentBytes();
+	}
+
+	return meshes;
+}
+
 void colourVertices(Mesh &VectorMesh, float4 colour) {
 	VectorMesh.colours = std::vector<float>();
 	VectorMesh.colours.resize(VectorMesh.vertexCount() * 4);
@@ -204,37 +894,117 @@ void colourVertices(VectorMesh &VectorMesh, float4 colour) {
 	}
 }
 
-Mesh loadTerrainMesh(std::string const srcFile) {
-	std::vector<VectorMesh> fileContents = loadWavefront(srcFile, true);
-	Mesh terrainMesh = Mesh(fileContents.at(0));
+void printLoadStats(std::string const &srcFile, OBJLoadStats const &stats) {
+	std::cout << "[INFO] parsed " << srcFile << " (" << double(stats.bytes) / (1024.0 * 1024.0) << " MB) in "
+			  << stats.seconds * 1000.0 << " ms on " << stats.workerCount << " thread(s), "
+			  << stats.megabytesPerSecond() << " MB/s, welded " << stats.cornerCount << " corners into "
+			  << stats.uniqueVertexCount << " vertices (" << stats.reductionRatio() << "x reduction), peak resident "
+			  << double(stats.peakResidentBytes) / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+static void printMeshMemory(std::string const &srcFile, size_t meshBytes) {
+	std::cout << "[INFO] " << srcFile << " meshes hold " << double(meshBytes) / (1024.0 * 1024.0)
+			  << " MB, peak resident " << double(peakResidentBytes()) / (1024.0 * 1024.0) << " MB" << std::endl;
+}
+
+Mesh loadTerrainMesh(std::string const srcFile, unsigned int workerCount, bool optimise) {
+	OBJLoadStats stats;
+	std::vector<VectorMesh> fileContents = loadWavefrontMapped(srcFile, true, workerCount, &stats, true);
+	printLoadStats(srcFile, stats);
+	Mesh terrainMesh = Mesh(std::move(fileContents.at(0)));
+	fileContents.clear();
+	if (optimise) {
+		optimiseMesh(terrainMesh);
+		buildLODChain(terrainMesh);
+	}
 	colourVertices(terrainMesh, float4(1, 1, 1, 1));
+	printMeshMemory(srcFile, terrainMesh.byteSize());
 
 	return terrainMesh;
 }
 
-Helicopter loadHelicopterModel(std::string const srcFile) {
-	std::vector<VectorMesh> fileContents = loadWavefront(srcFile, true);
+Helicopter loadHelicopterModel(std::string const srcFile, unsigned int workerCount, bool optimise) {
+	OBJLoadStats stats;
+	std::vector<VectorMesh> fileContents = loadWavefrontMapped(srcFile, true, workerCount, &stats, true);
+	printLoadStats(srcFile, stats);
 
 	Helicopter out;
 
-	for (VectorMesh VectorMesh : fileContents) {
-		Mesh smesh = Mesh(VectorMesh);
-		if(VectorMesh.name == "Body_body") {
+	// Each part is converted in place, so only one part ever exists in both forms
+	for (VectorMesh &vectorMesh : fileContents) {
+		Mesh smesh = Mesh(std::move(vectorMesh));
+		if (optimise) {
+			optimiseMesh(smesh);
+			buildLODChain(smesh);
+		}
+		if(smesh.name == "Body_body") {
 			colourVertices(smesh, float4(0.3, 0.3, 0.3, 1.0));
-			out.body = smesh;
-		} else if(VectorMesh.name == "Main_Rotor_main_rotor") {
+			out.body = std::move(smesh);
+		} else if(smesh.name == "Main_Rotor_main_rotor") {
 			colourVertices(smesh, float4(0.3, 0.1, 0.1, 1.0));
-			out.mainRotor = smesh;
-		} else if(VectorMesh.name == "Tail_Rotor_tail_rotor") {
+			out.mainRotor = std::move(smesh);
+		} else if(smesh.name == "Tail_Rotor_tail_rotor") {
 			colourVertices(smesh, float4(0.1, 0.3, 0.1, 1.0));
-			out.tailRotor = smesh;
-		} else if(VectorMesh.name == "Door_door") {
+			out.tailRotor = std::move(smesh);
+		} else if(smesh.name == "Door_door") {
 			colourVertices(smesh, float4(0.1, 0.1, 0.3, 1.0));
-			out.door = smesh;
+			out.door = std::move(smesh);
 		} else {
 			throw std::runtime_error("The OBJ file did not contain any parts with names the loading function recognises. Did you load the correct OBJ file?");
 		}
 	}
+	printMeshMemory(srcFile, out.body.byteSize() + out.mainRotor.byteSize() + out.tailRotor.byteSize() + out.door.byteSize());
 
 	return out;
 }
+
+// Writes meshes to the cache file of srcFile and maps it into cache.
+// Falls back to keeping the meshes in memory if the cache can not be written.
+static void storeInCache(MeshCache &cache, std::string const &srcFile, std::vector<Mesh> &&meshes) {
+	std::string cachePath = srcFile + MESH_CACHE_EXTENSION;
+	std::vector<const Mesh *> pointers;
+	for (const Mesh &mesh : meshes) {
+		pointers.push_back(&mesh);
+	}
+
+	if (!MeshCache::write(cachePath, srcFile, pointers) || !cache.open(cachePath, srcFile)) {
+		std::cout << "[WARNING] could not write mesh cache '" << cachePath << "', keeping meshes in memory" << std::endl;
+		cache.assign(std::move(meshes));
+	}
+}
+
+static void printCacheTime(std::string const &srcFile, std::chrono::steady_clock::time_point startTime) {
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "[INFO] opened mesh cache for " << srcFile << " in " << milliseconds << " ms" << std::endl;
+}
+
+HelicopterView openHelicopterCache(MeshCache &cache, std::string const srcFile, unsigned int workerCount) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+
+	// The parts are stored in a fixed order, so that missing parts keep their place
+	if (!cache.open(srcFile + MESH_CACHE_EXTENSION, srcFile)) {
+		Helicopter heli = loadHelicopterModel(srcFile, workerCount);
+		std::vector<Mesh> meshes;
+		meshes.push_back(std::move(heli.body));
+		meshes.push_back(std::move(heli.mainRotor));
+		meshes.push_back(std::move(heli.tailRotor));
+		meshes.push_back(std::move(heli.door));
+		storeInCache(cache, srcFile, std::move(meshes));
+	}
+	printCacheTime(srcFile, startTime);
+
+	return viewHelicopter(cache);
+}
+
+HelicopterView viewHelicopter(const MeshCache &cache) {
+	if (cache.meshes().size() != 4) {
+		throw std::runtime_error("The helicopter mesh cache does not contain the four expected parts.");
+	}
+
+	HelicopterView view;
+	view.body = cache.meshes()[0];
+	view.mainRotor = cache.meshes()[1];
+	view.tailRotor = cache.meshes()[2];
+	view.door = cache.meshes()[3];
+	return view;
+}
@@ -8,6 +8,7 @@
 #include <sstream>
 #include <limits>
 #include "mesh.hpp"
+#include "meshCache.hpp"
 
 struct Helicopter {
 	Mesh body = Mesh("<missing>");
@@ -16,7 +17,58 @@ struct Helicopter {
 	Mesh door = Mesh("<missing>");
 };
 
+// The helicopter parts as they are stored in a MeshCache
+struct HelicopterView {
+	MeshView body;
+	MeshView mainRotor;
+	MeshView tailRotor;
+	MeshView door;
+};
+
+// Timing of a single OBJ parse, used to track loader throughput
+struct OBJLoadStats {
+	size_t bytes = 0;
+	double seconds = 0.0;
+	unsigned int workerCount = 1;
+	// Triangle corners read from faces, and the vertices that remained after welding
+	size_t cornerCount = 0;
+	size_t uniqueVertexCount = 0;
+	// Largest resident set of the process by the end of the load
+	size_t peakResidentBytes = 0;
+
+	double megabytesPerSecond() const {
+		return seconds > 0.0 ? (double(bytes) / (1024.0 * 1024.0)) / seconds : 0.0;
+	}
+
+	double reductionRatio() const {
+		return uniqueVertexCount > 0 ? double(cornerCount) / double(uniqueVertexCount) : 1.0;
+	}
+};
+
 std::vector<VectorMesh> loadWavefront(std::string const srcFile, bool quiet = false);
 
-Helicopter loadHelicopterModel(std::string const srcFile);
-Mesh loadTerrainMesh(std::string const srcFile);
\ No newline at end of file
+// Same output as loadWavefront, but memory maps the file and tokenizes it in place
+// without allocating strings or going through the locale-aware std::stof/std::stoi.
+// Large files are split at line boundaries and parsed by up to workerCount threads
+// (0 uses every hardware thread); the result does not depend on the worker count.
+// With weld set, corners sharing the same position and normal index become a single
+// vertex and the meshes get a real index buffer instead of a triangle soup.
+std::vector<VectorMesh> loadWavefrontMapped(std::string const srcFile, bool quiet = false,
+											unsigned int workerCount = 1, OBJLoadStats *stats = nullptr,
+											bool weld = false);
+
+// Turns a requested worker count into an actual one, where 0 means one per hardware thread
+unsigned int resolveWorkerCount(unsigned int workerCount);
+
+// With optimise set, every mesh is reordered for vertex cache reuse, overdraw and
+// vertex fetch locality after loading (see meshOptimiser.hpp), and gets a chain of
+// simplified levels of detail (see meshSimplifier.hpp)
+Helicopter loadHelicopterModel(std::string const srcFile, unsigned int workerCount = 0, bool optimise = true);
+Mesh loadTerrainMesh(std::string const srcFile, unsigned int workerCount = 0, bool optimise = true);
+
+// Map the binary cache of srcFile into cache and return views of its meshes.
+// The cache is rebuilt from the OBJ file first if it is missing or older than the OBJ file.
+// The views stay valid for as long as cache is open.
+HelicopterView openHelicopterCache(MeshCache &cache, std::string const srcFile, unsigned int workerCount = 0);
+// Views of the parts in an already opened helicopter cache
+HelicopterView viewHelicopter(const MeshCache &cache);
@@ -0,0 +1,329 @@
+#include "animation.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <stdexcept>
+#include "kernelLanes.hpp"
+#include "toolbox.hpp"
+
+// Degrees a figure eight pitches down per unit per second it flies, and banks at the ends
+// of its loops
+#define FIGURE_EIGHT_PITCH_PER_SPEED -0.5f
+#define FIGURE_EIGHT_BANK 30.0f
+
+static const float TWO_PI = 6.28318530717958647692f;
+static const float PI = 3.14159265358979323846f;
+
+// Brings angles or phases back into [0, 2 pi), which also keeps them well within the range
+// sinCos() is accurate in
+static inline Lanes wrapTurn(Lanes angle) {
+	return sub(angle, mul(broadcast(TWO_PI), roundDown(mul(angle, broadcast(1.0f / TWO_PI)))));
+}
+
+// alpha of the way from angle from to angle to, the shorter way round
+static inline float mixAngle(float from, float to, float alpha) {
+	return from + std::remainder(to - from, TWO_PI) * alpha;
+}
+
+void AnimationSystem::addSpin(SceneHandle node, unsigned int axis, float speed) {
+	if (axis > 2) {
+		throw std::runtime_error("A spin can only turn rotation component 0, 1 or 2.");
+	}
+	mSpinNodes.push_back(node);
+	mSpinAxes.push_back(static_cast<unsigned char>(axis));
+	mSpinSpeeds.push_back(speed);
+	mSpinAngles.push_back(0.0f);
+	mSpinPreviousAngles.push_back(0.0f);
+}
+
+void AnimationSystem::addFigureEight(SceneHandle node, float size, float speed, float timeOffset) {
+	mPathNodes.push_back(node);
+	mPathSizes.push_back(size);
+	mPathSpeeds.push_back(speed);
+	mPathPhases.push_back(std::fmod(speed * timeOffset, TWO_PI));
+	mPathX.push_back(0.0f);
+	mPathZ.push_back(0.0f);
+	mPathYaw.push_back(0.0f);
+	mPathPitch.push_back(0.0f);
+	mPathRoll.push_back(0.0f);
+	mPathPreviousX.push_back(0.0f);
+	mPathPreviousZ.push_back(0.0f);
+	mPathPreviousYaw.push_back(0.0f);
+	mPathPreviousPitch.push_back(0.0f);
+	mPathPreviousRoll.push_back(0.0f);
+
+	// Starts out where it is, rather than blending in from the origin
+	size_t path = mPathNodes.size() - 1;
+	evaluatePaths(path, path + 1, 0.0f);
+	mPathPreviousX[path] = mPathX[path];
+	mPathPreviousZ[path] = mPathZ[path];
+	mPathPreviousYaw[path] = mPathYaw[path];
+	mPathPreviousPitch[path] = mPathPitch[path];
+	mPathPreviousRoll[path] = mPathRoll[path];
+}
+
+unsigned int AnimationSystem::addClip(const std::vector<float> &times, const std::vector<glm::vec3> &values,
+									  Interpolation interpolation) {
+	if (times.empty() || times.size() != values.size()) {
+		throw std::runtime_error("An animation clip needs one value for each of at least one key.");
+	}
+	for (size_t key = 1; key < times.size(); key++) {
+		if (!(times[key] > times[key - 1])) {
+			throw std::runtime_error("The key times of an animation clip must increase.");
+		}
+	}
+	mClips.push_back(Clip{ unsigned(mKeyTimes.size()), unsigned(times.size()), times.back() - times.front(), interpolation });
+	mKeyTimes.insert(mKeyTimes.end(), times.begin(), times.end());
+	mKeyValues.insert(mKeyValues.end(), values.begin(), values.end());
+
+	// Catmull-Rom tangents over uneven key spacing, one sided at the ends of the clip
+	size_t last = times.size() - 1;
+	for (size_t key = 0; key <= last; key++) {
+		size_t before = key == 0 ? 0 : key - 1;
+		size_t after = std::min(key + 1, last);
+		mKeyTangents.push_back(after == before ? glm::vec3(0.0f)
+							   : (values[after] - values[before]) / (times[after] - times[before]));
+	}
+	return unsigned(mClips.size() - 1);
+}
+
+void AnimationSystem::addClipChannel(SceneHandle node, unsigned int clip, AnimationTarget target, float timeOffset) {
+	if (clip >= mClips.size()) {
+		throw std::runtime_error("Animation clip does not exist.");
+	}
+	// Times are kept within the clip, so evaluateClips() only has to wrap them at the end
+	float duration = mClips[clip].duration;
+	float time = duration > 0.0f ? std::fmod(timeOffset, duration) : 0.0f;
+	mClipNodes.push_back(node);
+	mClipIndices.push_back(clip);
+	mClipTargets.push_back(static_cast<unsigned char>(target));
+	mClipTimes.push_back(time < 0.0f ? time + duration : time);
+	mClipKeys.push_back(0);
+	mClipValues.push_back(mKeyValues[mClips[clip].firstKey]);
+	mClipPreviousValues.push_back(mKeyValues[mClips[clip].firstKey]);
+
+	size_t channel = mClipNodes.size() - 1;
+	evaluateClips(channel, channel + 1, 0.0f);
+	mClipPreviousValues[channel] = mClipValues[channel];
+}
+
+void AnimationSystem::evaluate(size_t begin, size_t end, double elapsedTime) {
+	float step = static_cast<float>(elapsedTime);
+	size_t pathsFirst = mSpinNodes.size();
+	size_t clipsFirst = pathsFirst + mPathNodes.size();
+	end = std::min(end, channelCount());
+
+	// Each type gets the part of [begin, end) that falls within its own channels
+	if (begin < pathsFirst) {
+		evaluateSpins(begin, std::min(end, pathsFirst), step);
+	}
+	if (begin < clipsFirst && end > pathsFirst) {
+		evaluatePaths(std::max(begin, pathsFirst) - pathsFirst, std::min(end, clipsFirst) - pathsFirst, step);
+	}
+	if (end > clipsFirst) {
+		evaluateClips(std::max(begin, clipsFirst) - clipsFirst, end - clipsFirst, step);
+	}
+}
+
+void AnimationSystem::evaluateSpins(size_t begin, size_t end, float elapsedTime) {
+	enum { Angle, Speed, PreviousAngle, RowCount };
+	float *const rows[RowCount] = { mSpinAngles.data() + begin, mSpinSpeeds.data() + begin,
+									mSpinPreviousAngles.data() + begin };
+	Lanes step = broadcast(elapsedTime);
+	forEachBatch(rows, end - begin, [step](Lanes (&lanes)[RowCount]) {
+		lanes[PreviousAngle] = lanes[Angle];
+		lanes[Angle] = wrapTurn(add(lanes[Angle], mul(lanes[Speed], step)));
+	});
+}
+
+void AnimationSystem::evaluatePaths(size_t begin, size_t end, float elapsedTime) {
+	enum { Phase, Size, Speed, X, Z, Yaw, Pitch, Roll, PreviousX, PreviousZ, PreviousYaw, PreviousPitch, PreviousRoll,
+		   RowCount };
+	float *const rows[RowCount] = { mPathPhases.data() + begin, mPathSizes.data() + begin, mPathSpeeds.data() + begin,
+									mPathX.data() + begin, mPathZ.data() + begin, mPathYaw.data() + begin,
+									mPathPitch.data() + begin, mPathRoll.data() + begin, mPathPreviousX.data() + begin,
+									mPathPreviousZ.data() + begin, mPathPreviousYaw.data() + begin,
+									mPathPreviousPitch.data() + begin, mPathPreviousRoll.data() + begin };
+	Lanes step = broadcast(elapsedTime);
+	Lanes pitchPerSpeed = broadcast(glm::radians(FIGURE_EIGHT_PITCH_PER_SPEED));
+	Lanes bank = broadcast(glm::radians(FIGURE_EIGHT_BANK));
+
+	forEachBatch(rows, end - begin, [&](Lanes (&lanes)[RowCount]) {
+		// X to Roll, which follow each other like their previous values do
+		for (int value = 0; value < 5; value++) {
+			lanes[PreviousX + value] = lanes[X + value];
+		}
+		Lanes phase = wrapTurn(add(lanes[Phase], mul(lanes[Speed], step)));
+		Lanes s, c;
+		sinCos(phase, s, c);
+
+		// x = size sin(2 phase) and z = 3 size cos(phase), differentiated by time
+		Lanes size = lanes[Size];
+		Lanes speed = lanes[Speed];
+		Lanes dx = mul(mul(broadcast(2.0f), mul(size, speed)), sub(mul(c, c), mul(s, s)));
+		Lanes dz = mul(mul(broadcast(-3.0f), mul(size, speed)), s);
+
+		lanes[Phase] = phase;
+		lanes[X] = mul(mul(broadcast(2.0f), size), mul(s, c));
+		lanes[Z] = mul(mul(broadcast(3.0f), size), c);
+		// The heading is the angle of the velocity, whose length sets the pitch
+		lanes[Yaw] = add(broadcast(PI), atan2(dx, dz));
+		lanes[Pitch] = mul(pitchPerSpeed, squareRoot(add(mul(dx, dx), mul(dz, dz))));
+		lanes[Roll] = mul(bank, c);
+	});
+}
+
+void AnimationSystem::evaluateClips(size_t begin, size_t end, float elapsedTime) {
+	for (size_t i = begin; i < end; i++) {
+		const Clip &clip = mClips[mClipIndices[i]];
+		const float *times = mKeyTimes.data() + clip.firstKey;
+		float time = mClipTimes[i] + elapsedTime;
+		if (time >= clip.duration && clip.duration > 0.0f) {
+			// Usually less than a frame past the end, so this only divides when it is not
+			time = time < 2.0f * clip.duration ? time - clip.duration : std::fmod(time, clip.duration);
+		}
+		mClipTimes[i] = time;
+		mClipPreviousValues[i] = mClipValues[i];
+		if (clip.keyCount == 1) {
+			mClipValues[i] = mKeyValues[clip.firstKey];
+			continue;
+		}
+
+		// Time only moves forward, so the segment is found by stepping on from the last one,
+		// and starting over once the clip has looped
+		float t = times[0] + time;
+		unsigned int key = mClipKeys[i];
+		if (t < times[key]) {
+			key = 0;
+		}
+		while (key + 2 < clip.keyCount && t >= times[key + 1]) {
+			key++;
+		}
+		mClipKeys[i] = key;
+
+		unsigned int start = clip.firstKey + key;
+		float span = times[key + 1] - times[key];
+		float u = std::min((t - times[key]) / span, 1.0f);
+		if (clip.interpolation == Interpolation::Linear) {
+			mClipValues[i] = glm::mix(mKeyValues[start], mKeyValues[start + 1], u);
+			continue;
+		}
+		float u2 = u * u;
+		float u3 = u2 * u;
+		mClipValues[i] = (2.0f * u3 - 3.0f * u2 + 1.0f) * mKeyValues[start]
+					   + ((u3 - 2.0f * u2 + u) * span) * mKeyTangents[start]
+					   + (-2.0f * u3 + 3.0f * u2) * mKeyValues[start + 1]
+					   + ((u3 - u2) * span) * mKeyTangents[start + 1];
+	}
+}
+
+void AnimationSystem::apply(SceneStore &scene, float alpha) const {
+	for (size_t i = 0; i < mSpinNodes.size(); i++) {
+		if (scene.valid(mSpinNodes[i])) {
+			glm::vec3 rotation = scene.rotation(mSpinNodes[i]);
+			rotation[mSpinAxes[i]] = mixAngle(mSpinPreviousAngles[i], mSpinAngles[i], alpha);
+			scene.setRotation(mSpinNodes[i], rotation);
+		}
+	}
+	for (size_t i = 0; i < mPathNodes.size(); i++) {
+		if (scene.valid(mPathNodes[i])) {
+			float height = scene.position(mPathNodes[i]).y;
+			scene.setPosition(mPathNodes[i], glm::vec3(glm::mix(mPathPreviousX[i], mPathX[i], alpha), height,
+													   glm::mix(mPathPreviousZ[i], mPathZ[i], alpha)));
+			scene.setRotation(mPathNodes[i], glm::vec3(mixAngle(mPathPreviousYaw[i], mPathYaw[i], alpha),
+													   glm::mix(mPathPreviousPitch[i], mPathPitch[i], alpha),
+													   glm::mix(mPathPreviousRoll[i], mPathRoll[i], alpha)));
+		}
+	}
+	for (size_t i = 0; i < mClipNodes.size(); i++) {
+		if (scene.valid(mClipNodes[i])) {
+			glm::vec3 value = glm::mix(mClipPreviousValues[i], mClipValues[i], alpha);
+			if (AnimationTarget(mClipTargets[i]) == AnimationTarget::Position) {
+				scene.setPosition(mClipNodes[i], value);
+			} else {
+				scene.setRotation(mClipNodes[i], value);
+			}
+		}
+	}
+}
+
+void benchmarkAnimation(size_t channelCount, unsigned int repetitions) {
+	const float frameTime = 1.0f / 60.0f;
+	const unsigned int clipKeys = 16;
+	AnimationSystem animation;
+	SceneStore scene;
+
+	// Two clips to share between the clip channels, one of each interpolation
+	std::vector<float> times(clipKeys);
+	std::vector<glm::vec3> values(clipKeys);
+	for (unsigned int key = 0; key < clipKeys; key++) {
+		times[key] = float(key) * 0.25f + randomUniformFloat() * 0.2f;
+		values[key] = glm::vec3(randomUniformFloat(), randomUniformFloat(), randomUniformFloat()) * 10.0f;
+	}
+	unsigned int clips[2] = { animation.addClip(times, values, Interpolation::Linear),
+							  animation.addClip(times, values, Interpolation::Cubic) };
+
+	// Only the figure eights get nodes, to compare them with the reference afterwards
+	size_t pathCount = channelCount / 3;
+	size_t spinCount = channelCount / 3;
+	size_t clipCount = channelCount - pathCount - spinCount;
+	std::vector<SceneHandle> pathNodes(pathCount);
+	std::vector<float> pathSizes(pathCount);
+	std::vector<float> pathSpeeds(pathCount);
+	std::vector<float> pathOffsets(pathCount);
+	for (size_t i = 0; i < spinCount; i++) {
+		animation.addSpin(SceneHandle(), unsigned(i % 3), (randomUniformFloat() - 0.5f) * 40.0f);
+	}
+	for (size_t i = 0; i < pathCount; i++) {
+		pathNodes[i] = scene.create();
+		pathSizes[i] = 5.0f + randomUniformFloat() * 20.0f;
+		pathSpeeds[i] = (randomUniformFloat() - 0.5f) * 4.0f;
+		pathOffsets[i] = randomUniformFloat() * 10.0f;
+		animation.addFigureEight(pathNodes[i], pathSizes[i], pathSpeeds[i], pathOffsets[i]);
+	}
+	for (size_t i = 0; i < clipCount; i++) {
+		animation.addClipChannel(SceneHandle(), clips[i % 2], AnimationTarget::Position, randomUniformFloat() * 4.0f);
+	}
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+		animation.evaluate(0, animation.channelCount(), frameTime);
+	}
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	animation.apply(scene, 1.0f);
+
+	// The same paths in double precision, with the heading from the angle of the derivative.
+	// The phase is advanced the same way, so that only the evaluation is compared.
+	float largestDifference = 0.0f;
+	for (size_t i = 0; i < pathCount; i++) {
+		float step = pathSpeeds[i] * frameTime;
+		float wrapped = std::fmod(pathSpeeds[i] * pathOffsets[i], TWO_PI);
+		// Once more for the evaluation addFigureEight() starts the path out with
+		for (unsigned int repetition = 0; repetition <= repetitions; repetition++) {
+			wrapped += repetition == 0 ? 0.0f : step;
+			wrapped -= TWO_PI * std::floor(wrapped * (1.0f / TWO_PI));
+		}
+		double phase = wrapped;
+		double size = pathSizes[i];
+		double speed = pathSpeeds[i];
+		double dx = 2.0 * size * speed * std::cos(2.0 * phase);
+		double dz = -3.0 * size * speed * std::sin(phase);
+		glm::vec3 position = scene.position(pathNodes[i]);
+		glm::vec3 rotation = scene.rotation(pathNodes[i]);
+		double yawDifference = std::remainder(rotation.x - (PI + std::atan2(dx, dz)), 2.0 * PI);
+		double differences[5] = { position.x - size * std::sin(2.0 * phase), position.z - 3.0 * size * std::cos(phase),
+								  yawDifference, rotation.y - glm::radians(FIGURE_EIGHT_PITCH_PER_SPEED) * std::sqrt(dx * dx + dz * dz),
+								  rotation.z - glm::radians(FIGURE_EIGHT_BANK) * std::cos(phase) };
+		for (double difference : differences) {
+			largestDifference = std::max(largestDifference, float(std::fabs(difference)));
+		}
+	}
+
+	double channels = double(animation.channelCount()) * repetitions;
+	printf("[INFO] evaluating %zu spins, %zu figure eights and %zu clip channels %u times\n", spinCount, pathCount,
+		   clipCount, repetitions);
+	printf("[INFO] %.1f million channels/s, %.3f ms per frame\n", channels / seconds / 1e6,
+		   seconds / repetitions * 1e3);
+	printf("[INFO] largest difference from the reference figure eights: %g\n", largestDifference);
+}
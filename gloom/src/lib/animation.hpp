@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/glm.hpp>
+#include "sceneStore.hpp"
+
+// Which transform of its node a clip channel drives
+enum class AnimationTarget {
+	Position,
+	Rotation
+};
+
+// How a clip gets from one key to the next. Cubic runs a Catmull-Rom spline through the
+// keys, with tangents scaled to the uneven spacing of the key times.
+enum class Interpolation {
+	Linear,
+	Cubic
+};
+
+// Channels of every animation in a scene, evaluated together in batches.
+//
+// A channel drives a single node, and each type of channel keeps its own structure of
+// arrays, so that evaluating a batch is a tight loop over contiguous floats:
+//  - spins turn one rotation angle of their node at a fixed speed,
+//  - figure eights fly their node along a figure eight, heading along the path,
+//  - clip channels play a looping keyframe clip into the position or rotation of their node.
+//
+// Spins and figure eights are evaluated TRANSFORM_KERNEL_WIDTH channels at a time, with the
+// lane operations and sine, cosine and arc tangent approximations of the transform kernel.
+// Paths are evaluated in closed form, their heading comes from the analytic derivative of
+// the path instead of a finite difference. Clip channels step on from the key they were at
+// last, so finding the key is constant time while a clip plays.
+//
+// Every channel has an index in [0, channelCount()): spins first, then figure eights, then
+// clip channels. evaluate() advances and evaluates a range of them, and may run for
+// disjoint ranges at the same time. Each channel keeps what it evaluated to the time before
+// as well, and apply() writes a blend of the two to the scene, so that a fixed step
+// simulation can be drawn between its steps. Channels must not be added while either runs.
+class AnimationSystem {
+public:
+	// Spins rotation component axis of node, 0 to 2, at speed radians per second. The
+	// other components keep whatever the node has.
+	void addSpin(SceneHandle node, unsigned int axis, float speed);
+
+	// Flies node along a figure eight around the origin of its parent, size wide and three
+	// times size long, which it goes around at speed radians per second, starting
+	// timeOffset seconds in. Its height is left alone. The node faces along the path,
+	// pitches down with speed and banks into the turns.
+	void addFigureEight(SceneHandle node, float size, float speed, float timeOffset);
+
+	// Adds a clip and returns its index for addClipChannel(). times must be increasing,
+	// and the clip loops from the first key to the last. Throws std::runtime_error for
+	// clips without keys, or whose times and values do not match up.
+	unsigned int addClip(const std::vector<float> &times, const std::vector<glm::vec3> &values,
+						 Interpolation interpolation);
+	// Plays clip into target of node, starting timeOffset seconds in
+	void addClipChannel(SceneHandle node, unsigned int clip, AnimationTarget target, float timeOffset);
+
+	size_t channelCount() const { return mSpinNodes.size() + mPathNodes.size() + mClipNodes.size(); }
+
+	// Advances channels [begin, end) by elapsedTime seconds and evaluates them
+	void evaluate(size_t begin, size_t end, double elapsedTime);
+	// Writes the state of each channel alpha of the way from what the second to last
+	// evaluate() gave to what the last one gave to the scene. Angles take the shorter way
+	// round. Channels whose node has been destroyed are skipped.
+	void apply(SceneStore &scene, float alpha) const;
+
+private:
+	struct Clip {
+		unsigned int firstKey;
+		unsigned int keyCount;
+		float duration;
+		Interpolation interpolation;
+	};
+
+	void evaluateSpins(size_t begin, size_t end, float elapsedTime);
+	void evaluatePaths(size_t begin, size_t end, float elapsedTime);
+	void evaluateClips(size_t begin, size_t end, float elapsedTime);
+
+	// Spins: the angle doubles as the result
+	std::vector<SceneHandle> mSpinNodes;
+	std::vector<unsigned char> mSpinAxes;
+	std::vector<float> mSpinSpeeds;
+	std::vector<float> mSpinAngles;
+	std::vector<float> mSpinPreviousAngles;
+
+	// Figure eights, and what they evaluated to
+	std::vector<SceneHandle> mPathNodes;
+	std::vector<float> mPathSizes;
+	std::vector<float> mPathSpeeds;
+	std::vector<float> mPathPhases;
+	std::vector<float> mPathX;
+	std::vector<float> mPathZ;
+	std::vector<float> mPathYaw;
+	std::vector<float> mPathPitch;
+	std::vector<float> mPathRoll;
+	std::vector<float> mPathPreviousX;
+	std::vector<float> mPathPreviousZ;
+	std::vector<float> mPathPreviousYaw;
+	std::vector<float> mPathPreviousPitch;
+	std::vector<float> mPathPreviousRoll;
+
+	// Keys of every clip, one after another, with their Catmull-Rom tangents
+	std::vector<Clip> mClips;
+	std::vector<float> mKeyTimes;
+	std::vector<glm::vec3> mKeyValues;
+	std::vector<glm::vec3> mKeyTangents;
+
+	// Clip channels, and what they evaluated to
+	std::vector<SceneHandle> mClipNodes;
+	std::vector<unsigned int> mClipIndices;
+	std::vector<unsigned char> mClipTargets;
+	std::vector<float> mClipTimes;
+	// Key starting the segment each channel was in last
+	std::vector<unsigned int> mClipKeys;
+	std::vector<glm::vec3> mClipValues;
+	std::vector<glm::vec3> mClipPreviousValues;
+};
+
+// Times evaluating channelCount channels, a third of each type, and prints channels per
+// second and the time a frame of them takes, together with the largest difference between
+// the figure eights and the same paths evaluated with std::sin, std::cos and std::atan2
+void benchmarkAnimation(size_t channelCount, unsigned int repetitions);
@@ -0,0 +1,33 @@
+#include "fixedStepClock.hpp"
+#include <cmath>
+#include <stdexcept>
+
+FixedStepClock::FixedStepClock(double stepSeconds, unsigned int maxStepsPerFrame)
+	: mStepSeconds(stepSeconds),
+	  mMaxStepsPerFrame(maxStepsPerFrame),
+	  mAccumulator(0.0),
+	  mStepCount(0),
+	  mDroppedSeconds(0.0) {
+	if (!(stepSeconds > 0.0) || maxStepsPerFrame == 0) {
+		throw std::runtime_error("A fixed step clock needs a positive step length and at least one step per frame.");
+	}
+}
+
+unsigned int FixedStepClock::advance(double frameSeconds) {
+	if (frameSeconds > 0.0) {
+		mAccumulator += frameSeconds;
+	}
+	unsigned int steps = 0;
+	while (mAccumulator >= mStepSeconds && steps < mMaxStepsPerFrame) {
+		mAccumulator -= mStepSeconds;
+		steps++;
+	}
+	// Keeps less than a step, so rendering stays between the last two states
+	if (mAccumulator >= mStepSeconds) {
+		double kept = std::fmod(mAccumulator, mStepSeconds);
+		mDroppedSeconds += mAccumulator - kept;
+		mAccumulator = kept;
+	}
+	mStepCount += steps;
+	return steps;
+}
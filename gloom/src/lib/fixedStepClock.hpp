@@ -0,0 +1,34 @@
+#pragma once
+
+// Turns the irregular time between rendered frames into simulation steps of a fixed length.
+//
+// Frame time is added to an accumulator, and every whole step in it is taken out again and
+// reported to be simulated. What is left over, as a fraction of a step, is how far rendering
+// is past the last simulated state, so the renderer can interpolate between the last two
+// states instead of showing time jump by whole steps. Simulation results then only depend
+// on the step length, however fast or slow frames are rendered.
+//
+// A frame never asks for more than maxStepsPerFrame steps. Time beyond that is dropped, so
+// that a slow frame does not make the next one slower still by asking for even more steps.
+class FixedStepClock {
+public:
+	FixedStepClock(double stepSeconds, unsigned int maxStepsPerFrame);
+
+	// Adds frameSeconds of real time and returns the number of steps to simulate for it
+	unsigned int advance(double frameSeconds);
+
+	double stepSeconds() const { return mStepSeconds; }
+	// How far the time rendered is from the second to last towards the last simulated state,
+	// in [0, 1)
+	float alpha() const { return float(mAccumulator / mStepSeconds); }
+	// Steps taken so far, and the real time dropped because frames asked for too many
+	unsigned long long stepCount() const { return mStepCount; }
+	double droppedSeconds() const { return mDroppedSeconds; }
+
+private:
+	double mStepSeconds;
+	unsigned int mMaxStepsPerFrame;
+	double mAccumulator;
+	unsigned long long mStepCount;
+	double mDroppedSeconds;
+};
@@ -0,0 +1,115 @@
+#include "frustum.hpp"
+#include <cmath>
+#if FRUSTUM_SSE
+#include <xmmintrin.h>
+#endif
+
+Frustum extractFrustum(const glm::mat4 &matrix) {
+	// glm matrices are column major, so row i is made up of element i of every column
+	glm::vec4 rows[4];
+	for (int i = 0; i < 4; i++) {
+		rows[i] = glm::vec4(matrix[0][i], matrix[1][i], matrix[2][i], matrix[3][i]);
+	}
+
+	Frustum frustum;
+	frustum.planes[0] = rows[3] + rows[0]; // Left
+	frustum.planes[1] = rows[3] - rows[0]; // Right
+	frustum.planes[2] = rows[3] + rows[1]; // Bottom
+	frustum.planes[3] = rows[3] - rows[1]; // Top
+	frustum.planes[4] = rows[3] + rows[2]; // Near
+	frustum.planes[5] = rows[3] - rows[2]; // Far
+	for (glm::vec4 &plane : frustum.planes) {
+		float length = glm::length(glm::vec3(plane));
+		if (length > 0.0f) {
+			plane = plane * (1.0f / length);
+		}
+	}
+
+	for (int i = 0; i < 8; i++) {
+		const glm::vec4 &plane = frustum.planes[i < 6 ? i : 5];
+		frustum.planeX[i] = plane.x;
+		frustum.planeY[i] = plane.y;
+		frustum.planeZ[i] = plane.z;
+		frustum.planeW[i] = plane.w;
+	}
+	return frustum;
+}
+
+static bool isEmpty(const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+	return boxMin.x > boxMax.x || boxMin.y > boxMax.y || boxMin.z > boxMax.z;
+}
+
+bool boxInFrustumScalar(const Frustum &frustum, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+	if (isEmpty(boxMin, boxMax)) {
+		return false;
+	}
+	for (const glm::vec4 &plane : frustum.planes) {
+		// The corner furthest along the plane normal is the last one to leave the frustum
+		glm::vec3 corner(plane.x >= 0.0f ? boxMax.x : boxMin.x,
+						 plane.y >= 0.0f ? boxMax.y : boxMin.y,
+						 plane.z >= 0.0f ? boxMax.z : boxMin.z);
+		if (glm::dot(glm::vec3(plane), corner) + plane.w < 0.0f) {
+			return false;
+		}
+	}
+	return true;
+}
+
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &boxMin, const glm::vec3 &boxMax) {
+#if FRUSTUM_SSE
+	if (isEmpty(boxMin, boxMax)) {
+		return false;
+	}
+	// Same test as the scalar version, written with the box centre and half extent: the
+	// furthest corner along a normal n is at distance dot(n, centre) + dot(abs(n), extent)
+	__m128 centreX = _mm_set1_ps((boxMin.x + boxMax.x) * 0.5f);
+	__m128 centreY = _mm_set1_ps((boxMin.y + boxMax.y) * 0.5f);
+	__m128 centreZ = _mm_set1_ps((boxMin.z + boxMax.z) * 0.5f);
+	__m128 extentX = _mm_set1_ps((boxMax.x - boxMin.x) * 0.5f);
+	__m128 extentY = _mm_set1_ps((boxMax.y - boxMin.y) * 0.5f);
+	__m128 extentZ = _mm_set1_ps((boxMax.z - boxMin.z) * 0.5f);
+	// Clearing the sign bit gives the absolute value
+	__m128 signMask = _mm_set1_ps(-0.0f);
+	__m128 zero = _mm_setzero_ps();
+
+	for (int batch = 0; batch < 8; batch += 4) {
+		__m128 x = _mm_load_ps(frustum.planeX + batch);
+		__m128 y = _mm_load_ps(frustum.planeY + batch);
+		__m128 z = _mm_load_ps(frustum.planeZ + batch);
+		__m128 w = _mm_load_ps(frustum.planeW + batch);
+
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(x, centreX), _mm_mul_ps(y, centreY)),
+									 _mm_add_ps(_mm_mul_ps(z, centreZ), w));
+		__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(_mm_andnot_ps(signMask, x), extentX),
+											  _mm_mul_ps(_mm_andnot_ps(signMask, y), extentY)),
+								   _mm_mul_ps(_mm_andnot_ps(signMask, z), extentZ));
+		if (_mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, radius), zero)) != 0) {
+			return false;
+		}
+	}
+	return true;
+#else
+	return boxInFrustumScalar(frustum, boxMin, boxMax);
+#endif
+}
+
+void transformBox(const glm::mat4 &matrix, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+				  glm::vec3 &outMin, glm::vec3 &outMax) {
+	if (isEmpty(boxMin, boxMax)) {
+		outMin = glm::vec3(EMPTY_BOUNDS);
+		outMax = glm::vec3(-EMPTY_BOUNDS);
+		return;
+	}
+
+	glm::vec3 centre = 0.5f * (boxMin + boxMax);
+	glm::vec3 extent = 0.5f * (boxMax - boxMin);
+	glm::vec3 transformedCentre = glm::vec3(matrix * glm::vec4(centre, 1.0f));
+	glm::vec3 transformedExtent;
+	for (int row = 0; row < 3; row++) {
+		transformedExtent[row] = std::fabs(matrix[0][row]) * extent.x
+							   + std::fabs(matrix[1][row]) * extent.y
+							   + std::fabs(matrix[2][row]) * extent.z;
+	}
+	outMin = transformedCentre - transformedExtent;
+	outMax = transformedCentre + transformedExtent;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+// Every coordinate of the minimum of an empty box, whose maximum is -EMPTY_BOUNDS. Growing
+// an empty box by another box gives that box, and an empty box is outside every frustum.
+#define EMPTY_BOUNDS 1e30f
+
+// Test the frustum planes four at a time with SSE where the compiler targets it
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FRUSTUM_SSE 1
+#else
+#define FRUSTUM_SSE 0
+#endif
+
+// The six planes bounding what a camera can see. Each plane is stored as (normal, distance)
+// with the normal pointing inwards, so points inside the frustum have a positive distance
+// to every plane.
+struct Frustum {
+	glm::vec4 planes[6];
+	// The planes again as structure of arrays, padded to eight with copies of the last
+	// plane, so that boxInFrustum can test them in two batches of four
+	alignas(16) float planeX[8];
+	alignas(16) float planeY[8];
+	alignas(16) float planeZ[8];
+	alignas(16) float planeW[8];
+};
+
+// Extracts the planes of the clip volume of matrix, following Gribb and Hartmann, "Fast
+// Extraction of Viewing Frustum Planes from the World-View-Projection Matrix". The planes
+// are in the space matrix transforms from, so passing projection * view * model gives
+// planes that can be tested directly against model space bounds.
+Frustum extractFrustum(const glm::mat4 &matrix);
+
+// Conservative test of an axis aligned box against the frustum. May report boxes near the
+// corners of the frustum as visible, but never reports a visible box as hidden. Empty
+// boxes are never visible.
+bool boxInFrustum(const Frustum &frustum, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+// Plain C++ version of boxInFrustum, used where SSE is not available
+bool boxInFrustumScalar(const Frustum &frustum, const glm::vec3 &boxMin, const glm::vec3 &boxMax);
+
+// Axis aligned box around boxMin-boxMax after it has been transformed by matrix, following
+// Arvo, "Transforming Axis-Aligned Bounding Boxes". Empty boxes stay empty.
+void transformBox(const glm::mat4 &matrix, const glm::vec3 &boxMin, const glm::vec3 &boxMax,
+				  glm::vec3 &outMin, glm::vec3 &outMax);
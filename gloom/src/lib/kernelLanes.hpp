@@ -0,0 +1,188 @@
+#pragma once
+
+// Lane operations the vectorised kernels are written in, with the sine, cosine and arc
+// tangent approximations they share. Only for the translation units of those kernels.
+
+#include <algorithm>
+#include <cmath>
+#include "transformKernel.hpp"
+#if TRANSFORM_KERNEL_WIDTH == 8
+#include <immintrin.h>
+#elif TRANSFORM_KERNEL_WIDTH == 4
+#include <emmintrin.h>
+#endif
+
+// Kernels are written once against these lane operations, so that every width runs the
+// exact same arithmetic. Masks hold the result of a comparison in every lane.
+#if TRANSFORM_KERNEL_WIDTH == 8
+typedef __m256 Lanes;
+typedef __m256 Mask;
+static inline Lanes load(const float *values) { return _mm256_load_ps(values); }
+static inline void store(float *values, Lanes lanes) { _mm256_store_ps(values, lanes); }
+static inline Lanes broadcast(float value) { return _mm256_set1_ps(value); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm256_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm256_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm256_mul_ps(a, b); }
+static inline Lanes roundToInteger(Lanes a) { return _mm256_round_ps(a, _MM_FROUND_TO_NEAREST_INT | _MM_FROUND_NO_EXC); }
+static inline Mask equal(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+static inline Mask greaterEqual(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+static inline Mask either(Mask a, Mask b) { return _mm256_or_ps(a, b); }
+static inline Lanes select(Mask mask, Lanes a, Lanes b) { return _mm256_or_ps(_mm256_and_ps(mask, a), _mm256_andnot_ps(mask, b)); }
+static inline Lanes divide(Lanes a, Lanes b) { return _mm256_div_ps(a, b); }
+static inline Lanes squareRoot(Lanes a) { return _mm256_sqrt_ps(a); }
+static inline Lanes roundDown(Lanes a) { return _mm256_floor_ps(a); }
+static inline Lanes absolute(Lanes a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+static inline Lanes minimum(Lanes a, Lanes b) { return _mm256_min_ps(a, b); }
+static inline Lanes maximum(Lanes a, Lanes b) { return _mm256_max_ps(a, b); }
+static inline Mask less(Lanes a, Lanes b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+static inline Lanes loadUnaligned(const float *values) { return _mm256_loadu_ps(values); }
+static inline void storeUnaligned(float *values, Lanes lanes) { _mm256_storeu_ps(values, lanes); }
+#elif TRANSFORM_KERNEL_WIDTH == 4
+typedef __m128 Lanes;
+typedef __m128 Mask;
+static inline Lanes load(const float *values) { return _mm_load_ps(values); }
+static inline void store(float *values, Lanes lanes) { _mm_store_ps(values, lanes); }
+static inline Lanes broadcast(float value) { return _mm_set1_ps(value); }
+static inline Lanes add(Lanes a, Lanes b) { return _mm_add_ps(a, b); }
+static inline Lanes sub(Lanes a, Lanes b) { return _mm_sub_ps(a, b); }
+static inline Lanes mul(Lanes a, Lanes b) { return _mm_mul_ps(a, b); }
+static inline Lanes roundToInteger(Lanes a) { return _mm_cvtepi32_ps(_mm_cvtps_epi32(a)); }
+static inline Mask equal(Lanes a, Lanes b) { return _mm_cmpeq_ps(a, b); }
+static inline Mask greaterEqual(Lanes a, Lanes b) { return _mm_cmpge_ps(a, b); }
+static inline Mask either(Mask a, Mask b) { return _mm_or_ps(a, b); }
+static inline Lanes select(Mask mask, Lanes a, Lanes b) { return _mm_or_ps(_mm_and_ps(mask, a), _mm_andnot_ps(mask, b)); }
+static inline Lanes divide(Lanes a, Lanes b) { return _mm_div_ps(a, b); }
+static inline Lanes squareRoot(Lanes a) { return _mm_sqrt_ps(a); }
+// SSE2 has no floor, so rounding to nearest is corrected where it went up
+static inline Lanes roundDown(Lanes a) {
+	Lanes rounded = _mm_cvtepi32_ps(_mm_cvtps_epi32(a));
+	return _mm_sub_ps(rounded, _mm_and_ps(_mm_cmpgt_ps(rounded, a), _mm_set1_ps(1.0f)));
+}
+static inline Lanes absolute(Lanes a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+static inline Lanes minimum(Lanes a, Lanes b) { return _mm_min_ps(a, b); }
+static inline Lanes maximum(Lanes a, Lanes b) { return _mm_max_ps(a, b); }
+static inline Mask less(Lanes a, Lanes b) { return _mm_cmplt_ps(a, b); }
+static inline Lanes loadUnaligned(const float *values) { return _mm_loadu_ps(values); }
+static inline void storeUnaligned(float *values, Lanes lanes) { _mm_storeu_ps(values, lanes); }
+#else
+typedef float Lanes;
+typedef bool Mask;
+static inline Lanes load(const float *values) { return *values; }
+static inline void store(float *values, Lanes lanes) { *values = lanes; }
+static inline Lanes broadcast(float value) { return value; }
+static inline Lanes add(Lanes a, Lanes b) { return a + b; }
+static inline Lanes sub(Lanes a, Lanes b) { return a - b; }
+static inline Lanes mul(Lanes a, Lanes b) { return a * b; }
+static inline Lanes roundToInteger(Lanes a) { return std::nearbyint(a); }
+static inline Mask equal(Lanes a, Lanes b) { return a == b; }
+static inline Mask greaterEqual(Lanes a, Lanes b) { return a >= b; }
+static inline Mask either(Mask a, Mask b) { return a || b; }
+static inline Lanes select(Mask mask, Lanes a, Lanes b) { return mask ? a : b; }
+static inline Lanes divide(Lanes a, Lanes b) { return a / b; }
+static inline Lanes squareRoot(Lanes a) { return std::sqrt(a); }
+static inline Lanes roundDown(Lanes a) { return std::floor(a); }
+static inline Lanes absolute(Lanes a) { return std::fabs(a); }
+static inline Lanes minimum(Lanes a, Lanes b) { return std::min(a, b); }
+static inline Lanes maximum(Lanes a, Lanes b) { return std::max(a, b); }
+static inline Mask less(Lanes a, Lanes b) { return a < b; }
+static inline Lanes loadUnaligned(const float *values) { return *values; }
+static inline void storeUnaligned(float *values, Lanes lanes) { *values = lanes; }
+#endif
+
+// Sine and cosine following Cephes' sinf and cosf: x is reduced to r in [-pi/4, pi/4] by
+// subtracting the nearest multiple j of pi/2 in three parts, both are approximated by
+// polynomials in r, and the quarter turn j mod 4 picks which one is which and their signs
+static inline void sinCos(Lanes x, Lanes &sine, Lanes &cosine) {
+	Lanes j = roundToInteger(mul(x, broadcast(0.636619772367581343f)));
+	Lanes r = sub(x, mul(j, broadcast(1.5703125f)));
+	r = sub(r, mul(j, broadcast(4.837512969970703125e-4f)));
+	r = sub(r, mul(j, broadcast(7.54978995489188216e-8f)));
+	Lanes r2 = mul(r, r);
+
+	Lanes sinR = mul(r2, broadcast(-1.9515295891e-4f));
+	sinR = mul(r2, add(sinR, broadcast(8.3321608736e-3f)));
+	sinR = mul(mul(r2, r), add(sinR, broadcast(-1.6666654611e-1f)));
+	sinR = add(r, sinR);
+	Lanes cosR = mul(r2, broadcast(2.443315711809948e-5f));
+	cosR = mul(r2, add(cosR, broadcast(-1.388731625493765e-3f)));
+	cosR = mul(mul(r2, r2), add(cosR, broadcast(4.166664568298827e-2f)));
+	cosR = add(sub(broadcast(1.0f), mul(r2, broadcast(0.5f))), cosR);
+
+	// j mod 4, with the floor of j / 4 found by rounding, since j / 4 is a multiple of 0.25
+	Lanes quarter = sub(j, mul(broadcast(4.0f), roundToInteger(sub(mul(j, broadcast(0.25f)), broadcast(0.375f)))));
+	Mask odd = either(equal(quarter, broadcast(1.0f)), equal(quarter, broadcast(3.0f)));
+	Mask negateSine = greaterEqual(quarter, broadcast(2.0f));
+	Mask negateCosine = either(equal(quarter, broadcast(1.0f)), equal(quarter, broadcast(2.0f)));
+	Lanes s = select(odd, cosR, sinR);
+	Lanes c = select(odd, sinR, cosR);
+	Lanes zero = broadcast(0.0f);
+	sine = select(negateSine, sub(zero, s), s);
+	cosine = select(negateCosine, sub(zero, c), c);
+}
+
+// Arc tangent of y / x in the quadrant of (x, y), following Cephes' atanf: the ratio of the
+// smaller to the larger of |x| and |y| is brought below tan(pi / 8), approximated by a
+// polynomial, and the result is mirrored into the right octant
+static inline Lanes atan2(Lanes y, Lanes x) {
+	Lanes zero = broadcast(0.0f);
+	Lanes absX = absolute(x);
+	Lanes absY = absolute(y);
+	// Both zero gives 0 rather than 0 / 0
+	Lanes t = divide(minimum(absX, absY), maximum(maximum(absX, absY), broadcast(1e-30f)));
+
+	Mask large = less(broadcast(0.414213562373095f), t);
+	Lanes a = select(large, divide(sub(t, broadcast(1.0f)), add(t, broadcast(1.0f))), t);
+	Lanes p = mul(a, a);
+	Lanes poly = mul(p, broadcast(8.05374449538e-2f));
+	poly = mul(p, add(poly, broadcast(-1.38776856032e-1f)));
+	poly = mul(p, add(poly, broadcast(1.99777106478e-1f)));
+	poly = mul(p, add(poly, broadcast(-3.33329491539e-1f)));
+	Lanes angle = add(select(large, broadcast(0.785398163397448f), zero), add(a, mul(poly, a)));
+
+	angle = select(less(absX, absY), sub(broadcast(1.57079632679490f), angle), angle);
+	angle = select(less(x, zero), sub(broadcast(3.14159265358979f), angle), angle);
+	return select(less(y, zero), sub(zero, angle), angle);
+}
+
+static inline float reduceAngle(float angle) {
+	if (std::fabs(angle) <= TRANSFORM_KERNEL_MAX_ANGLE) {
+		return angle;
+	}
+	return static_cast<float>(std::remainder(double(angle), 6.283185307179586476925));
+}
+
+// Runs kernel on rows[0..Rows)[0..count), TRANSFORM_KERNEL_WIDTH columns at a time. kernel
+// gets the lanes of every row and may change them, and what it leaves is written back.
+// Whole batches are loaded straight from the rows, the last one goes through a copy padded
+// with its final column, so the kernel never sees uninitialised lanes.
+template <size_t Rows, typename Kernel>
+static inline void forEachBatch(float *const (&rows)[Rows], size_t count, Kernel kernel) {
+	Lanes lanes[Rows];
+	size_t first = 0;
+	for (; first + TRANSFORM_KERNEL_WIDTH <= count; first += TRANSFORM_KERNEL_WIDTH) {
+		for (size_t row = 0; row < Rows; row++) {
+			lanes[row] = loadUnaligned(rows[row] + first);
+		}
+		kernel(lanes);
+		for (size_t row = 0; row < Rows; row++) {
+			storeUnaligned(rows[row] + first, lanes[row]);
+		}
+	}
+	if (first == count) {
+		return;
+	}
+
+	alignas(32) float padded[Rows][TRANSFORM_KERNEL_WIDTH];
+	size_t used = count - first;
+	for (size_t row = 0; row < Rows; row++) {
+		for (size_t lane = 0; lane < TRANSFORM_KERNEL_WIDTH; lane++) {
+			padded[row][lane] = rows[row][first + std::min(lane, used - 1)];
+		}
+		lanes[row] = load(padded[row]);
+	}
+	kernel(lanes);
+	for (size_t row = 0; row < Rows; row++) {
+		store(padded[row], lanes[row]);
+		std::copy(padded[row], padded[row] + used, rows[row] + first);
+	}
+}
@@ -0,0 +1,162 @@
+#include "mappedFile.hpp"
+#include <stdexcept>
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <sys/stat.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool getFileInfo(std::string const &path, FileInfo &info) {
+#ifdef _WIN32
+	struct _stat64 fileStat;
+	if (_stat64(path.c_str(), &fileStat) != 0) {
+		return false;
+	}
+#else
+	struct stat fileStat;
+	if (stat(path.c_str(), &fileStat) != 0) {
+		return false;
+	}
+#endif
+	info.size = static_cast<unsigned long long>(fileStat.st_size);
+	info.modified = static_cast<long long>(fileStat.st_mtime);
+	return true;
+}
+
+#ifdef _WIN32
+
+void MappedFile::open(std::string const &path) {
+	close();
+
+	HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+							  OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+	if (file == INVALID_HANDLE_VALUE) {
+		throw std::runtime_error("Could not open file '" + path + "' for mapping.");
+	}
+
+	LARGE_INTEGER fileSize;
+	GetFileSizeEx(file, &fileSize);
+	mHandle = file;
+	mSize = static_cast<size_t>(fileSize.QuadPart);
+
+	// Empty files can not be mapped, but are still valid input
+	if (mSize == 0) {
+		mData = "";
+		return;
+	}
+
+	HANDLE mapping = CreateFileMappingA(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	if (mapping == nullptr) {
+		close();
+		throw std::runtime_error("Could not map file '" + path + "'.");
+	}
+	mMapping = mapping;
+	mData = static_cast<const char *>(MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0));
+	if (mData == nullptr) {
+		close();
+		throw std::runtime_error("Could not map file '" + path + "'.");
+	}
+}
+
+void MappedFile::close() {
+	if (mMapping != nullptr) {
+		if (mData != nullptr) {
+			UnmapViewOfFile(mData);
+		}
+		CloseHandle(static_cast<HANDLE>(mMapping));
+	}
+	if (mHandle != nullptr) {
+		CloseHandle(static_cast<HANDLE>(mHandle));
+	}
+	mData = nullptr;
+	mSize = 0;
+	mHandle = nullptr;
+	mMapping = nullptr;
+}
+
+void MappedFile::adviseSequential() {
+	// FILE_FLAG_SEQUENTIAL_SCAN is already passed when the file is opened
+}
+
+void MappedFile::releasePages(const char *begin, const char *end) {
+	// Windows trims clean file-backed pages from the working set on its own
+	(void) begin;
+	(void) end;
+}
+
+#else
+
+// On POSIX systems mHandle holds the file descriptor + 1, so that descriptor 0 is not confused with "closed"
+void MappedFile::open(std::string const &path) {
+	close();
+
+	int fd = ::open(path.c_str(), O_RDONLY);
+	if (fd == -1) {
+		throw std::runtime_error("Could not open file '" + path + "' for mapping.");
+	}
+
+	struct stat fileStat;
+	if (fstat(fd, &fileStat) == -1) {
+		::close(fd);
+		throw std::runtime_error("Could not determine the size of '" + path + "'.");
+	}
+	mHandle = reinterpret_cast<void *>(static_cast<intptr_t>(fd) + 1);
+	mSize = static_cast<size_t>(fileStat.st_size);
+
+	// Empty files can not be mapped, but are still valid input
+	if (mSize == 0) {
+		mData = "";
+		return;
+	}
+
+	void *address = mmap(nullptr, mSize, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (address == MAP_FAILED) {
+		close();
+		throw std::runtime_error("Could not map file '" + path + "'.");
+	}
+	mMapping = address;
+	mData = static_cast<const char *>(address);
+}
+
+void MappedFile::close() {
+	if (mMapping != nullptr) {
+		munmap(mMapping, mSize);
+	}
+	if (mHandle != nullptr) {
+		::close(static_cast<int>(reinterpret_cast<intptr_t>(mHandle) - 1));
+	}
+	mData = nullptr;
+	mSize = 0;
+	mHandle = nullptr;
+	mMapping = nullptr;
+}
+
+void MappedFile::adviseSequential() {
+	if (mMapping != nullptr) {
+		madvise(mMapping, mSize, MADV_SEQUENTIAL);
+	}
+}
+
+void MappedFile::releasePages(const char *begin, const char *end) {
+	if (mMapping == nullptr || begin >= end) {
+		return;
+	}
+	// Only whole pages inside the range may be released, the ones at either end may
+	// still be shared with neighbouring ranges
+	uintptr_t pageSize = static_cast<uintptr_t>(sysconf(_SC_PAGESIZE));
+	uintptr_t first = (reinterpret_cast<uintptr_t>(begin) + pageSize - 1) & ~(pageSize - 1);
+	uintptr_t last = reinterpret_cast<uintptr_t>(end) & ~(pageSize - 1);
+	if (first < last) {
+		madvise(reinterpret_cast<void *>(first), last - first, MADV_DONTNEED);
+	}
+}
+
+#endif
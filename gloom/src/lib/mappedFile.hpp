@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// Size and last modification time of a file, used to detect stale caches
+struct FileInfo {
+	unsigned long long size;
+	long long modified;
+};
+
+// Returns false if the file does not exist
+bool getFileInfo(std::string const &path, FileInfo &info);
+
+// Read-only memory mapping of a whole file.
+// The mapping is released when the object goes out of scope.
+class MappedFile {
+public:
+	MappedFile() : mData(nullptr), mSize(0), mHandle(nullptr), mMapping(nullptr) { }
+	~MappedFile() { close(); }
+
+	MappedFile(const MappedFile &) = delete;
+	MappedFile &operator=(const MappedFile &) = delete;
+
+	// Maps the file at path into memory. Throws std::runtime_error if the file can not be opened.
+	void open(std::string const &path);
+	void close();
+
+	// Hint to the operating system that the mapping will be read front to back
+	void adviseSequential();
+
+	// Tells the operating system that [begin, end) will not be read again for a while, so
+	// its pages can be dropped from the resident set. Reading the range later is still
+	// valid, it is just paged back in from the file.
+	void releasePages(const char *begin, const char *end);
+
+	bool isOpen() const { return mHandle != nullptr; }
+	const char *data() const { return mData; }
+	const char *end() const { return mData + mSize; }
+	size_t size() const { return mSize; }
+
+private:
+	const char *mData;
+	size_t mSize;
+	// Platform handles, kept opaque so that the header does not pull in system headers
+	void *mHandle;
+	void *mMapping;
+};
@@ -3,6 +3,7 @@
 #include <string>
 #include <vector>
 #include <cstring>
+#include <utility>
 
 struct float4 {
 public:
@@ -43,6 +44,14 @@ public:
 	int2(int x, int y) : x(x), y(y) { }
 };
 
+// A range of a mesh's index buffer that draws the whole mesh at some level of detail
+struct MeshLOD {
+	unsigned int indexOffset;
+	unsigned int indexCount;
+	// Largest distance, in model units, between this level's surface and the full mesh
+	float error;
+};
+
 class VectorMesh {
 public:
 	std::string name;
@@ -51,17 +60,13 @@ public:
 	std::vector<float3> normals;
 	std::vector<unsigned int> indices;
 
-	VectorMesh(std::string vname) : name(vname) {
-	    // Trading memory usage for speed
-	    vertices.reserve(200000);
-        normals.reserve(200000);
-        indices.reserve(200000);
-	}
+	// Loaders size the arrays themselves, blanket reserves here only inflated peak memory
+	VectorMesh(std::string vname) : name(vname), hasNormals(false) { }
 
 	bool hasNormals;
 
 	unsigned long faceCount() {
-		return (this->vertices.size() / 3);
+		return (this->indices.size() / 3);
 	}
 };
 
@@ -72,6 +77,8 @@ public:
 	std::vector<float> colours;
 	std::vector<float> normals;
 	std::vector<unsigned int> indices;
+	// Levels of detail stored in indices, most detailed first. Empty if indices is a single level.
+	std::vector<MeshLOD> lods;
 
 	Mesh(std::string vname) : name(vname) { }
 	Mesh(VectorMesh &mesh) {
@@ -88,11 +95,82 @@ public:
 		std::memcpy(normals.data(),  mesh.normals.data(),  mesh.normals.size() * 3 * sizeof(float));
 		std::memcpy(indices.data(),  mesh.indices.data(),  mesh.indices.size() * sizeof(unsigned int));
 	}
+	// Converts a mesh that is no longer needed, releasing each of its arrays as soon as
+	// it has been converted so that the mesh never exists twice in memory
+	Mesh(VectorMesh &&mesh) : name(std::move(mesh.name)) {
+		vertices.resize(mesh.vertices.size() * 3);
+		for (size_t i = 0; i < mesh.vertices.size(); i++) {
+			vertices[i * 3 + 0] = mesh.vertices[i].x;
+			vertices[i * 3 + 1] = mesh.vertices[i].y;
+			vertices[i * 3 + 2] = mesh.vertices[i].z;
+		}
+		std::vector<float4>().swap(mesh.vertices);
+		std::vector<float4>().swap(mesh.colours);
+
+		normals.resize(mesh.normals.size() * 3);
+		std::memcpy(normals.data(), mesh.normals.data(), mesh.normals.size() * 3 * sizeof(float));
+		std::vector<float3>().swap(mesh.normals);
+
+		indices = std::move(mesh.indices);
+	}
 
-	unsigned int vertexCount() {
+	unsigned int vertexCount() const {
 		return (this->vertices.size()) / 3;
 	}
 
+	// Bytes held by the mesh's arrays
+	size_t byteSize() const {
+		return (vertices.size() + colours.size() + normals.size()) * sizeof(float)
+			+ indices.size() * sizeof(unsigned int);
+	}
+
+};
+
+// Axis aligned bounding box of a tightly packed xyz vertex array, empty (min above max) if there are no vertices
+inline void computeBounds(const float *vertices, unsigned int vertexCount, float3 &boundsMin, float3 &boundsMax) {
+	boundsMin = float3(1e30f, 1e30f, 1e30f);
+	boundsMax = float3(-1e30f, -1e30f, -1e30f);
+	for (unsigned int i = 0; i < vertexCount; i++) {
+		const float *vertex = vertices + size_t(i) * 3;
+		boundsMin.x = vertex[0] < boundsMin.x ? vertex[0] : boundsMin.x;
+		boundsMin.y = vertex[1] < boundsMin.y ? vertex[1] : boundsMin.y;
+		boundsMin.z = vertex[2] < boundsMin.z ? vertex[2] : boundsMin.z;
+		boundsMax.x = vertex[0] > boundsMax.x ? vertex[0] : boundsMax.x;
+		boundsMax.y = vertex[1] > boundsMax.y ? vertex[1] : boundsMax.y;
+		boundsMax.z = vertex[2] > boundsMax.z ? vertex[2] : boundsMax.z;
+	}
+}
+
+// Non-owning view of a mesh's arrays, which may live in a Mesh or in a mapped cache file
+struct MeshView {
+	std::string name;
+	const float *vertices;
+	const float *normals;
+	const float *colours;
+	const unsigned int *indices;
+	unsigned int vertexCount;
+	// All indices, including those of every level of detail
+	unsigned int indexCount;
+	const MeshLOD *lods;
+	unsigned int lodCount;
+	// Bounding box of the vertices, known without reading them when the view comes from a cache
+	float3 boundsMin;
+	float3 boundsMax;
+
+	MeshView() : vertices(nullptr), normals(nullptr), colours(nullptr), indices(nullptr), vertexCount(0), indexCount(0),
+		lods(nullptr), lodCount(0), boundsMin(0, 0, 0), boundsMax(0, 0, 0) { }
+	MeshView(const Mesh &mesh) :
+		name(mesh.name),
+		vertices(mesh.vertices.data()),
+		normals(mesh.normals.data()),
+		colours(mesh.colours.empty() ? nullptr : mesh.colours.data()),
+		indices(mesh.indices.data()),
+		vertexCount(mesh.vertexCount()),
+		indexCount(unsigned(mesh.indices.size())),
+		lods(mesh.lods.empty() ? nullptr : mesh.lods.data()),
+		lodCount(unsigned(mesh.lods.size())) {
+		computeBounds(vertices, vertexCount, boundsMin, boundsMax);
+	}
 };
 
 
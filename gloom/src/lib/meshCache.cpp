@@ -0,0 +1,239 @@
+#include "meshCache.hpp"
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+
+// Bump whenever the file layout or the processing of the stored meshes changes
+#define MESH_CACHE_VERSION 5
+#define MESH_CACHE_ALIGNMENT 64
+
+static const char meshCacheMagic[8] = { 'G', 'L', 'O', 'O', 'M', 'M', 'S', 'H' };
+
+struct MeshCacheHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t meshCount;
+	uint64_t sourceSize;
+	int64_t sourceModified;
+};
+
+struct MeshCacheEntry {
+	uint64_t nameOffset;
+	uint64_t verticesOffset;
+	uint64_t normalsOffset;
+	uint64_t coloursOffset;
+	uint64_t indicesOffset;
+	uint64_t lodsOffset;
+	uint32_t nameLength;
+	uint32_t vertexCount;
+	uint32_t indexCount;
+	uint32_t hasColours;
+	uint32_t lodCount;
+	uint32_t padding;
+	float boundsMin[3];
+	float boundsMax[3];
+};
+
+static uint64_t alignOffset(uint64_t offset) {
+	return (offset + MESH_CACHE_ALIGNMENT - 1) & ~uint64_t(MESH_CACHE_ALIGNMENT - 1);
+}
+
+// Checks that an array of the given size lies inside the file and is suitably aligned
+static bool inBounds(uint64_t offset, uint64_t bytes, uint64_t fileSize) {
+	return offset % 4 == 0 && offset <= fileSize && bytes <= fileSize - offset;
+}
+
+bool MeshCache::open(std::string const &cachePath, std::string const &srcFile) {
+	close();
+
+	FileInfo sourceInfo;
+	FileInfo cacheInfo;
+	if (!getFileInfo(srcFile, sourceInfo) || !getFileInfo(cachePath, cacheInfo) || cacheInfo.size < sizeof(MeshCacheHeader)) {
+		return false;
+	}
+
+	mFile.open(cachePath);
+	const char *base = mFile.data();
+	uint64_t fileSize = mFile.size();
+
+	MeshCacheHeader header;
+	std::memcpy(&header, base, sizeof(header));
+	if (std::memcmp(header.magic, meshCacheMagic, sizeof(meshCacheMagic)) != 0
+		|| header.version != MESH_CACHE_VERSION
+		|| header.sourceSize != sourceInfo.size
+		|| header.sourceModified != sourceInfo.modified
+		|| !inBounds(sizeof(header), uint64_t(header.meshCount) * sizeof(MeshCacheEntry), fileSize)) {
+		close();
+		return false;
+	}
+
+	const MeshCacheEntry *entries = reinterpret_cast<const MeshCacheEntry *>(base + sizeof(header));
+	mViews.resize(header.meshCount);
+	for (uint32_t i = 0; i < header.meshCount; i++) {
+		const MeshCacheEntry &entry = entries[i];
+		uint64_t attributeBytes = uint64_t(entry.vertexCount) * 3 * sizeof(float);
+		if (entry.nameOffset > fileSize || entry.nameLength > fileSize - entry.nameOffset
+			|| !inBounds(entry.verticesOffset, attributeBytes, fileSize)
+			|| !inBounds(entry.normalsOffset, attributeBytes, fileSize)
+			|| (entry.hasColours && !inBounds(entry.coloursOffset, uint64_t(entry.vertexCount) * 4 * sizeof(float), fileSize))
+			|| !inBounds(entry.indicesOffset, uint64_t(entry.indexCount) * sizeof(unsigned int), fileSize)
+			|| !inBounds(entry.lodsOffset, uint64_t(entry.lodCount) * sizeof(MeshLOD), fileSize)) {
+			close();
+			return false;
+		}
+		const MeshLOD *lods = reinterpret_cast<const MeshLOD *>(base + entry.lodsOffset);
+		for (uint32_t l = 0; l < entry.lodCount; l++) {
+			if (lods[l].indexOffset > entry.indexCount || lods[l].indexCount > entry.indexCount - lods[l].indexOffset) {
+				close();
+				return false;
+			}
+		}
+
+		MeshView &view = mViews[i];
+		view.name = std::string(base + entry.nameOffset, entry.nameLength);
+		view.vertices = reinterpret_cast<const float *>(base + entry.verticesOffset);
+		view.normals = reinterpret_cast<const float *>(base + entry.normalsOffset);
+		view.colours = entry.hasColours ? reinterpret_cast<const float *>(base + entry.coloursOffset) : nullptr;
+		view.indices = reinterpret_cast<const unsigned int *>(base + entry.indicesOffset);
+		view.vertexCount = entry.vertexCount;
+		view.indexCount = entry.indexCount;
+		view.lods = entry.lodCount > 0 ? lods : nullptr;
+		view.lodCount = entry.lodCount;
+		view.boundsMin = float3(entry.boundsMin[0], entry.boundsMin[1], entry.boundsMin[2]);
+		view.boundsMax = float3(entry.boundsMax[0], entry.boundsMax[1], entry.boundsMax[2]);
+
+		// The arrays of a mesh are stored back to back, from its vertices to its levels of detail
+		mRanges.push_back(std::make_pair(base + entry.verticesOffset,
+			base + entry.lodsOffset + uint64_t(entry.lodCount) * sizeof(MeshLOD)));
+	}
+
+	return true;
+}
+
+void MeshCache::close() {
+	mViews.clear();
+	mRanges.clear();
+	mOwnedMeshes.clear();
+	mFile.close();
+}
+
+void MeshCache::assign(std::vector<Mesh> &&meshes) {
+	close();
+	mOwnedMeshes = std::move(meshes);
+	for (const Mesh &mesh : mOwnedMeshes) {
+		mViews.emplace_back(mesh);
+	}
+}
+
+void MeshCache::releaseMesh(size_t index) {
+	if (index < mRanges.size()) {
+		mFile.releasePages(mRanges[index].first, mRanges[index].second);
+	}
+}
+
+const MeshView *MeshCache::find(std::string const &name) const {
+	for (const MeshView &view : mViews) {
+		if (view.name == name) {
+			return &view;
+		}
+	}
+	return nullptr;
+}
+
+// Writes data at offset, padding the stream with zeros up to it
+static void writeAt(std::ofstream &out, uint64_t &position, uint64_t offset, const void *data, uint64_t bytes) {
+	static const char zeros[MESH_CACHE_ALIGNMENT] = { 0 };
+	out.write(zeros, std::streamsize(offset - position));
+	out.write(static_cast<const char *>(data), std::streamsize(bytes));
+	position = offset + bytes;
+}
+
+bool MeshCache::write(std::string const &cachePath, std::string const &srcFile, const std::vector<const Mesh *> &meshes) {
+	FileInfo sourceInfo;
+	if (!getFileInfo(srcFile, sourceInfo)) {
+		return false;
+	}
+
+	MeshCacheHeader header;
+	std::memcpy(header.magic, meshCacheMagic, sizeof(meshCacheMagic));
+	header.version = MESH_CACHE_VERSION;
+	header.meshCount = uint32_t(meshes.size());
+	header.sourceSize = sourceInfo.size;
+	header.sourceModified = sourceInfo.modified;
+
+	// Lay out the names first, then every array on its own aligned offset
+	std::vector<MeshCacheEntry> entries(meshes.size());
+	uint64_t offset = sizeof(header) + entries.size() * sizeof(MeshCacheEntry);
+	for (size_t i = 0; i < meshes.size(); i++) {
+		entries[i].nameOffset = offset;
+		entries[i].nameLength = uint32_t(meshes[i]->name.size());
+		offset += meshes[i]->name.size();
+	}
+	for (size_t i = 0; i < meshes.size(); i++) {
+		const Mesh &mesh = *meshes[i];
+		MeshCacheEntry &entry = entries[i];
+		entry.vertexCount = mesh.vertexCount();
+		entry.indexCount = uint32_t(mesh.indices.size());
+		entry.hasColours = mesh.colours.size() == size_t(entry.vertexCount) * 4;
+
+		entry.verticesOffset = alignOffset(offset);
+		offset = entry.verticesOffset + uint64_t(entry.vertexCount) * 3 * sizeof(float);
+		entry.normalsOffset = alignOffset(offset);
+		offset = entry.normalsOffset + uint64_t(entry.vertexCount) * 3 * sizeof(float);
+		entry.coloursOffset = alignOffset(offset);
+		offset = entry.coloursOffset + (entry.hasColours ? uint64_t(entry.vertexCount) * 4 * sizeof(float) : 0);
+		entry.indicesOffset = alignOffset(offset);
+		offset = entry.indicesOffset + uint64_t(entry.indexCount) * sizeof(unsigned int);
+		entry.lodCount = uint32_t(mesh.lods.size());
+		entry.padding = 0;
+		entry.lodsOffset = alignOffset(offset);
+		offset = entry.lodsOffset + uint64_t(entry.lodCount) * sizeof(MeshLOD);
+
+		float3 boundsMin;
+		float3 boundsMax;
+		computeBounds(mesh.vertices.data(), entry.vertexCount, boundsMin, boundsMax);
+		entry.boundsMin[0] = boundsMin.x;
+		entry.boundsMin[1] = boundsMin.y;
+		entry.boundsMin[2] = boundsMin.z;
+		entry.boundsMax[0] = boundsMax.x;
+		entry.boundsMax[1] = boundsMax.y;
+		entry.boundsMax[2] = boundsMax.z;
+	}
+
+	// Write to a temporary file first, so that a crash never leaves a truncated cache behind
+	std::string temporaryPath = cachePath + ".tmp";
+	{
+		std::ofstream out(temporaryPath, std::ios::binary | std::ios::trunc);
+		if (!out.is_open()) {
+			return false;
+		}
+
+		uint64_t position = 0;
+		writeAt(out, position, 0, &header, sizeof(header));
+		writeAt(out, position, position, entries.data(), entries.size() * sizeof(MeshCacheEntry));
+		for (size_t i = 0; i < meshes.size(); i++) {
+			writeAt(out, position, entries[i].nameOffset, meshes[i]->name.data(), entries[i].nameLength);
+		}
+		for (size_t i = 0; i < meshes.size(); i++) {
+			const Mesh &mesh = *meshes[i];
+			const MeshCacheEntry &entry = entries[i];
+			writeAt(out, position, entry.verticesOffset, mesh.vertices.data(), uint64_t(entry.vertexCount) * 3 * sizeof(float));
+			writeAt(out, position, entry.normalsOffset, mesh.normals.data(), uint64_t(entry.vertexCount) * 3 * sizeof(float));
+			if (entry.hasColours) {
+				writeAt(out, position, entry.coloursOffset, mesh.colours.data(), uint64_t(entry.vertexCount) * 4 * sizeof(float));
+			}
+			writeAt(out, position, entry.indicesOffset, mesh.indices.data(), uint64_t(entry.indexCount) * sizeof(unsigned int));
+			writeAt(out, position, entry.lodsOffset, mesh.lods.data(), uint64_t(entry.lodCount) * sizeof(MeshLOD));
+		}
+
+		if (!out.good()) {
+			out.close();
+			std::remove(temporaryPath.c_str());
+			return false;
+		}
+	}
+
+	std::remove(cachePath.c_str());
+	return std::rename(temporaryPath.c_str(), cachePath.c_str()) == 0;
+}
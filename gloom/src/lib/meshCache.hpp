@@ -0,0 +1,52 @@
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+#include "mesh.hpp"
+#include "mappedFile.hpp"
+
+// Appended to the OBJ file name to get the name of its cache file
+#define MESH_CACHE_EXTENSION ".meshcache"
+
+// Binary container for the processed meshes of one OBJ file.
+//
+// Layout: a header, one entry per mesh, the mesh names, and then the vertex, normal,
+// colour, index and level of detail arrays of every mesh, each aligned to
+// MESH_CACHE_ALIGNMENT bytes.
+// Every entry also holds the bounding box of its mesh, so that meshes can be placed and
+// culled before any of their arrays have been read.
+// The header records the size and modification time of the OBJ file it was built from,
+// so that the cache is rebuilt whenever the source changes.
+//
+// Opening a cache maps it into memory and exposes the arrays as MeshViews that can be
+// handed straight to buildMesh without copying them into vectors first.
+class MeshCache {
+public:
+	// Maps cachePath if it exists and matches srcFile in its current state
+	bool open(std::string const &cachePath, std::string const &srcFile);
+	void close();
+
+	// Keeps already loaded meshes in memory instead, for when no cache file can be written
+	void assign(std::vector<Mesh> &&meshes);
+
+	// Serialises meshes into cachePath, stamped with the current state of srcFile.
+	// Returns false if the file could not be written.
+	static bool write(std::string const &cachePath, std::string const &srcFile, const std::vector<const Mesh *> &meshes);
+
+	const std::vector<MeshView> &meshes() const { return mViews; }
+	// Returns nullptr if there is no mesh with the given name
+	const MeshView *find(std::string const &name) const;
+
+	// Lets the operating system drop the pages holding the arrays of mesh index from memory,
+	// e.g. once they have been uploaded. Its view stays valid, the pages are read back on use.
+	// Does nothing for meshes kept in memory.
+	void releaseMesh(size_t index);
+
+private:
+	MappedFile mFile;
+	std::vector<Mesh> mOwnedMeshes;
+	std::vector<MeshView> mViews;
+	// Start and end of the arrays of every mapped mesh
+	std::vector<std::pair<const char *, const char *>> mRanges;
+};
@@ -0,0 +1,352 @@
+#include "meshOptimiser.hpp"
+#include <algorithm>
+#include <cmath>
+#include <iostream>
+#include <glm/glm.hpp>
+
+// Size of the LRU cache modelled while reordering triangles
+#define FORSYTH_CACHE_SIZE 32
+// Valences above this all get the same score
+#define FORSYTH_MAX_VALENCE 32
+// Size of the FIFO cache used to measure ACMR/ATVR, typical for current GPUs
+#define ANALYSIS_CACHE_SIZE 16
+// Clusters smaller than this are never split off when sorting for overdraw
+#define OVERDRAW_MIN_CLUSTER 32
+
+#define NO_TRIANGLE (~size_t(0))
+
+// --- Analysis ---
+
+// Simulates a FIFO cache by remembering when each vertex was last inserted.
+// A vertex is still cached if fewer than ANALYSIS_CACHE_SIZE misses happened since.
+class FIFOCacheSimulation {
+public:
+	explicit FIFOCacheSimulation(unsigned int vertexCount) : mInsertedAt(vertexCount, 0), mTime(ANALYSIS_CACHE_SIZE + 1) { }
+
+	// Returns true on a cache miss
+	bool access(unsigned int vertex) {
+		if (mTime - mInsertedAt[vertex] > ANALYSIS_CACHE_SIZE) {
+			mInsertedAt[vertex] = mTime++;
+			return true;
+		}
+		return false;
+	}
+
+	// Evicts everything, as if a new draw started
+	void flush() {
+		mTime += ANALYSIS_CACHE_SIZE + 1;
+	}
+
+private:
+	std::vector<unsigned int> mInsertedAt;
+	unsigned int mTime;
+};
+
+VertexCacheStats analyseVertexCache(const std::vector<unsigned int> &indices, unsigned int vertexCount) {
+	FIFOCacheSimulation cache(vertexCount);
+	size_t misses = 0;
+	for (unsigned int index : indices) {
+		misses += cache.access(index);
+	}
+
+	VertexCacheStats stats;
+	stats.acmr = indices.size() >= 3 ? float(misses) / float(indices.size() / 3) : 0.0f;
+	stats.atvr = vertexCount > 0 ? float(misses) / float(vertexCount) : 0.0f;
+	return stats;
+}
+
+// --- Vertex cache optimisation ---
+
+// Score tables for the vertex scoring function of Forsyth's algorithm
+struct ForsythScores {
+	float cachePosition[FORSYTH_CACHE_SIZE];
+	float valence[FORSYTH_MAX_VALENCE + 1];
+
+	ForsythScores() {
+		const float cacheDecayPower = 1.5f;
+		const float lastTriangleScore = 0.75f;
+		const float valenceBoostScale = 2.0f;
+		const float valenceBoostPower = 0.5f;
+
+		for (int i = 0; i < FORSYTH_CACHE_SIZE; i++) {
+			if (i < 3) {
+				// The vertices of the triangle that was just drawn get a fixed score,
+				// so that the next triangle does not always reuse the same edge
+				cachePosition[i] = lastTriangleScore;
+			} else {
+				float scaler = 1.0f / (FORSYTH_CACHE_SIZE - 3);
+				cachePosition[i] = std::pow(1.0f - float(i - 3) * scaler, cacheDecayPower);
+			}
+		}
+		valence[0] = 0.0f;
+		for (int i = 1; i <= FORSYTH_MAX_VALENCE; i++) {
+			// Vertices with few triangles left are boosted, to get rid of them quickly
+			valence[i] = valenceBoostScale * std::pow(float(i), -valenceBoostPower);
+		}
+	}
+
+	float score(int position, unsigned int remainingTriangles) const {
+		if (remainingTriangles == 0) {
+			return -1.0f;
+		}
+		float result = position >= 0 ? cachePosition[position] : 0.0f;
+		return result + valence[std::min<unsigned int>(remainingTriangles, FORSYTH_MAX_VALENCE)];
+	}
+};
+
+void optimiseVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount) {
+	static const ForsythScores scores;
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Triangles that have not been emitted yet, per vertex
+	std::vector<unsigned int> remaining(vertexCount, 0);
+	for (size_t i = 0; i < triangleCount * 3; i++) {
+		remaining[indices[i]]++;
+	}
+	std::vector<size_t> adjacencyOffsets(vertexCount + 1, 0);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		adjacencyOffsets[v + 1] = adjacencyOffsets[v] + remaining[v];
+	}
+	std::vector<size_t> adjacency(triangleCount * 3);
+	{
+		std::vector<size_t> fill(adjacencyOffsets.begin(), adjacencyOffsets.end() - 1);
+		for (size_t i = 0; i < triangleCount * 3; i++) {
+			adjacency[fill[indices[i]]++] = i / 3;
+		}
+	}
+
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		vertexScores[v] = scores.score(-1, remaining[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<char> emitted(triangleCount, 0);
+	size_t bestTriangle = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		triangleScores[t] = vertexScores[indices[t * 3]] + vertexScores[indices[t * 3 + 1]] + vertexScores[indices[t * 3 + 2]];
+		if (triangleScores[t] > triangleScores[bestTriangle]) {
+			bestTriangle = t;
+		}
+	}
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	unsigned int cache[FORSYTH_CACHE_SIZE + 3];
+	unsigned int cacheCount = 0;
+	size_t inputCursor = 0;
+
+	while (output.size() < triangleCount * 3) {
+		// Nothing useful in the cache, continue with the next triangle in input order
+		if (bestTriangle == NO_TRIANGLE) {
+			while (emitted[inputCursor]) {
+				inputCursor++;
+			}
+			bestTriangle = inputCursor;
+		}
+
+		emitted[bestTriangle] = 1;
+		const unsigned int *triangle = &indices[bestTriangle * 3];
+
+		// The emitted triangle's vertices move to the front of the cache
+		unsigned int newCache[FORSYTH_CACHE_SIZE + 3];
+		unsigned int newCount = 0;
+		unsigned int triangleVertexCount = 0;
+		for (int k = 0; k < 3; k++) {
+			unsigned int v = triangle[k];
+			output.push_back(v);
+
+			size_t begin = adjacencyOffsets[v];
+			size_t end = begin + remaining[v];
+			for (size_t j = begin; j < end; j++) {
+				if (adjacency[j] == bestTriangle) {
+					adjacency[j] = adjacency[end - 1];
+					remaining[v]--;
+					break;
+				}
+			}
+
+			if (std::find(newCache, newCache + triangleVertexCount, v) == newCache + triangleVertexCount) {
+				newCache[triangleVertexCount++] = v;
+			}
+		}
+		newCount = triangleVertexCount;
+		for (unsigned int i = 0; i < cacheCount; i++) {
+			if (std::find(newCache, newCache + triangleVertexCount, cache[i]) == newCache + triangleVertexCount) {
+				newCache[newCount++] = cache[i];
+			}
+		}
+
+		// Rescore everything that moved, including vertices that just fell out of the cache
+		for (unsigned int i = 0; i < newCount; i++) {
+			unsigned int v = newCache[i];
+			cachePosition[v] = i < FORSYTH_CACHE_SIZE ? int(i) : -1;
+			float newScore = scores.score(cachePosition[v], remaining[v]);
+			float delta = newScore - vertexScores[v];
+			vertexScores[v] = newScore;
+
+			size_t begin = adjacencyOffsets[v];
+			for (size_t j = begin; j < begin + remaining[v]; j++) {
+				triangleScores[adjacency[j]] += delta;
+			}
+		}
+		cacheCount = std::min<unsigned int>(newCount, FORSYTH_CACHE_SIZE);
+		std::copy(newCache, newCache + cacheCount, cache);
+
+		// The next triangle is the best one touching the cache
+		bestTriangle = NO_TRIANGLE;
+		float bestScore = -1.0f;
+		for (unsigned int i = 0; i < cacheCount; i++) {
+			unsigned int v = cache[i];
+			size_t begin = adjacencyOffsets[v];
+			for (size_t j = begin; j < begin + remaining[v]; j++) {
+				if (triangleScores[adjacency[j]] > bestScore) {
+					bestScore = triangleScores[adjacency[j]];
+					bestTriangle = adjacency[j];
+				}
+			}
+		}
+	}
+
+	// Leftover indices of an incomplete last triangle are dropped
+	indices.swap(output);
+}
+
+// --- Overdraw optimisation ---
+
+void optimiseOverdraw(std::vector<unsigned int> &indices, const std::vector<float> &vertices, float threshold) {
+	size_t triangleCount = indices.size() / 3;
+	unsigned int vertexCount = unsigned(vertices.size() / 3);
+	if (triangleCount == 0) {
+		return;
+	}
+
+	// Hard cluster boundaries are where the cache had to start over anyway (three misses).
+	// Soft boundaries are cut once a cluster on its own is within threshold of the mesh's ACMR.
+	float targetMisses = threshold * analyseVertexCache(indices, vertexCount).acmr;
+	std::vector<size_t> clusterStarts(1, 0);
+	FIFOCacheSimulation cache(vertexCount);
+	size_t clusterMisses = 0;
+	for (size_t t = 0; t < triangleCount; t++) {
+		size_t clusterSize = t - clusterStarts.back();
+		if (clusterSize >= OVERDRAW_MIN_CLUSTER && float(clusterMisses) <= targetMisses * float(clusterSize)) {
+			clusterStarts.push_back(t);
+			clusterMisses = 0;
+			cache.flush();
+		}
+
+		unsigned int misses = 0;
+		for (int k = 0; k < 3; k++) {
+			misses += cache.access(indices[t * 3 + k]);
+		}
+		if (misses == 3 && t != clusterStarts.back()) {
+			clusterStarts.push_back(t);
+			clusterMisses = 0;
+		}
+		clusterMisses += misses;
+	}
+	clusterStarts.push_back(triangleCount);
+
+	// Area weighted centroid and normal of every cluster
+	size_t clusterCount = clusterStarts.size() - 1;
+	std::vector<glm::vec3> centroids(clusterCount, glm::vec3(0.0f));
+	std::vector<glm::vec3> normals(clusterCount, glm::vec3(0.0f));
+	std::vector<float> areas(clusterCount, 0.0f);
+	glm::vec3 meshCentroid(0.0f);
+	float meshArea = 0.0f;
+	for (size_t c = 0; c < clusterCount; c++) {
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; t++) {
+			const float *a = &vertices[indices[t * 3] * 3];
+			const float *b = &vertices[indices[t * 3 + 1] * 3];
+			const float *d = &vertices[indices[t * 3 + 2] * 3];
+			glm::vec3 p0(a[0], a[1], a[2]);
+			glm::vec3 p1(b[0], b[1], b[2]);
+			glm::vec3 p2(d[0], d[1], d[2]);
+			glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+			float area = glm::length(normal) * 0.5f;
+
+			centroids[c] += (p0 + p1 + p2) * (area / 3.0f);
+			normals[c] += normal;
+			areas[c] += area;
+		}
+		meshCentroid += centroids[c];
+		meshArea += areas[c];
+	}
+	if (meshArea > 0.0f) {
+		meshCentroid = meshCentroid / meshArea;
+	}
+
+	// Clusters far out along their own normal are likely to occlude the others
+	std::vector<float> sortKeys(clusterCount, 0.0f);
+	for (size_t c = 0; c < clusterCount; c++) {
+		float normalLength = glm::length(normals[c]);
+		if (areas[c] > 0.0f && normalLength > 0.0f) {
+			sortKeys[c] = glm::dot(centroids[c] / areas[c] - meshCentroid, normals[c] / normalLength);
+		}
+	}
+	std::vector<size_t> order(clusterCount);
+	for (size_t c = 0; c < clusterCount; c++) {
+		order[c] = c;
+	}
+	std::stable_sort(order.begin(), order.end(), [&](size_t a, size_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<unsigned int> output;
+	output.reserve(triangleCount * 3);
+	for (size_t c : order) {
+		output.insert(output.end(), indices.begin() + clusterStarts[c] * 3, indices.begin() + clusterStarts[c + 1] * 3);
+	}
+	indices.swap(output);
+}
+
+// --- Vertex fetch optimisation ---
+
+// Moves every vertex attribute to its new index, dropping unreferenced vertices
+static void remapAttribute(std::vector<float> &values, const std::vector<unsigned int> &remap,
+						   unsigned int components, unsigned int newVertexCount) {
+	if (values.size() != remap.size() * components) {
+		return;
+	}
+	std::vector<float> result(size_t(newVertexCount) * components);
+	for (size_t v = 0; v < remap.size(); v++) {
+		if (remap[v] != ~0u) {
+			std::copy(values.begin() + v * components, values.begin() + (v + 1) * components,
+					  result.begin() + size_t(remap[v]) * components);
+		}
+	}
+	values.swap(result);
+}
+
+void optimiseVertexFetch(Mesh &mesh) {
+	std::vector<unsigned int> remap(mesh.vertexCount(), ~0u);
+	unsigned int nextVertex = 0;
+	for (unsigned int &index : mesh.indices) {
+		if (remap[index] == ~0u) {
+			remap[index] = nextVertex++;
+		}
+		index = remap[index];
+	}
+
+	remapAttribute(mesh.vertices, remap, 3, nextVertex);
+	remapAttribute(mesh.normals, remap, 3, nextVertex);
+	remapAttribute(mesh.colours, remap, 4, nextVertex);
+}
+
+void optimiseMesh(Mesh &mesh, bool quiet) {
+	VertexCacheStats before = analyseVertexCache(mesh.indices, mesh.vertexCount());
+
+	optimiseVertexCache(mesh.indices, mesh.vertexCount());
+	optimiseOverdraw(mesh.indices, mesh.vertices);
+	optimiseVertexFetch(mesh);
+
+	if (!quiet) {
+		VertexCacheStats after = analyseVertexCache(mesh.indices, mesh.vertexCount());
+		std::cout << "[INFO] optimised " << mesh.name << ": ACMR " << before.acmr << " -> " << after.acmr
+				  << ", ATVR " << before.atvr << " -> " << after.atvr << std::endl;
+	}
+}
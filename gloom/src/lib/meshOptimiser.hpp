@@ -0,0 +1,32 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+
+// Results of running an index buffer through a simulated FIFO post-transform vertex cache
+struct VertexCacheStats {
+	// Average cache misses per triangle, between 0.5 (ideal for large meshes) and 3
+	float acmr;
+	// Average transforms per vertex, 1 is ideal
+	float atvr;
+};
+
+VertexCacheStats analyseVertexCache(const std::vector<unsigned int> &indices, unsigned int vertexCount);
+
+// Reorders triangles for post-transform vertex cache reuse, following
+// Tom Forsyth's "Linear-Speed Vertex Cache Optimisation"
+void optimiseVertexCache(std::vector<unsigned int> &indices, unsigned int vertexCount);
+
+// Splits a cache optimised index buffer into clusters and sorts them so that clusters
+// facing away from the mesh centre are drawn first, which lets early-Z reject more of
+// what is behind them. threshold is how much worse than the cache optimised ACMR the
+// result may get.
+void optimiseOverdraw(std::vector<unsigned int> &indices, const std::vector<float> &vertices, float threshold = 1.05f);
+
+// Renumbers the vertices of mesh in the order they are first used by its index buffer,
+// so that vertex fetches walk memory linearly. Unreferenced vertices are dropped.
+void optimiseVertexFetch(Mesh &mesh);
+
+// Runs all of the above on mesh and, unless quiet, prints ACMR/ATVR before and after
+void optimiseMesh(Mesh &mesh, bool quiet = false);
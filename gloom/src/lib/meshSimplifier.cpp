@@ -0,0 +1,333 @@
+#include "meshSimplifier.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstring>
+#include <unordered_map>
+#include <glm/glm.hpp>
+#include "meshOptimiser.hpp"
+
+// Most levels a chain gets, including the full mesh
+#define LOD_MAX_LEVELS 8
+// Each level aims for this fraction of the triangles of the level before
+#define LOD_REDUCTION 0.5f
+// Levels stop once simplification can not remove at least this fraction of triangles
+#define LOD_MIN_REDUCTION 0.1f
+// Meshes and levels smaller than this are not simplified any further
+#define LOD_MIN_TRIANGLES 64
+// Largest error of the first simplified level, relative to the radius of the mesh.
+// Every further level may move the surface by twice as much as the one before.
+#define LOD_BASE_ERROR 0.002f
+
+#define NO_VERTEX (~0u)
+
+// Sum of squared distances to a set of planes, weighted by triangle area:
+// Q(p) = p^T A p + 2 b.p + c
+struct Quadric {
+	double a00, a01, a02, a11, a12, a22;
+	double b0, b1, b2;
+	double c;
+	double weight;
+
+	void add(const Quadric &other) {
+		a00 += other.a00; a01 += other.a01; a02 += other.a02;
+		a11 += other.a11; a12 += other.a12; a22 += other.a22;
+		b0 += other.b0; b1 += other.b1; b2 += other.b2;
+		c += other.c;
+		weight += other.weight;
+	}
+
+	// Weighted mean squared distance of p to the planes
+	double error(const glm::vec3 &p) const {
+		double x = p.x, y = p.y, z = p.z;
+		double sum = x * (a00 * x + 2.0 * (a01 * y + a02 * z)) + y * (a11 * y + 2.0 * a12 * z) + a22 * z * z
+			+ 2.0 * (b0 * x + b1 * y + b2 * z) + c;
+		return weight > 0.0 ? std::max(sum, 0.0) / weight : 0.0;
+	}
+};
+
+static Quadric planeQuadric(const glm::vec3 &normal, double distance, double weight) {
+	Quadric q;
+	double nx = normal.x, ny = normal.y, nz = normal.z;
+	q.a00 = weight * nx * nx; q.a01 = weight * nx * ny; q.a02 = weight * nx * nz;
+	q.a11 = weight * ny * ny; q.a12 = weight * ny * nz; q.a22 = weight * nz * nz;
+	q.b0 = weight * nx * distance; q.b1 = weight * ny * distance; q.b2 = weight * nz * distance;
+	q.c = weight * distance * distance;
+	q.weight = weight;
+	return q;
+}
+
+static inline glm::vec3 positionOf(const float *vertices, unsigned int vertex) {
+	return glm::vec3(vertices[vertex * 3 + 0], vertices[vertex * 3 + 1], vertices[vertex * 3 + 2]);
+}
+
+// Finds the vertices that must stay where they are: those sharing their position with
+// another vertex, which would tear the seam open if moved, and those on open borders.
+static std::vector<bool> findLockedVertices(const std::vector<unsigned int> &indices, const float *vertices, unsigned int vertexCount) {
+	std::vector<bool> locked(vertexCount, false);
+
+	// Identify every vertex by the first vertex with the same position
+	struct PositionHash {
+		size_t operator()(const glm::vec3 &p) const {
+			uint32_t bits[3];
+			std::memcpy(bits, &p, sizeof(bits));
+			return size_t((bits[0] * 73856093u) ^ (bits[1] * 19349663u) ^ (bits[2] * 83492791u));
+		}
+	};
+	std::unordered_map<glm::vec3, unsigned int, PositionHash> firstAtPosition;
+	firstAtPosition.reserve(vertexCount);
+	std::vector<unsigned int> canonical(vertexCount);
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		std::pair<std::unordered_map<glm::vec3, unsigned int, PositionHash>::iterator, bool> inserted =
+			firstAtPosition.insert(std::make_pair(positionOf(vertices, v), v));
+		canonical[v] = inserted.first->second;
+		if (!inserted.second) {
+			locked[v] = true;
+			locked[canonical[v]] = true;
+		}
+	}
+
+	// An edge used by a single triangle lies on a border. Edges are compared by position,
+	// so that seams are not mistaken for borders.
+	std::vector<uint64_t> edges;
+	edges.reserve(indices.size());
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		for (unsigned int e = 0; e < 3; e++) {
+			unsigned int a = canonical[indices[i + e]];
+			unsigned int b = canonical[indices[i + (e + 1) % 3]];
+			edges.push_back((uint64_t(std::min(a, b)) << 32) | std::max(a, b));
+		}
+	}
+	std::sort(edges.begin(), edges.end());
+	for (size_t i = 0; i < edges.size();) {
+		size_t end = i + 1;
+		while (end < edges.size() && edges[end] == edges[i]) {
+			end++;
+		}
+		if (end - i == 1) {
+			unsigned int a = unsigned(edges[i] >> 32);
+			unsigned int b = unsigned(edges[i] & 0xFFFFFFFFu);
+			locked[a] = true;
+			locked[b] = true;
+		}
+		i = end;
+	}
+
+	// Border vertices were marked through their canonical vertex, pass that on to the others
+	for (unsigned int v = 0; v < vertexCount; v++) {
+		if (locked[canonical[v]]) {
+			locked[v] = true;
+		}
+	}
+	return locked;
+}
+
+// Triangles around every vertex, stored as offsets into one array
+struct VertexTriangles {
+	std::vector<unsigned int> offsets;
+	std::vector<unsigned int> triangles;
+
+	void build(const std::vector<unsigned int> &indices, unsigned int vertexCount) {
+		offsets.assign(vertexCount + 1, 0);
+		for (unsigned int index : indices) {
+			offsets[index + 1]++;
+		}
+		for (unsigned int v = 0; v < vertexCount; v++) {
+			offsets[v + 1] += offsets[v];
+		}
+		triangles.resize(indices.size());
+		std::vector<unsigned int> next(offsets.begin(), offsets.end() - 1);
+		for (size_t i = 0; i < indices.size(); i++) {
+			triangles[next[indices[i]]++] = unsigned(i / 3);
+		}
+	}
+};
+
+// Checks that moving vertex from onto target does not turn any of its remaining triangles over
+static bool collapseFlipsTriangles(unsigned int from, unsigned int target, const std::vector<unsigned int> &indices,
+								   const VertexTriangles &adjacency, const float *vertices) {
+	glm::vec3 targetPosition = positionOf(vertices, target);
+	for (unsigned int t = adjacency.offsets[from]; t < adjacency.offsets[from + 1]; t++) {
+		const unsigned int *triangle = &indices[adjacency.triangles[t] * 3];
+		if (triangle[0] == target || triangle[1] == target || triangle[2] == target) {
+			// Collapses to nothing
+			continue;
+		}
+		glm::vec3 before[3];
+		glm::vec3 after[3];
+		for (unsigned int c = 0; c < 3; c++) {
+			before[c] = positionOf(vertices, triangle[c]);
+			after[c] = triangle[c] == from ? targetPosition : before[c];
+		}
+		glm::vec3 normalBefore = glm::cross(before[1] - before[0], before[2] - before[0]);
+		glm::vec3 normalAfter = glm::cross(after[1] - after[0], after[2] - after[0]);
+		if (glm::dot(normalBefore, normalAfter) <= 0.0f) {
+			return true;
+		}
+	}
+	return false;
+}
+
+float simplifyMesh(std::vector<unsigned int> &destination, const std::vector<unsigned int> &indices,
+				   const float *vertices, unsigned int vertexCount, size_t targetIndexCount, float maxError) {
+	destination = indices;
+	if (indices.size() <= targetIndexCount) {
+		return 0.0f;
+	}
+
+	std::vector<bool> locked = findLockedVertices(indices, vertices, vertexCount);
+
+	// Every vertex starts out with the planes of the triangles around it
+	std::vector<Quadric> quadrics(vertexCount);
+	std::memset(quadrics.data(), 0, quadrics.size() * sizeof(Quadric));
+	for (size_t i = 0; i + 2 < indices.size(); i += 3) {
+		glm::vec3 p0 = positionOf(vertices, indices[i + 0]);
+		glm::vec3 p1 = positionOf(vertices, indices[i + 1]);
+		glm::vec3 p2 = positionOf(vertices, indices[i + 2]);
+		glm::vec3 normal = glm::cross(p1 - p0, p2 - p0);
+		float doubleArea = glm::length(normal);
+		if (doubleArea == 0.0f) {
+			continue;
+		}
+		normal /= doubleArea;
+		Quadric plane = planeQuadric(normal, -double(glm::dot(normal, p0)), 0.5 * doubleArea);
+		for (unsigned int c = 0; c < 3; c++) {
+			quadrics[indices[i + c]].add(plane);
+		}
+	}
+
+	float resultError = 0.0f;
+	double maxSquaredError = double(maxError) * double(maxError);
+	VertexTriangles adjacency;
+	std::vector<unsigned int> bestTarget(vertexCount);
+	std::vector<double> bestCost(vertexCount);
+	std::vector<unsigned int> order;
+	std::vector<bool> touched(vertexCount);
+	std::vector<unsigned int> collapseTo(vertexCount);
+
+	// Every pass collapses a set of edges that do not share vertices, cheapest first
+	while (destination.size() > targetIndexCount) {
+		// The cheapest collapse of every vertex that may move
+		std::fill(bestTarget.begin(), bestTarget.end(), NO_VERTEX);
+		for (size_t i = 0; i + 2 < destination.size(); i += 3) {
+			for (unsigned int e = 0; e < 6; e++) {
+				unsigned int from = destination[i + e % 3];
+				unsigned int target = destination[i + (e / 3 + 1 + e % 3) % 3];
+				if (locked[from]) {
+					continue;
+				}
+				Quadric merged = quadrics[from];
+				merged.add(quadrics[target]);
+				double cost = merged.error(positionOf(vertices, target));
+				if (bestTarget[from] == NO_VERTEX || cost < bestCost[from]) {
+					bestTarget[from] = target;
+					bestCost[from] = cost;
+				}
+			}
+		}
+
+		order.clear();
+		for (unsigned int v = 0; v < vertexCount; v++) {
+			if (bestTarget[v] != NO_VERTEX && bestCost[v] <= maxSquaredError) {
+				order.push_back(v);
+			}
+		}
+		if (order.empty()) {
+			break;
+		}
+		std::sort(order.begin(), order.end(), [&](unsigned int a, unsigned int b) {
+			return bestCost[a] < bestCost[b];
+		});
+
+		adjacency.build(destination, vertexCount);
+		std::fill(touched.begin(), touched.end(), false);
+		for (unsigned int v = 0; v < vertexCount; v++) {
+			collapseTo[v] = v;
+		}
+
+		// A collapse removes about two triangles
+		size_t trianglesToRemove = (destination.size() - targetIndexCount) / 3;
+		size_t collapses = 0;
+		for (unsigned int from : order) {
+			if (collapses * 2 >= trianglesToRemove) {
+				break;
+			}
+			unsigned int target = bestTarget[from];
+			if (touched[from] || touched[target]) {
+				continue;
+			}
+			if (collapseFlipsTriangles(from, target, destination, adjacency, vertices)) {
+				continue;
+			}
+			collapseTo[from] = target;
+			quadrics[target].add(quadrics[from]);
+			touched[from] = true;
+			touched[target] = true;
+			// Neighbours are left alone this pass, their triangles were checked against the old positions
+			for (unsigned int t = adjacency.offsets[from]; t < adjacency.offsets[from + 1]; t++) {
+				const unsigned int *triangle = &destination[adjacency.triangles[t] * 3];
+				touched[triangle[0]] = touched[triangle[1]] = touched[triangle[2]] = true;
+			}
+			resultError = std::max(resultError, float(std::sqrt(bestCost[from])));
+			collapses++;
+		}
+		if (collapses == 0) {
+			break;
+		}
+
+		// Move the collapsed corners and drop the triangles that became degenerate
+		size_t kept = 0;
+		for (size_t i = 0; i + 2 < destination.size(); i += 3) {
+			unsigned int a = collapseTo[destination[i + 0]];
+			unsigned int b = collapseTo[destination[i + 1]];
+			unsigned int c = collapseTo[destination[i + 2]];
+			if (a == b || b == c || a == c) {
+				continue;
+			}
+			destination[kept++] = a;
+			destination[kept++] = b;
+			destination[kept++] = c;
+		}
+		destination.resize(kept);
+	}
+
+	return resultError;
+}
+
+void buildLODChain(Mesh &mesh) {
+	unsigned int vertexCount = mesh.vertexCount();
+	size_t fullIndexCount = mesh.indices.size();
+	mesh.lods.clear();
+	mesh.lods.push_back(MeshLOD{ 0, unsigned(fullIndexCount), 0.0f });
+	if (vertexCount == 0 || fullIndexCount / 3 < LOD_MIN_TRIANGLES * 2) {
+		return;
+	}
+
+	glm::vec3 minimum = positionOf(mesh.vertices.data(), 0);
+	glm::vec3 maximum = minimum;
+	for (unsigned int v = 1; v < vertexCount; v++) {
+		minimum = glm::min(minimum, positionOf(mesh.vertices.data(), v));
+		maximum = glm::max(maximum, positionOf(mesh.vertices.data(), v));
+	}
+	float radius = 0.5f * glm::length(maximum - minimum);
+
+	// Every level is simplified from the one before, so their errors add up
+	std::vector<unsigned int> previous(mesh.indices.begin(), mesh.indices.end());
+	std::vector<unsigned int> level;
+	float levelError = LOD_BASE_ERROR * radius;
+	float totalError = 0.0f;
+	while (mesh.lods.size() < LOD_MAX_LEVELS && previous.size() / 3 >= LOD_MIN_TRIANGLES * 2) {
+		size_t target = size_t(float(previous.size() / 3) * LOD_REDUCTION) * 3;
+		float error = simplifyMesh(level, previous, mesh.vertices.data(), vertexCount, target, levelError);
+		if (float(level.size()) > float(previous.size()) * (1.0f - LOD_MIN_REDUCTION)) {
+			break;
+		}
+		optimiseVertexCache(level, vertexCount);
+
+		totalError += error;
+		mesh.lods.push_back(MeshLOD{ unsigned(mesh.indices.size()), unsigned(level.size()), totalError });
+		mesh.indices.insert(mesh.indices.end(), level.begin(), level.end());
+		previous.swap(level);
+		levelError *= 2.0f;
+	}
+}
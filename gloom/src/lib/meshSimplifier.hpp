@@ -0,0 +1,21 @@
+#pragma once
+
+#include <vector>
+#include "mesh.hpp"
+
+// Simplifies a triangle list with quadric error metrics (Garland and Heckbert, "Surface
+// Simplification Using Quadric Error Metrics"). Vertices are collapsed onto one of their
+// neighbours, so the result still indexes the original vertex buffer. Vertices on open
+// borders and on attribute seams, i.e. several vertices sharing one position, never move.
+//
+// Collapses the cheapest edges first until destination holds at most targetIndexCount
+// indices, or until the next collapse would move the surface by more than maxError model
+// units. Returns the largest error of the collapses that were made.
+float simplifyMesh(std::vector<unsigned int> &destination, const std::vector<unsigned int> &indices,
+				   const float *vertices, unsigned int vertexCount, size_t targetIndexCount, float maxError);
+
+// Appends progressively simplified copies of the mesh's index buffer to mesh.indices and
+// records every level, including the full mesh, in mesh.lods. Each level has about half
+// the triangles of the one before and a bounded error relative to the mesh size.
+// Has to run after optimiseMesh, which expects the index buffer to hold a single level.
+void buildLODChain(Mesh &mesh);
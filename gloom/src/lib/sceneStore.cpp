@@ -0,0 +1,445 @@
+#include "sceneStore.hpp"
+#include <algorithm>
+#include <stdexcept>
+#include "frustum.hpp"
+
+// Reorders values so that entry i of the result is entry order[i] of the input
+template <typename T>
+static void permute(std::vector<T> &values, const std::vector<unsigned int> &order) {
+	std::vector<T> permuted;
+	permuted.reserve(values.size());
+	for (unsigned int index : order) {
+		permuted.push_back(std::move(values[index]));
+	}
+	values.swap(permuted);
+}
+
+template <typename T>
+static void eraseRange(std::vector<T> &values, unsigned int first, unsigned int end) {
+	values.erase(values.begin() + first, values.begin() + end);
+}
+
+// Generations skip 0, which marks handles that never referred to anything
+static unsigned int nextGeneration(unsigned int generation) {
+	return generation + 1 == 0 ? 1 : generation + 1;
+}
+
+SceneHandle SceneStore::create(SceneHandle parent) {
+	int parentIndex = valid(parent) ? int(denseIndex(parent)) : -1;
+
+	unsigned int slot;
+	if (!mFreeSlots.empty()) {
+		slot = mFreeSlots.back();
+		mFreeSlots.pop_back();
+	} else {
+		slot = unsigned(mSlots.size());
+		mSlots.push_back(Slot{ 0, 0 });
+	}
+	unsigned int dense = unsigned(mParents.size());
+	mSlots[slot].dense = dense;
+	mSlots[slot].generation = nextGeneration(mSlots[slot].generation);
+
+	mSlotOf.push_back(slot);
+	mParents.push_back(parentIndex);
+	mSubtreeEnds.push_back(dense + 1);
+	mPositions.push_back(glm::vec3(0.0f));
+	mRotations.push_back(glm::vec3(0.0f));
+	mReferencePoints.push_back(glm::vec3(0.0f));
+	mWorldMatrices.push_back(glm::mat4(1.0f));
+	mMeshes.push_back(std::shared_ptr<GPUMesh>());
+	mLocalBoundsMin.push_back(glm::vec3(EMPTY_BOUNDS));
+	mLocalBoundsMax.push_back(glm::vec3(-EMPTY_BOUNDS));
+	mWorldBoundsMin.push_back(glm::vec3(EMPTY_BOUNDS));
+	mWorldBoundsMax.push_back(glm::vec3(-EMPTY_BOUNDS));
+	mSubtreeBoundsMin.push_back(glm::vec3(EMPTY_BOUNDS));
+	mSubtreeBoundsMax.push_back(glm::vec3(-EMPTY_BOUNDS));
+	mSubtreeMeshCounts.push_back(0);
+	mDirty.push_back(1);
+	mSubtreeDirty.push_back(1);
+
+	// Appending keeps parents first, but the parent's subtree is no longer contiguous
+	mOrderDirty = true;
+	mStructureVersion++;
+	return SceneHandle(slot, mSlots[slot].generation);
+}
+
+void SceneStore::destroy(SceneHandle node) {
+	if (!valid(node)) {
+		return;
+	}
+	mStructureVersion++;
+	if (mOrderDirty) {
+		restoreOrder();
+	}
+
+	unsigned int first = denseIndex(node);
+	unsigned int end = mSubtreeEnds[first];
+	unsigned int count = end - first;
+	int parent = mParents[first];
+	for (unsigned int i = first; i < end; i++) {
+		Slot &slot = mSlots[mSlotOf[i]];
+		slot.generation = nextGeneration(slot.generation);
+		mFreeSlots.push_back(mSlotOf[i]);
+	}
+
+	eraseRange(mSlotOf, first, end);
+	eraseRange(mParents, first, end);
+	eraseRange(mSubtreeEnds, first, end);
+	eraseRange(mPositions, first, end);
+	eraseRange(mRotations, first, end);
+	eraseRange(mReferencePoints, first, end);
+	eraseRange(mWorldMatrices, first, end);
+	for (unsigned int i = first; i < end; i++) {
+		if (mMeshes[i]) {
+			mReleasedMeshes.push_back(std::move(mMeshes[i]));
+		}
+	}
+	eraseRange(mMeshes, first, end);
+	eraseRange(mLocalBoundsMin, first, end);
+	eraseRange(mLocalBoundsMax, first, end);
+	eraseRange(mWorldBoundsMin, first, end);
+	eraseRange(mWorldBoundsMax, first, end);
+	eraseRange(mSubtreeBoundsMin, first, end);
+	eraseRange(mSubtreeBoundsMax, first, end);
+	eraseRange(mSubtreeMeshCounts, first, end);
+	eraseRange(mDirty, first, end);
+	eraseRange(mSubtreeDirty, first, end);
+
+	// Ancestors end after the removed range and shrink, nodes before it are not affected,
+	// and everything after it moves down. No remaining node has a parent inside the range.
+	for (unsigned int i = 0; i < mParents.size(); i++) {
+		if (mSubtreeEnds[i] >= end) {
+			mSubtreeEnds[i] -= count;
+		}
+		if (mParents[i] >= int(end)) {
+			mParents[i] -= int(count);
+		}
+		if (i >= first) {
+			mSlots[mSlotOf[i]].dense = i;
+		}
+	}
+
+	// The ancestors keep their matrices, but their subtree boxes have to be rebuilt
+	markSubtreeDirty(parent);
+}
+
+bool SceneStore::valid(SceneHandle node) const {
+	return node.generation != 0 && node.slot < mSlots.size() && mSlots[node.slot].generation == node.generation;
+}
+
+unsigned int SceneStore::denseIndex(SceneHandle node) const {
+	if (!valid(node)) {
+		throw std::out_of_range("Stale scene node handle.");
+	}
+	return mSlots[node.slot].dense;
+}
+
+void SceneStore::setPosition(SceneHandle node, const glm::vec3 &position) {
+	glm::vec3 &current = mPositions[denseIndex(node)];
+	if (current != position) {
+		current = position;
+		markNodeDirty(node);
+	}
+}
+
+void SceneStore::setRotation(SceneHandle node, const glm::vec3 &rotation) {
+	glm::vec3 &current = mRotations[denseIndex(node)];
+	if (current != rotation) {
+		current = rotation;
+		markNodeDirty(node);
+	}
+}
+
+void SceneStore::setReferencePoint(SceneHandle node, const glm::vec3 &referencePoint) {
+	glm::vec3 &current = mReferencePoints[denseIndex(node)];
+	if (current != referencePoint) {
+		current = referencePoint;
+		markNodeDirty(node);
+	}
+}
+
+void SceneStore::markNodeDirty(SceneHandle node) {
+	unsigned int index = denseIndex(node);
+	mDirty[index] = 1;
+	markSubtreeDirty(int(index));
+}
+
+void SceneStore::markSubtreeDirty(int index) {
+	// Every ancestor of a flagged node is flagged already, so the walk can stop at the first one
+	while (index >= 0 && !mSubtreeDirty[index]) {
+		mSubtreeDirty[index] = 1;
+		index = mParents[index];
+	}
+}
+
+void SceneStore::setMesh(SceneHandle node, const std::shared_ptr<GPUMesh> &mesh, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax) {
+	if (!valid(node)) {
+		if (mesh) {
+			mReleasedMeshes.push_back(mesh);
+		}
+		return;
+	}
+	unsigned int index = denseIndex(node);
+	if (mMeshes[index] && mMeshes[index] != mesh) {
+		mReleasedMeshes.push_back(std::move(mMeshes[index]));
+	}
+	mMeshes[index] = mesh;
+	mStructureVersion++;
+	mLocalBoundsMin[index] = boundsMin;
+	mLocalBoundsMax[index] = boundsMax;
+	markNodeDirty(node);
+}
+
+void SceneStore::restoreOrder() {
+	unsigned int count = unsigned(mParents.size());
+
+	// Children of every node in creation order, with the roots listed under index count
+	std::vector<unsigned int> childStarts(count + 3, 0);
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int parent = mParents[i] < 0 ? count : unsigned(mParents[i]);
+		childStarts[parent + 2]++;
+	}
+	for (unsigned int i = 2; i < count + 3; i++) {
+		childStarts[i] += childStarts[i - 1];
+	}
+	std::vector<unsigned int> children(count);
+	for (unsigned int i = 0; i < count; i++) {
+		unsigned int parent = mParents[i] < 0 ? count : unsigned(mParents[i]);
+		children[childStarts[parent + 1]++] = i;
+	}
+	// childStarts[p] .. childStarts[p + 1] now holds the children of p
+
+	// Depth first walk, pushing children in reverse so that they come out in order
+	std::vector<unsigned int> order;
+	order.reserve(count);
+	std::vector<unsigned int> stack;
+	for (unsigned int c = childStarts[count + 1]; c > childStarts[count]; c--) {
+		stack.push_back(children[c - 1]);
+	}
+	while (!stack.empty()) {
+		unsigned int node = stack.back();
+		stack.pop_back();
+		order.push_back(node);
+		for (unsigned int c = childStarts[node + 1]; c > childStarts[node]; c--) {
+			stack.push_back(children[c - 1]);
+		}
+	}
+
+	std::vector<unsigned int> newIndex(count);
+	for (unsigned int i = 0; i < count; i++) {
+		newIndex[order[i]] = i;
+	}
+	permute(mSlotOf, order);
+	permute(mParents, order);
+	permute(mPositions, order);
+	permute(mRotations, order);
+	permute(mReferencePoints, order);
+	permute(mWorldMatrices, order);
+	permute(mMeshes, order);
+	permute(mLocalBoundsMin, order);
+	permute(mLocalBoundsMax, order);
+	permute(mWorldBoundsMin, order);
+	permute(mWorldBoundsMax, order);
+	permute(mSubtreeBoundsMin, order);
+	permute(mSubtreeBoundsMax, order);
+	permute(mSubtreeMeshCounts, order);
+
+	for (unsigned int i = 0; i < count; i++) {
+		if (mParents[i] >= 0) {
+			mParents[i] = int(newIndex[mParents[i]]);
+		}
+		mSlots[mSlotOf[i]].dense = i;
+	}
+
+	// Subtree sizes add up from the back, since every child comes after its parent
+	std::vector<unsigned int> sizes(count, 1);
+	for (unsigned int i = count; i-- > 0;) {
+		if (mParents[i] >= 0) {
+			sizes[mParents[i]] += sizes[i];
+		}
+	}
+	for (unsigned int i = 0; i < count; i++) {
+		mSubtreeEnds[i] = i + sizes[i];
+	}
+
+	std::fill(mDirty.begin(), mDirty.end(), 1);
+	std::fill(mSubtreeDirty.begin(), mSubtreeDirty.end(), 1);
+	mOrderDirty = false;
+}
+
+SceneUpdateStats SceneStore::update() {
+	// A single range per root subtree, or as many as fit in one
+	partition(unsigned(mParents.size()));
+	updateSplitNodes();
+	for (size_t range = 0; range < mRanges.size(); range++) {
+		updateRange(range);
+	}
+	return finishUpdate();
+}
+
+void SceneStore::partition(unsigned int grainSize) {
+	if (mOrderDirty) {
+		restoreOrder();
+	}
+
+	mRanges.clear();
+	unsigned int count = unsigned(mParents.size());
+	unsigned int i = 0;
+	while (i < count) {
+		unsigned int end = mSubtreeEnds[i];
+		if (end - i > grainSize) {
+			mRanges.push_back(SceneRange{ i, i + 1, true });
+			i++;
+			continue;
+		}
+		// Subtrees next to each other share a range until it is full. Every node of the range
+		// then has its parent either earlier in the range or among the split nodes.
+		if (!mRanges.empty() && !mRanges.back().split && mRanges.back().end == i && end - mRanges.back().first <= grainSize) {
+			mRanges.back().end = end;
+		} else {
+			mRanges.push_back(SceneRange{ i, end, false });
+		}
+		i = end;
+	}
+
+	mRangeStats.assign(mRanges.size(), SceneUpdateStats{ 0, 0 });
+	if (mRangeScratch.size() < mRanges.size()) {
+		mRangeScratch.resize(mRanges.size());
+	}
+}
+
+void SceneStore::visitNode(unsigned int index, std::vector<unsigned int> &moved) {
+	int parent = mParents[index];
+	// A parent that moved has been marked dirty in this update, which passes on to its children
+	if (parent >= 0 && mDirty[parent]) {
+		mDirty[index] = 1;
+	}
+	if (mDirty[index]) {
+		moved.push_back(index);
+		return;
+	}
+	mSubtreeBoundsMin[index] = mWorldBoundsMin[index];
+	mSubtreeBoundsMax[index] = mWorldBoundsMax[index];
+	mSubtreeMeshCounts[index] = mMeshes[index] ? 1 : 0;
+}
+
+void SceneStore::moveNodes(const std::vector<unsigned int> &moved, std::vector<glm::mat4> &locals) {
+	locals.resize(moved.size());
+	composeLocalTransforms(mPositions.data(), mRotations.data(), mReferencePoints.data(), moved.data(), moved.size(), locals.data());
+
+	// Parents come first, so their world matrices are final by the time their children need them
+	for (size_t k = 0; k < moved.size(); k++) {
+		unsigned int index = moved[k];
+		int parent = mParents[index];
+		mWorldMatrices[index] = parent < 0 ? locals[k] : mWorldMatrices[parent] * locals[k];
+		transformBox(mWorldMatrices[index], mLocalBoundsMin[index], mLocalBoundsMax[index], mWorldBoundsMin[index], mWorldBoundsMax[index]);
+		mSubtreeBoundsMin[index] = mWorldBoundsMin[index];
+		mSubtreeBoundsMax[index] = mWorldBoundsMax[index];
+		mSubtreeMeshCounts[index] = mMeshes[index] ? 1 : 0;
+	}
+}
+
+void SceneStore::mergeIntoParent(unsigned int index) {
+	int parent = mParents[index];
+	if (parent >= 0) {
+		mSubtreeBoundsMin[parent] = glm::min(mSubtreeBoundsMin[parent], mSubtreeBoundsMin[index]);
+		mSubtreeBoundsMax[parent] = glm::max(mSubtreeBoundsMax[parent], mSubtreeBoundsMax[index]);
+		mSubtreeMeshCounts[parent] += mSubtreeMeshCounts[index];
+	}
+}
+
+void SceneStore::updateSplitNodes() {
+	// Split nodes always start their subtree boxes over, there are only a few of them. They
+	// come before their descendants, and their parents are split nodes as well.
+	std::vector<unsigned int> &moved = mSplitScratch.moved;
+	for (size_t range = 0; range < mRanges.size(); range++) {
+		if (mRanges[range].split) {
+			unsigned int node = mRanges[range].first;
+			visitNode(node, moved);
+			mRangeStats[range] = mDirty[node] ? SceneUpdateStats{ 1, 0 } : SceneUpdateStats{ 0, 1 };
+		}
+	}
+	moveNodes(moved, mSplitScratch.locals);
+	moved.clear();
+}
+
+void SceneStore::updateRange(size_t range) {
+	const SceneRange &nodes = mRanges[range];
+	if (nodes.split) {
+		return;
+	}
+	std::vector<unsigned int> &rebuilt = mRangeScratch[range].rebuilt;
+	std::vector<unsigned int> &moved = mRangeScratch[range].moved;
+	int first = int(nodes.first);
+
+	unsigned int i = nodes.first;
+	while (i < nodes.end) {
+		int parent = mParents[i];
+		if (!(parent >= 0 && mDirty[parent]) && !mSubtreeDirty[i]) {
+			// Nothing in here changed, so the whole subtree keeps its matrices and boxes. A
+			// parent within the range is being rebuilt though, or this node would have been
+			// jumped over.
+			if (parent >= first) {
+				rebuilt.push_back(i);
+			}
+			i = mSubtreeEnds[i];
+			continue;
+		}
+		visitNode(i, moved);
+		rebuilt.push_back(i);
+		i++;
+	}
+	// Local transforms do not depend on each other, so they are composed in one batch once
+	// every moved node is known
+	moveNodes(moved, mRangeScratch[range].locals);
+	unsigned int recomputed = unsigned(moved.size());
+	mRangeStats[range] = SceneUpdateStats{ recomputed, nodes.end - nodes.first - recomputed };
+
+	// Children come after their parents, so walking backwards finishes every subtree before
+	// it is merged into its parent. Parents outside the range are left to finishUpdate().
+	for (size_t k = rebuilt.size(); k-- > 0;) {
+		unsigned int node = rebuilt[k];
+		if (mParents[node] >= first) {
+			mergeIntoParent(node);
+		}
+		mDirty[node] = 0;
+		mSubtreeDirty[node] = 0;
+	}
+	rebuilt.clear();
+	moved.clear();
+}
+
+SceneUpdateStats SceneStore::finishUpdate() {
+	SceneUpdateStats stats = { 0, 0 };
+	// Parents of range roots are split nodes in earlier ranges, so going through the ranges
+	// backwards merges every subtree before its parent is merged in turn
+	for (size_t range = mRanges.size(); range-- > 0;) {
+		const SceneRange &nodes = mRanges[range];
+		for (unsigned int root = nodes.first; root < nodes.end; root = mSubtreeEnds[root]) {
+			mergeIntoParent(root);
+		}
+		if (nodes.split) {
+			mDirty[nodes.first] = 0;
+			mSubtreeDirty[nodes.first] = 0;
+		}
+		stats.recomputed += mRangeStats[range].recomputed;
+		stats.skipped += mRangeStats[range].skipped;
+	}
+	return stats;
+}
+
+void SceneStore::snapshot(SceneSnapshot &snapshot) const {
+	snapshot.worldMatrices.assign(mWorldMatrices.begin(), mWorldMatrices.end());
+	snapshot.meshes.resize(mMeshes.size());
+	for (size_t node = 0; node < mMeshes.size(); node++) {
+		snapshot.meshes[node] = mMeshes[node].get();
+	}
+	snapshot.structureVersion = mStructureVersion;
+}
+
+void SceneStore::takeReleasedMeshes(std::vector<std::shared_ptr<GPUMesh>> &released) {
+	for (std::shared_ptr<GPUMesh> &mesh : mReleasedMeshes) {
+		released.push_back(std::move(mesh));
+	}
+	mReleasedMeshes.clear();
+}
@@ -0,0 +1,211 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+#include <memory>
+#include <vector>
+#include "transformKernel.hpp"
+
+// Uploaded mesh shared between nodes, see vao.hpp
+struct GPUMesh;
+
+// Stable reference to a node in a SceneStore. A handle keeps referring to the same node
+// while nodes around it are added, removed or reordered, and is recognised as stale once
+// its node has been destroyed, even after the slot it pointed to has been reused.
+struct SceneHandle {
+	unsigned int slot;
+	// 0 never refers to a node, so a default constructed handle is always stale
+	unsigned int generation;
+
+	SceneHandle() : slot(0), generation(0) { }
+	SceneHandle(unsigned int slot, unsigned int generation) : slot(slot), generation(generation) { }
+
+	bool operator==(const SceneHandle &other) const { return slot == other.slot && generation == other.generation; }
+	bool operator!=(const SceneHandle &other) const { return !(*this == other); }
+};
+
+// Matrices recomputed and matrices reused by one SceneStore::update()
+struct SceneUpdateStats {
+	unsigned int recomputed;
+	unsigned int skipped;
+};
+
+// Nodes [first, end) of a SceneStore, updated together by SceneStore::updateRange
+struct SceneRange {
+	unsigned int first;
+	unsigned int end;
+	// A single node whose subtree was too large for one range and has been split over the
+	// ranges after it. Split nodes are updated by SceneStore::updateSplitNodes.
+	bool split;
+};
+
+// What drawing the nodes of a SceneStore takes, copied out by SceneStore::snapshot() so that
+// one thread can draw it while another goes on updating the scene. The meshes are not owned.
+// They stay valid while the scene keeps them, and once it lets go of them for as long as
+// whoever took them from SceneStore::takeReleasedMeshes() holds on to them.
+struct SceneSnapshot {
+	std::vector<glm::mat4> worldMatrices;
+	std::vector<const GPUMesh *> meshes;
+	unsigned int structureVersion;
+
+	SceneSnapshot() : structureVersion(0) { }
+	size_t nodeCount() const { return meshes.size(); }
+};
+
+// Flat scene graph keeping every node in contiguous structure of arrays storage.
+//
+// Nodes are stored depth first, so parents come before their children and the subtree of
+// the node at index i occupies [i, subtreeEnd(i)). That turns the transform update into a
+// single forward pass over the arrays, and lets a draw walk skip a culled subtree by
+// jumping to its end. Adding or removing nodes marks the order stale; it is restored in
+// O(n) by the next update().
+//
+// Transforms are only written through the setters, which mark the node dirty. Every dirty
+// node also flags its ancestors, so update() skips clean subtrees in one jump and only
+// recomputes the world matrices below dirty nodes. Everything else keeps its cached matrix.
+//
+// The update can be spread over threads. partition() cuts the nodes into ranges of whole
+// subtrees, below a few split nodes at the top of large subtrees. Once the split nodes are
+// up to date the ranges do not share any nodes, so they can be updated in any order or at
+// the same time, with the same results as update().
+//
+// Handles go through a slot table with generation counts, and destroyed nodes give their
+// slot back to a free list. References returned by the accessors are invalidated by
+// create(), destroy() and update().
+class SceneStore {
+public:
+	SceneStore() : mOrderDirty(false), mStructureVersion(0) { }
+
+	SceneStore(const SceneStore &) = delete;
+	SceneStore &operator=(const SceneStore &) = delete;
+
+	// Adds a node at the origin below parent, or a new root if parent is not a valid handle
+	SceneHandle create(SceneHandle parent = SceneHandle());
+	// Removes node together with every node below it
+	void destroy(SceneHandle node);
+	bool valid(SceneHandle node) const;
+
+	// The node's transform relative to its parent, applied as
+	// translate(position) * rotation about referencePoint (see composeLocalTransform)
+	const glm::vec3 &position(SceneHandle node) const { return mPositions[denseIndex(node)]; }
+	const glm::vec3 &rotation(SceneHandle node) const { return mRotations[denseIndex(node)]; }
+	const glm::vec3 &referencePoint(SceneHandle node) const { return mReferencePoints[denseIndex(node)]; }
+	void setPosition(SceneHandle node, const glm::vec3 &position);
+	void setRotation(SceneHandle node, const glm::vec3 &rotation);
+	void setReferencePoint(SceneHandle node, const glm::vec3 &referencePoint);
+
+	// Makes the next update() recompute the world matrices of node and everything below it
+	void markNodeDirty(SceneHandle node);
+
+	// Makes node draw mesh, whose contents lie within boundsMin-boundsMax in model space.
+	// Stale handles are ignored, so loaders may attach meshes to nodes that are gone by then;
+	// the mesh is released as if the node had dropped it.
+	void setMesh(SceneHandle node, const std::shared_ptr<GPUMesh> &mesh, const glm::vec3 &boundsMin, const glm::vec3 &boundsMax);
+
+	// As of the last update()
+	const glm::mat4 &worldMatrix(SceneHandle node) const { return mWorldMatrices[denseIndex(node)]; }
+
+	// Restores depth first order if nodes were added or removed, then recomputes the world
+	// matrices and boxes of dirty subtrees, and the subtree boxes of their ancestors
+	SceneUpdateStats update();
+
+	// The steps of update(), for spreading it over threads. partition() restores the order
+	// and cuts the nodes into ranges of at most grainSize nodes, not counting split nodes.
+	// After updateSplitNodes(), updateRange() may run for every range that is not split, in
+	// any order and at the same time. finishUpdate() completes the subtree boxes. Nodes
+	// must not be added, removed or moved until then.
+	void partition(unsigned int grainSize);
+	const std::vector<SceneRange> &ranges() const { return mRanges; }
+	void updateSplitNodes();
+	void updateRange(size_t range);
+	SceneUpdateStats finishUpdate();
+
+	// Per node arrays in depth first order, valid after update()
+	size_t nodeCount() const { return mParents.size(); }
+	const std::vector<glm::mat4> &worldMatrices() const { return mWorldMatrices; }
+	const std::vector<std::shared_ptr<GPUMesh>> &meshes() const { return mMeshes; }
+	const std::vector<glm::vec3> &worldBoundsMin() const { return mWorldBoundsMin; }
+	const std::vector<glm::vec3> &worldBoundsMax() const { return mWorldBoundsMax; }
+	// Boxes around each node and all of its descendants, in world space
+	const std::vector<glm::vec3> &subtreeBoundsMin() const { return mSubtreeBoundsMin; }
+	const std::vector<glm::vec3> &subtreeBoundsMax() const { return mSubtreeBoundsMax; }
+	// One past the last node of each node's subtree
+	const std::vector<unsigned int> &subtreeEnds() const { return mSubtreeEnds; }
+	// Nodes with a mesh in each node's subtree, including itself
+	const std::vector<unsigned int> &subtreeMeshCounts() const { return mSubtreeMeshCounts; }
+	// Changes whenever nodes are added or removed, which moves them to other indices, or a
+	// node is given another mesh. Data kept per node index elsewhere is stale once it does.
+	unsigned int structureVersion() const { return mStructureVersion; }
+	// Copies the world matrices, meshes and structure version into snapshot, reusing its
+	// allocations. Valid after update(), like the arrays it copies.
+	void snapshot(SceneSnapshot &snapshot) const;
+
+	// Appends the meshes setMesh() replaced or turned away and destroy() removed since the
+	// last call to released. A GPUMesh has to be dropped on the GL thread, so the scene holds
+	// on to them until then, which lets it be updated on another thread.
+	void takeReleasedMeshes(std::vector<std::shared_ptr<GPUMesh>> &released);
+
+private:
+	struct Slot {
+		unsigned int dense;
+		unsigned int generation;
+	};
+
+	// Throws std::out_of_range for stale handles
+	unsigned int denseIndex(SceneHandle node) const;
+	// Sorts the arrays depth first, keeping siblings in the order they were created.
+	// Marks every node dirty, since all cached subtree data refers to the old order.
+	void restoreOrder();
+	// Flags index and its ancestors as holding dirty nodes
+	void markSubtreeDirty(int index);
+	// Queues a node whose parent is up to date in moved if it or its parent moved, and
+	// otherwise starts its subtree boxes over from its own box
+	void visitNode(unsigned int index, std::vector<unsigned int> &moved);
+	// Recomputes the world matrices and boxes of moved, which is in depth first order, and
+	// starts their subtree boxes over. Local transforms are composed in batches into locals.
+	void moveNodes(const std::vector<unsigned int> &moved, std::vector<glm::mat4> &locals);
+	// Merges the subtree box of index into that of its parent
+	void mergeIntoParent(unsigned int index);
+
+	std::vector<Slot> mSlots;
+	std::vector<unsigned int> mFreeSlots;
+	bool mOrderDirty;
+	unsigned int mStructureVersion;
+
+	// Structure of arrays, one entry per node
+	std::vector<unsigned int> mSlotOf;
+	std::vector<int> mParents;
+	std::vector<unsigned int> mSubtreeEnds;
+	std::vector<glm::vec3> mPositions;
+	std::vector<glm::vec3> mRotations;
+	std::vector<glm::vec3> mReferencePoints;
+	std::vector<glm::mat4> mWorldMatrices;
+	std::vector<std::shared_ptr<GPUMesh>> mMeshes;
+	// Meshes dropped since the last takeReleasedMeshes()
+	std::vector<std::shared_ptr<GPUMesh>> mReleasedMeshes;
+	std::vector<glm::vec3> mLocalBoundsMin;
+	std::vector<glm::vec3> mLocalBoundsMax;
+	std::vector<glm::vec3> mWorldBoundsMin;
+	std::vector<glm::vec3> mWorldBoundsMax;
+	std::vector<glm::vec3> mSubtreeBoundsMin;
+	std::vector<glm::vec3> mSubtreeBoundsMax;
+	std::vector<unsigned int> mSubtreeMeshCounts;
+	// Whether the node's local transform or mesh changed since the last update
+	std::vector<unsigned char> mDirty;
+	// Whether the node or any of its descendants is dirty
+	std::vector<unsigned char> mSubtreeDirty;
+	// Working memory of an update of one range, kept between updates to reuse the allocations
+	struct RangeScratch {
+		// Nodes whose subtree boxes have to be merged into their parents, in depth first order
+		std::vector<unsigned int> rebuilt;
+		// Nodes whose matrices are recomputed, and their local transforms
+		std::vector<unsigned int> moved;
+		std::vector<glm::mat4> locals;
+	};
+
+	// The last partition, with what updateSplitNodes() and updateRange() did for each range
+	std::vector<SceneRange> mRanges;
+	std::vector<SceneUpdateStats> mRangeStats;
+	std::vector<RangeScratch> mRangeScratch;
+	RangeScratch mSplitScratch;
+};
@@ -0,0 +1,112 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <stdexcept>
+#include <thread>
+#include <vector>
+
+// Times a waiting thread yields before it starts napping, and how long each nap lasts
+#define SPSC_WAIT_YIELDS 64
+#define SPSC_WAIT_NAP_MICROSECONDS 100
+
+// Bounded queue passing elements from one producer thread to one consumer thread without
+// locks.
+//
+// Elements live in a ring of slots that is allocated once, and are filled and read in place,
+// so whatever they own is reused instead of reallocated. The producer claims the next free
+// slot with beginPush(), fills it, and publishes it with push(); the consumer reads the
+// oldest published slot through front() and hands it back with pop(). Each side only ever
+// writes its own index, and the release store of that index is what makes the slot
+// contents visible to the other side.
+//
+// waitToPush() and waitForFront() block by yielding, then napping, until a slot turns up,
+// so neither side takes a lock even while it waits. Both return nullptr once the queue is
+// closed, which either side may do to make the other stop.
+template<typename T>
+class SPSCQueue {
+public:
+	// Throws std::runtime_error for a capacity of 0
+	explicit SPSCQueue(size_t capacity) : mSlots(capacity), mClosed(false), mHead(0), mTail(0) {
+		if (capacity == 0) {
+			throw std::runtime_error("An SPSC queue needs room for at least one element.");
+		}
+	}
+
+	SPSCQueue(const SPSCQueue &) = delete;
+	SPSCQueue &operator=(const SPSCQueue &) = delete;
+
+	size_t capacity() const { return mSlots.size(); }
+
+	// Producer: the slot to fill next, or nullptr if every slot is taken
+	T *beginPush() {
+		size_t tail = mTail.load(std::memory_order_relaxed);
+		if (tail - mHead.load(std::memory_order_acquire) == mSlots.size()) {
+			return nullptr;
+		}
+		return &mSlots[tail % mSlots.size()];
+	}
+	// Producer: publishes the slot beginPush() returned
+	void push() {
+		mTail.store(mTail.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	// Producer: waits for a free slot, or returns nullptr once the queue is closed
+	T *waitToPush() {
+		unsigned int attempts = 0;
+		while (!closed()) {
+			T *slot = beginPush();
+			if (slot != nullptr) {
+				return slot;
+			}
+			backOff(attempts);
+		}
+		return nullptr;
+	}
+
+	// Consumer: the oldest published slot, or nullptr if there is none
+	T *front() {
+		size_t head = mHead.load(std::memory_order_relaxed);
+		if (head == mTail.load(std::memory_order_acquire)) {
+			return nullptr;
+		}
+		return &mSlots[head % mSlots.size()];
+	}
+	// Consumer: hands the slot front() returned back to the producer
+	void pop() {
+		mHead.store(mHead.load(std::memory_order_relaxed) + 1, std::memory_order_release);
+	}
+	// Consumer: waits for a published slot, or returns nullptr once the queue is closed
+	T *waitForFront() {
+		unsigned int attempts = 0;
+		while (!closed()) {
+			T *slot = front();
+			if (slot != nullptr) {
+				return slot;
+			}
+			backOff(attempts);
+		}
+		return nullptr;
+	}
+
+	// Makes every wait return nullptr from now on
+	void close() { mClosed.store(true, std::memory_order_release); }
+	bool closed() const { return mClosed.load(std::memory_order_acquire); }
+
+private:
+	static void backOff(unsigned int &attempts) {
+		if (attempts < SPSC_WAIT_YIELDS) {
+			attempts++;
+			std::this_thread::yield();
+		} else {
+			std::this_thread::sleep_for(std::chrono::microseconds(SPSC_WAIT_NAP_MICROSECONDS));
+		}
+	}
+
+	std::vector<T> mSlots;
+	std::atomic<bool> mClosed;
+	// Slots read and slots written so far. On separate cache lines, since each is written by
+	// a different thread.
+	alignas(64) std::atomic<size_t> mHead;
+	alignas(64) std::atomic<size_t> mTail;
+};
@@ -0,0 +1,192 @@
+#include "taskScheduler.hpp"
+#include <algorithm>
+#include <stdexcept>
+
+TaskGraph::Task TaskGraph::add(std::function<void()> work) {
+	// Nodes past mTaskCount are left over from before clear(), reusing their successor lists
+	if (mTaskCount == mTasks.size()) {
+		mTasks.push_back(Node());
+	}
+	Node &node = mTasks[mTaskCount];
+	node.work = std::move(work);
+	node.successors.clear();
+	node.predecessors = 0;
+	return mTaskCount++;
+}
+
+void TaskGraph::precede(Task before, Task after) {
+	mTasks[before].successors.push_back(after);
+	mTasks[after].predecessors++;
+}
+
+size_t TaskGraph::addBatches(size_t count, size_t batchSize, std::function<void(size_t, size_t)> work,
+							 Task after, Task before) {
+	batchSize = std::max<size_t>(batchSize, 1);
+	size_t batches = 0;
+	for (size_t begin = 0; begin < count; begin += batchSize) {
+		size_t end = std::min(begin + batchSize, count);
+		Task batch = add([work, begin, end]() { work(begin, end); });
+		precede(after, batch);
+		precede(batch, before);
+		batches++;
+	}
+	if (batches == 0) {
+		precede(after, before);
+	}
+	return batches;
+}
+
+void TaskGraph::clear() {
+	for (size_t i = 0; i < mTaskCount; i++) {
+		mTasks[i].work = nullptr;
+	}
+	mTaskCount = 0;
+}
+
+TaskScheduler::TaskScheduler(unsigned int workerCount)
+	: mStopping(false), mGraph(nullptr), mWaitingOnCapacity(0), mUnfinished(0), mQueued(0), mFailed(false) {
+	if (workerCount == 0) {
+		unsigned int hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 0;
+	}
+	for (unsigned int i = 0; i <= workerCount; i++) {
+		mQueues.emplace_back(new Queue());
+	}
+	for (unsigned int i = 1; i <= workerCount; i++) {
+		mWorkers.emplace_back(&TaskScheduler::workerLoop, this, i);
+	}
+}
+
+TaskScheduler::~TaskScheduler() {
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStopping = true;
+	}
+	mWake.notify_all();
+	for (std::thread &worker : mWorkers) {
+		worker.join();
+	}
+}
+
+void TaskScheduler::run(TaskGraph &graph) {
+	size_t count = graph.mTaskCount;
+	if (count == 0) {
+		return;
+	}
+	if (count > mWaitingOnCapacity) {
+		mWaitingOn.reset(new std::atomic<unsigned int>[count]);
+		mWaitingOnCapacity = count;
+	}
+	for (size_t i = 0; i < count; i++) {
+		mWaitingOn[i].store(graph.mTasks[i].predecessors, std::memory_order_relaxed);
+	}
+	mGraph = &graph;
+	mFailed = false;
+	mError = nullptr;
+	mUnfinished = count;
+
+	bool started = false;
+	for (size_t i = 0; i < count; i++) {
+		if (graph.mTasks[i].predecessors == 0) {
+			push(0, i);
+			started = true;
+		}
+	}
+	if (!started) {
+		mGraph = nullptr;
+		throw std::runtime_error("Task graph has a cycle, no task can start.");
+	}
+
+	while (mUnfinished.load() != 0) {
+		if (!runOne(0)) {
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]() { return mUnfinished.load() == 0 || mQueued.load() != 0; });
+		}
+	}
+	mGraph = nullptr;
+
+	if (mError) {
+		std::exception_ptr error = mError;
+		mError = nullptr;
+		std::rethrow_exception(error);
+	}
+}
+
+void TaskScheduler::workerLoop(unsigned int thread) {
+	while (true) {
+		if (runOne(thread)) {
+			continue;
+		}
+		std::unique_lock<std::mutex> lock(mMutex);
+		mWake.wait(lock, [this]() { return mStopping || mQueued.load() != 0; });
+		if (mStopping) {
+			return;
+		}
+	}
+}
+
+bool TaskScheduler::runOne(unsigned int thread) {
+	size_t queueCount = mQueues.size();
+	for (size_t offset = 0; offset < queueCount; offset++) {
+		Queue &queue = *mQueues[(thread + offset) % queueCount];
+		TaskGraph::Task task;
+		{
+			std::lock_guard<std::mutex> lock(queue.mutex);
+			if (queue.tasks.empty()) {
+				continue;
+			}
+			// Newest of our own tasks, oldest of anyone else's
+			if (offset == 0) {
+				task = queue.tasks.back();
+				queue.tasks.pop_back();
+			} else {
+				task = queue.tasks.front();
+				queue.tasks.pop_front();
+			}
+		}
+		mQueued--;
+		execute(task, thread);
+		return true;
+	}
+	return false;
+}
+
+void TaskScheduler::execute(TaskGraph::Task task, unsigned int thread) {
+	TaskGraph::Node &node = mGraph->mTasks[task];
+	if (!mFailed.load()) {
+		try {
+			node.work();
+		} catch (...) {
+			std::lock_guard<std::mutex> lock(mMutex);
+			if (!mError) {
+				mError = std::current_exception();
+			}
+			mFailed = true;
+		}
+	}
+
+	// Successors are queued before this task counts as finished, so run() cannot return early
+	for (TaskGraph::Task successor : node.successors) {
+		if (mWaitingOn[successor].fetch_sub(1) == 1) {
+			push(thread, successor);
+		}
+	}
+	if (mUnfinished.fetch_sub(1) == 1) {
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWake.notify_all();
+	}
+}
+
+void TaskScheduler::push(unsigned int thread, TaskGraph::Task task) {
+	// Counted first, so that mQueued never drops below the number of queued tasks
+	mQueued++;
+	{
+		std::lock_guard<std::mutex> lock(mQueues[thread]->mutex);
+		mQueues[thread]->tasks.push_back(task);
+	}
+	if (mQueues.size() > 1) {
+		// Taking the lock makes sure a thread about to sleep sees the task first
+		std::lock_guard<std::mutex> lock(mMutex);
+		mWake.notify_all();
+	}
+}
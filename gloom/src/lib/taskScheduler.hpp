@@ -0,0 +1,101 @@
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Tasks and the order they have to run in, run by a TaskScheduler. Tasks that do not depend
+// on each other may run at the same time, so they must not write to the same data.
+class TaskGraph {
+public:
+	typedef size_t Task;
+
+	TaskGraph() : mTaskCount(0) { }
+
+	// Adds a task running work once every task preceding it has finished
+	Task add(std::function<void()> work);
+	// Makes after wait for before
+	void precede(Task before, Task after);
+	// Adds a task per batchSize indices in [0, count), running work(begin, end) for its
+	// batch, and makes each of them follow after and precede before. Returns the batch count.
+	size_t addBatches(size_t count, size_t batchSize, std::function<void(size_t, size_t)> work,
+					  Task after, Task before);
+
+	// Removes every task, keeping the allocations for the next frame
+	void clear();
+	size_t size() const { return mTaskCount; }
+
+private:
+	friend class TaskScheduler;
+
+	struct Node {
+		std::function<void()> work;
+		std::vector<Task> successors;
+		unsigned int predecessors;
+	};
+
+	// Only the first mTaskCount nodes are in use
+	std::vector<Node> mTasks;
+	size_t mTaskCount;
+};
+
+// Runs task graphs on a fixed set of worker threads with work stealing.
+//
+// Every thread has its own queue. A task that finishes pushes the tasks it unblocked onto
+// the queue of the thread that ran it, which works through its queue newest first to keep
+// caches warm, while idle threads steal the oldest tasks of the other queues. The thread
+// calling run() joins in until the graph is done, so with no workers everything runs there.
+class TaskScheduler {
+public:
+	// Starts workerCount threads besides the one calling run(), 0 starts one per hardware
+	// thread beyond the first
+	explicit TaskScheduler(unsigned int workerCount);
+	~TaskScheduler();
+
+	TaskScheduler(const TaskScheduler &) = delete;
+	TaskScheduler &operator=(const TaskScheduler &) = delete;
+
+	// Threads running tasks, including the one calling run()
+	unsigned int threadCount() const { return unsigned(mQueues.size()); }
+
+	// Runs every task of graph, each once all of its predecessors have finished, and returns
+	// when they all have. Rethrows the first exception thrown by a task; tasks that had not
+	// started by then are skipped. Must not be called from a task.
+	void run(TaskGraph &graph);
+
+private:
+	struct Queue {
+		std::mutex mutex;
+		std::deque<TaskGraph::Task> tasks;
+	};
+
+	void workerLoop(unsigned int thread);
+	// Runs a task from the queue of thread, or stolen from another one. Returns false if
+	// every queue was empty.
+	bool runOne(unsigned int thread);
+	void execute(TaskGraph::Task task, unsigned int thread);
+	void push(unsigned int thread, TaskGraph::Task task);
+
+	// The queue of the thread calling run() comes first
+	std::vector<std::unique_ptr<Queue>> mQueues;
+	std::vector<std::thread> mWorkers;
+
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mStopping;
+
+	// State of the graph being run
+	TaskGraph *mGraph;
+	std::unique_ptr<std::atomic<unsigned int>[]> mWaitingOn;
+	size_t mWaitingOnCapacity;
+	std::atomic<size_t> mUnfinished;
+	std::atomic<size_t> mQueued;
+	std::atomic<bool> mFailed;
+	std::exception_ptr mError;
+};
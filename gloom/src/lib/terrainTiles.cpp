@@ -0,0 +1,130 @@
+#include "terrainTiles.hpp"
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <sstream>
+#include "OBJLoader.hpp"
+#include "meshOptimiser.hpp"
+#include "meshSimplifier.hpp"
+
+// Grid cell holding a coordinate, clamped so that the maximum lands in the last cell
+static unsigned int tileCoordinate(float value, float minimum, float tileSize, unsigned int tilesPerSide) {
+	if (tileSize <= 0.0f) {
+		return 0;
+	}
+	int cell = int((value - minimum) / tileSize);
+	return unsigned(std::min(std::max(cell, 0), int(tilesPerSide) - 1));
+}
+
+std::vector<Mesh> splitIntoTiles(const Mesh &mesh, unsigned int tilesPerSide) {
+	tilesPerSide = std::max(tilesPerSide, 1u);
+	size_t tileCount = size_t(tilesPerSide) * tilesPerSide;
+	unsigned int vertexCount = mesh.vertexCount();
+	size_t triangleCount = mesh.indices.size() / 3;
+	bool hasColours = mesh.colours.size() == size_t(vertexCount) * 4;
+
+	float3 boundsMin;
+	float3 boundsMax;
+	computeBounds(mesh.vertices.data(), vertexCount, boundsMin, boundsMax);
+	float tileSizeX = (boundsMax.x - boundsMin.x) / float(tilesPerSide);
+	float tileSizeZ = (boundsMax.z - boundsMin.z) / float(tilesPerSide);
+
+	// Bucket the triangles by tile, keeping their original order within each tile
+	std::vector<unsigned int> triangleTiles(triangleCount);
+	std::vector<size_t> tileStarts(tileCount + 1, 0);
+	for (size_t t = 0; t < triangleCount; t++) {
+		float centroidX = 0.0f;
+		float centroidZ = 0.0f;
+		for (unsigned int corner = 0; corner < 3; corner++) {
+			unsigned int vertex = mesh.indices[t * 3 + corner];
+			centroidX += mesh.vertices[size_t(vertex) * 3 + 0];
+			centroidZ += mesh.vertices[size_t(vertex) * 3 + 2];
+		}
+		unsigned int x = tileCoordinate(centroidX / 3.0f, boundsMin.x, tileSizeX, tilesPerSide);
+		unsigned int z = tileCoordinate(centroidZ / 3.0f, boundsMin.z, tileSizeZ, tilesPerSide);
+		triangleTiles[t] = z * tilesPerSide + x;
+		tileStarts[triangleTiles[t] + 1]++;
+	}
+	for (size_t tile = 0; tile < tileCount; tile++) {
+		tileStarts[tile + 1] += tileStarts[tile];
+	}
+	std::vector<unsigned int> tileTriangles(triangleCount);
+	std::vector<size_t> cursors(tileStarts.begin(), tileStarts.end() - 1);
+	for (size_t t = 0; t < triangleCount; t++) {
+		tileTriangles[cursors[triangleTiles[t]]++] = unsigned(t);
+	}
+	std::vector<unsigned int>().swap(triangleTiles);
+
+	// remap only holds valid entries for vertices whose owner is the tile being built
+	std::vector<unsigned int> remap(vertexCount);
+	std::vector<unsigned int> owner(vertexCount, ~0u);
+	std::vector<Mesh> tiles;
+	tiles.reserve(tileCount);
+	for (unsigned int z = 0; z < tilesPerSide; z++) {
+		for (unsigned int x = 0; x < tilesPerSide; x++) {
+			unsigned int tileIndex = z * tilesPerSide + x;
+			std::ostringstream name;
+			name << "tile_" << x << "_" << z;
+			tiles.emplace_back(name.str());
+			Mesh &tile = tiles.back();
+
+			tile.indices.reserve((tileStarts[tileIndex + 1] - tileStarts[tileIndex]) * 3);
+			for (size_t i = tileStarts[tileIndex]; i < tileStarts[tileIndex + 1]; i++) {
+				size_t t = tileTriangles[i];
+				for (unsigned int corner = 0; corner < 3; corner++) {
+					unsigned int vertex = mesh.indices[t * 3 + corner];
+					if (owner[vertex] != tileIndex) {
+						owner[vertex] = tileIndex;
+						remap[vertex] = tile.vertexCount();
+						tile.vertices.insert(tile.vertices.end(), &mesh.vertices[size_t(vertex) * 3], &mesh.vertices[size_t(vertex) * 3] + 3);
+						tile.normals.insert(tile.normals.end(), &mesh.normals[size_t(vertex) * 3], &mesh.normals[size_t(vertex) * 3] + 3);
+						if (hasColours) {
+							tile.colours.insert(tile.colours.end(), &mesh.colours[size_t(vertex) * 4], &mesh.colours[size_t(vertex) * 4] + 4);
+						}
+					}
+					tile.indices.push_back(remap[vertex]);
+				}
+			}
+		}
+	}
+
+	return tiles;
+}
+
+// Writes tiles to cachePath and maps it, or keeps them in memory if that is not possible
+static void storeTiles(MeshCache &cache, std::string const &cachePath, std::string const &srcFile, std::vector<Mesh> &&tiles) {
+	std::vector<const Mesh *> pointers;
+	for (const Mesh &tile : tiles) {
+		pointers.push_back(&tile);
+	}
+
+	if (!MeshCache::write(cachePath, srcFile, pointers) || !cache.open(cachePath, srcFile)) {
+		std::cout << "[WARNING] could not write tile cache '" << cachePath << "', keeping tiles in memory" << std::endl;
+		cache.assign(std::move(tiles));
+	}
+}
+
+void openTerrainTileCache(MeshCache &cache, std::string const srcFile, unsigned int tilesPerSide, unsigned int workerCount) {
+	std::chrono::steady_clock::time_point startTime = std::chrono::steady_clock::now();
+	std::string cachePath = srcFile + TERRAIN_TILE_CACHE_EXTENSION;
+	size_t tileCount = size_t(std::max(tilesPerSide, 1u)) * std::max(tilesPerSide, 1u);
+
+	if (!cache.open(cachePath, srcFile) || cache.meshes().size() != tileCount) {
+		std::vector<Mesh> tiles;
+		{
+			// The whole terrain only has to fit in memory this once, while the cache is built
+			Mesh terrain = loadTerrainMesh(srcFile, workerCount, false);
+			tiles = splitIntoTiles(terrain, tilesPerSide);
+		}
+		for (Mesh &tile : tiles) {
+			if (!tile.indices.empty()) {
+				optimiseMesh(tile, true);
+				buildLODChain(tile);
+			}
+		}
+		storeTiles(cache, cachePath, srcFile, std::move(tiles));
+	}
+
+	double milliseconds = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - startTime).count();
+	std::cout << "[INFO] opened " << cache.meshes().size() << " terrain tiles of " << srcFile << " in " << milliseconds << " ms" << std::endl;
+}
@@ -0,0 +1,23 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "mesh.hpp"
+#include "meshCache.hpp"
+
+// Appended to the OBJ file name to get the name of its tile cache file
+#define TERRAIN_TILE_CACHE_EXTENSION ".tiles" MESH_CACHE_EXTENSION
+
+// Splits mesh into tilesPerSide by tilesPerSide tiles on a regular grid over its XZ bounds.
+// Every triangle goes to the tile holding its centroid, and every tile gets its own copy of
+// the vertices it uses. Tiles are ordered row by row along X, named "tile_<x>_<z>", and
+// tiles without triangles are kept as empty meshes so that the grid stays complete.
+std::vector<Mesh> splitIntoTiles(const Mesh &mesh, unsigned int tilesPerSide);
+
+// Maps the tile cache of srcFile into cache, with one mesh per tile in the order of
+// splitIntoTiles. If the cache is missing, stale or was built with a different grid, the
+// terrain is loaded once, split, and every tile is optimised and given its own levels of
+// detail before the cache is written. Tile edges are open borders to the simplifier, so
+// neighbouring tiles still meet at every level of detail.
+void openTerrainTileCache(MeshCache &cache, std::string const srcFile, unsigned int tilesPerSide,
+						  unsigned int workerCount = 0);
@@ -4,6 +4,15 @@
 #include "toolbox.hpp"
 #include <glm/gtx/transform.hpp>
 
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#include <psapi.h>
+#else
+#include <sys/resource.h>
+#endif
+
 // The standard library's random number generator needs to be seeded in order to produce
 // different results every time the program is run. This should only happen once, so
 // we keep track here with a global variable whether this has happened previously.
@@ -40,30 +49,23 @@ double getTimeDeltaSeconds() {
     return timeDeltaSeconds;
 }
 
-Heading simpleHeadingAnimation(double time) {
-    // Constants
-    const float step = 0.05;
-    const float pathSize = 15;
-    const float circuitSpeed = 0.8f;
-
-    // Compute finite difference to approximate tangent for heading direction
-    float xpos = pathSize*sin(2*time*circuitSpeed);
-    float nextxpos = pathSize*sin(2*(time+step)*circuitSpeed);
-    float zpos = 3*pathSize*cos(time*circuitSpeed);
-    float nextzpos = 3*pathSize*cos((time+step)*circuitSpeed);
-    glm::vec2 dpos = glm::vec2(nextxpos-xpos, nextzpos-zpos);
-
-    double angle = glm::pi<double>() + atan2(dpos.x, dpos.y);
-
-    double rollAngle = cos(time*circuitSpeed);
-
-    Heading heading = Heading();
-
-    heading.x = xpos;
-    heading.z = zpos;
-    heading.yaw = angle;
-    heading.pitch = glm::radians(-10.0 * glm::length(dpos));
-    heading.roll = glm::radians(rollAngle * 30.0);
-
-    return heading;
+size_t peakResidentBytes() {
+#ifdef _WIN32
+    PROCESS_MEMORY_COUNTERS counters;
+    if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+        return 0;
+    }
+    return counters.PeakWorkingSetSize;
+#else
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#ifdef __APPLE__
+    // macOS reports bytes, Linux kilobytes
+    return static_cast<size_t>(usage.ru_maxrss);
+#else
+    return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include <cstddef>
 #include <glm/mat4x4.hpp>
 #include "mesh.hpp"
 
@@ -12,13 +13,6 @@ float randomUniformFloat();
 // Return the amount of time elapsed since the LAST TIME this function was called, in seconds.
 double getTimeDeltaSeconds();
 
-struct Heading {
-    float x;
-    float z;
-    float yaw;
-    float pitch;
-    float roll;
-};
-
-// Returns a Heading animated by incrementing the time argument
-Heading simpleHeadingAnimation(double time);
+// Returns the largest amount of memory this process has had resident so far, in bytes.
+// Returns 0 where the operating system does not report it.
+size_t peakResidentBytes();
@@ -0,0 +1,161 @@
+#include "transformKernel.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <vector>
+#include <glm/gtx/transform.hpp>
+#include "kernelLanes.hpp"
+#include "toolbox.hpp"
+
+// Inputs and outputs of one batch, one row of TRANSFORM_KERNEL_WIDTH lanes per value
+struct TransformBatch {
+	enum { PositionX, PositionY, PositionZ, AngleX, AngleY, AngleZ, ReferenceX, ReferenceY, ReferenceZ, InputCount };
+	alignas(32) float inputs[InputCount][TRANSFORM_KERNEL_WIDTH];
+	// Rotation rows, then the translation
+	alignas(32) float rotation[3][3][TRANSFORM_KERNEL_WIDTH];
+	alignas(32) float translation[3][TRANSFORM_KERNEL_WIDTH];
+};
+
+// For Ry(a) about Y, Rx(b) about X and Rz(c) about Z, R = Rz(c) Rx(b) Ry(a) is
+//   [ cc ca - sc sb sa   -sc cb   cc sa + sc sb ca ]
+//   [ sc ca + cc sb sa    cc cb   sc sa - cc sb ca ]
+//   [ -cb sa              sb      cb ca            ]
+// and the whole transform is R about the reference point r, then moved by p, so its
+// translation is p + r - R r
+static void composeBatch(TransformBatch &batch) {
+	Lanes sa, ca, sb, cb, sc, cc;
+	sinCos(load(batch.inputs[TransformBatch::AngleX]), sa, ca);
+	sinCos(load(batch.inputs[TransformBatch::AngleY]), sb, cb);
+	sinCos(load(batch.inputs[TransformBatch::AngleZ]), sc, cc);
+
+	Lanes sbsa = mul(sb, sa);
+	Lanes sbca = mul(sb, ca);
+	Lanes rotation[3][3];
+	rotation[0][0] = sub(mul(cc, ca), mul(sc, sbsa));
+	rotation[0][1] = sub(broadcast(0.0f), mul(sc, cb));
+	rotation[0][2] = add(mul(cc, sa), mul(sc, sbca));
+	rotation[1][0] = add(mul(sc, ca), mul(cc, sbsa));
+	rotation[1][1] = mul(cc, cb);
+	rotation[1][2] = sub(mul(sc, sa), mul(cc, sbca));
+	rotation[2][0] = sub(broadcast(0.0f), mul(cb, sa));
+	rotation[2][1] = sb;
+	rotation[2][2] = mul(cb, ca);
+
+	Lanes reference[3] = { load(batch.inputs[TransformBatch::ReferenceX]), load(batch.inputs[TransformBatch::ReferenceY]),
+						   load(batch.inputs[TransformBatch::ReferenceZ]) };
+	for (int row = 0; row < 3; row++) {
+		Lanes rotated = add(add(mul(rotation[row][0], reference[0]), mul(rotation[row][1], reference[1])),
+							mul(rotation[row][2], reference[2]));
+		Lanes position = load(batch.inputs[TransformBatch::PositionX + row]);
+		store(batch.translation[row], add(position, sub(reference[row], rotated)));
+		for (int column = 0; column < 3; column++) {
+			store(batch.rotation[row][column], rotation[row][column]);
+		}
+	}
+}
+
+// Moves one node between the scene's arrays and lane lane of batch
+static void gatherLane(TransformBatch &batch, size_t lane, const glm::vec3 &position, const glm::vec3 &rotation,
+					   const glm::vec3 &referencePoint) {
+	batch.inputs[TransformBatch::PositionX][lane] = position.x;
+	batch.inputs[TransformBatch::PositionY][lane] = position.y;
+	batch.inputs[TransformBatch::PositionZ][lane] = position.z;
+	batch.inputs[TransformBatch::AngleX][lane] = reduceAngle(rotation.x);
+	batch.inputs[TransformBatch::AngleY][lane] = reduceAngle(rotation.y);
+	batch.inputs[TransformBatch::AngleZ][lane] = reduceAngle(rotation.z);
+	batch.inputs[TransformBatch::ReferenceX][lane] = referencePoint.x;
+	batch.inputs[TransformBatch::ReferenceY][lane] = referencePoint.y;
+	batch.inputs[TransformBatch::ReferenceZ][lane] = referencePoint.z;
+}
+
+static void scatterLane(const TransformBatch &batch, size_t lane, glm::mat4 &matrix) {
+	// glm matrices are column major
+	matrix[0] = glm::vec4(batch.rotation[0][0][lane], batch.rotation[1][0][lane], batch.rotation[2][0][lane], 0.0f);
+	matrix[1] = glm::vec4(batch.rotation[0][1][lane], batch.rotation[1][1][lane], batch.rotation[2][1][lane], 0.0f);
+	matrix[2] = glm::vec4(batch.rotation[0][2][lane], batch.rotation[1][2][lane], batch.rotation[2][2][lane], 0.0f);
+	matrix[3] = glm::vec4(batch.translation[0][lane], batch.translation[1][lane], batch.translation[2][lane], 1.0f);
+}
+
+void composeLocalTransforms(const glm::vec3 *positions, const glm::vec3 *rotations, const glm::vec3 *referencePoints,
+							const unsigned int *indices, size_t count, glm::mat4 *out) {
+	TransformBatch batch;
+	for (size_t first = 0; first < count; first += TRANSFORM_KERNEL_WIDTH) {
+		size_t lanes = std::min<size_t>(TRANSFORM_KERNEL_WIDTH, count - first);
+		// A short last batch repeats its last node in the unused lanes
+		for (size_t lane = 0; lane < TRANSFORM_KERNEL_WIDTH; lane++) {
+			size_t i = first + std::min(lane, lanes - 1);
+			size_t node = indices != nullptr ? indices[i] : i;
+			gatherLane(batch, lane, positions[node], rotations[node], referencePoints[node]);
+		}
+
+		composeBatch(batch);
+
+		for (size_t lane = 0; lane < lanes; lane++) {
+			scatterLane(batch, lane, out[first + lane]);
+		}
+	}
+}
+
+glm::mat4 composeLocalTransform(const glm::vec3 &position, const glm::vec3 &rotation, const glm::vec3 &referencePoint) {
+	glm::mat4 transform;
+	composeLocalTransforms(&position, &rotation, &referencePoint, nullptr, 1, &transform);
+	return transform;
+}
+
+// The same transform built out of separate matrices, the way it was before the kernel
+static glm::mat4 composeWithMatrices(const glm::vec3 &position, const glm::vec3 &rotation, const glm::vec3 &referencePoint) {
+	glm::mat4 identity = glm::mat4(1.0f);
+	glm::mat4 translateFromRef = glm::translate(identity, referencePoint);
+	glm::mat4 rotateX = glm::rotate(rotation.x, glm::vec3(0.0f, 1.0f, 0.0f));
+	glm::mat4 rotateY = glm::rotate(rotation.y, glm::vec3(1.0f, 0.0f, 0.0f));
+	glm::mat4 rotateZ = glm::rotate(rotation.z, glm::vec3(0.0f, 0.0f, 1.0f));
+	glm::mat4 translateToRef = glm::translate(identity, -referencePoint);
+
+	return glm::translate(position) * translateFromRef * rotateZ * rotateY * rotateX * translateToRef;
+}
+
+void benchmarkLocalTransforms(size_t nodeCount, unsigned int repetitions) {
+	std::vector<glm::vec3> positions(nodeCount);
+	std::vector<glm::vec3> rotations(nodeCount);
+	std::vector<glm::vec3> referencePoints(nodeCount);
+	for (size_t i = 0; i < nodeCount; i++) {
+		for (int axis = 0; axis < 3; axis++) {
+			positions[i][axis] = (randomUniformFloat() - 0.5f) * 200.0f;
+			rotations[i][axis] = (randomUniformFloat() - 0.5f) * 20.0f;
+			referencePoints[i][axis] = (randomUniformFloat() - 0.5f) * 20.0f;
+		}
+	}
+	std::vector<glm::mat4> withMatrices(nodeCount);
+	std::vector<glm::mat4> withKernel(nodeCount);
+
+	std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+	for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+		for (size_t i = 0; i < nodeCount; i++) {
+			withMatrices[i] = composeWithMatrices(positions[i], rotations[i], referencePoints[i]);
+		}
+	}
+	double matrixSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	start = std::chrono::steady_clock::now();
+	for (unsigned int repetition = 0; repetition < repetitions; repetition++) {
+		composeLocalTransforms(positions.data(), rotations.data(), referencePoints.data(), nullptr, nodeCount, withKernel.data());
+	}
+	double kernelSeconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+	float largestDifference = 0.0f;
+	for (size_t i = 0; i < nodeCount; i++) {
+		for (int column = 0; column < 4; column++) {
+			for (int row = 0; row < 4; row++) {
+				largestDifference = std::max(largestDifference, std::fabs(withMatrices[i][column][row] - withKernel[i][column][row]));
+			}
+		}
+	}
+
+	double nodes = double(nodeCount) * repetitions;
+	printf("[INFO] composing %zu local transforms %u times\n", nodeCount, repetitions);
+	printf("[INFO] glm matrices: %.1f million nodes/s\n", nodes / matrixSeconds / 1e6);
+	printf("[INFO] kernel, %d wide: %.1f million nodes/s, %.1fx as fast\n", TRANSFORM_KERNEL_WIDTH,
+		   nodes / kernelSeconds / 1e6, matrixSeconds / kernelSeconds);
+	printf("[INFO] largest difference between the two: %g\n", largestDifference);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstddef>
+#include <glm/glm.hpp>
+#include <glm/mat4x4.hpp>
+
+// Nodes composeLocalTransforms works on at once: eight with AVX, four with SSE2, and one
+// at a time in plain C++ otherwise
+#if defined(__AVX__)
+#define TRANSFORM_KERNEL_WIDTH 8
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define TRANSFORM_KERNEL_WIDTH 4
+#else
+#define TRANSFORM_KERNEL_WIDTH 1
+#endif
+
+// Angles further from zero than this are first reduced to a single turn in double
+// precision, since the kernel's own range reduction loses accuracy beyond it
+#define TRANSFORM_KERNEL_MAX_ANGLE 8192.0f
+
+// Transform of a node relative to its parent: moves it to position after rotating it about
+// referencePoint, first by rotation.x about Y, then rotation.y about X, then rotation.z about Z.
+// Evaluated by the same kernel as composeLocalTransforms, so both give identical results.
+glm::mat4 composeLocalTransform(const glm::vec3 &position, const glm::vec3 &rotation, const glm::vec3 &referencePoint);
+
+// composeLocalTransform for count nodes, writing the transform of node indices[i] to out[i],
+// or of node i if indices is null. The matrix is written out in closed form from the sines
+// and cosines of the three angles, instead of multiplying five matrices together, and
+// TRANSFORM_KERNEL_WIDTH nodes are composed at once. Every node gets the same result
+// whichever nodes it is batched with.
+void composeLocalTransforms(const glm::vec3 *positions, const glm::vec3 *rotations, const glm::vec3 *referencePoints,
+							const unsigned int *indices, size_t count, glm::mat4 *out);
+
+// Times composeLocalTransforms against composing the same transforms out of glm::translate
+// and glm::rotate, on nodeCount random nodes, and prints nodes per second for both together
+// with the largest difference between their results
+void benchmarkLocalTransforms(size_t nodeCount, unsigned int repetitions);
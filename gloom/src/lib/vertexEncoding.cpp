@@ -0,0 +1,152 @@
+#include "vertexEncoding.hpp"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/gtx/transform.hpp>
+
+// Largest vertex count whose indices still fit in an unsigned short
+#define SHORT_INDEX_VERTEX_LIMIT 65536u
+
+static inline unsigned int packSignedNormalised10(float value) {
+	float clamped = std::min(std::max(value, -1.0f), 1.0f);
+	int quantised = static_cast<int>(std::lround(clamped * 511.0f));
+	return static_cast<unsigned int>(quantised) & 0x3FFu;
+}
+
+unsigned int packSignedNormalised1010102(float x, float y, float z) {
+	return packSignedNormalised10(x) | (packSignedNormalised10(y) << 10) | (packSignedNormalised10(z) << 20);
+}
+
+static inline unsigned short packUnsignedNormalised16(float value) {
+	float clamped = std::min(std::max(value, 0.0f), 1.0f);
+	return static_cast<unsigned short>(std::lround(clamped * 65535.0f));
+}
+
+static inline unsigned char packUnsignedNormalised8(float value) {
+	float clamped = std::min(std::max(value, 0.0f), 1.0f);
+	return static_cast<unsigned char>(std::lround(clamped * 255.0f));
+}
+
+static void encodePositions(const MeshView &mesh, EncodedMesh &out) {
+	size_t count = mesh.vertexCount;
+	if (!out.format.quantisePositions) {
+		out.positions.resize(count * 3 * sizeof(float));
+		std::memcpy(out.positions.data(), mesh.vertices, out.positions.size());
+		return;
+	}
+
+	glm::vec3 minimum(0.0f);
+	glm::vec3 maximum(0.0f);
+	for (size_t i = 0; i < count; i++) {
+		glm::vec3 position(mesh.vertices[i * 3 + 0], mesh.vertices[i * 3 + 1], mesh.vertices[i * 3 + 2]);
+		minimum = i == 0 ? position : glm::min(minimum, position);
+		maximum = i == 0 ? position : glm::max(maximum, position);
+	}
+	glm::vec3 extent = maximum - minimum;
+
+	out.positions.resize(count * 4 * sizeof(unsigned short));
+	unsigned short *positions = reinterpret_cast<unsigned short *>(out.positions.data());
+	for (size_t i = 0; i < count; i++) {
+		for (unsigned int axis = 0; axis < 3; axis++) {
+			// Flat axes keep every vertex on the minimum
+			float offset = mesh.vertices[i * 3 + axis] - minimum[axis];
+			positions[i * 4 + axis] = extent[axis] > 0.0f ? packUnsignedNormalised16(offset / extent[axis]) : 0;
+		}
+		positions[i * 4 + 3] = 0;
+	}
+	out.positionTransform = glm::translate(minimum) * glm::scale(extent);
+}
+
+static void encodeNormals(const MeshView &mesh, EncodedMesh &out) {
+	size_t count = mesh.vertexCount;
+	if (!out.format.packNormals) {
+		out.normals.resize(count * 3 * sizeof(float));
+		std::memcpy(out.normals.data(), mesh.normals, out.normals.size());
+		return;
+	}
+
+	out.normals.resize(count * sizeof(unsigned int));
+	unsigned int *normals = reinterpret_cast<unsigned int *>(out.normals.data());
+	for (size_t i = 0; i < count; i++) {
+		normals[i] = packSignedNormalised1010102(mesh.normals[i * 3 + 0], mesh.normals[i * 3 + 1], mesh.normals[i * 3 + 2]);
+	}
+}
+
+static void encodeColours(const MeshView &mesh, EncodedMesh &out) {
+	if (mesh.colours == nullptr) {
+		return;
+	}
+	size_t count = mesh.vertexCount;
+	if (!out.format.packColours) {
+		out.colours.resize(count * 4 * sizeof(float));
+		std::memcpy(out.colours.data(), mesh.colours, out.colours.size());
+		return;
+	}
+
+	out.colours.resize(count * 4);
+	for (size_t i = 0; i < count * 4; i++) {
+		out.colours[i] = packUnsignedNormalised8(mesh.colours[i]);
+	}
+}
+
+static void encodeIndices(const MeshView &mesh, EncodedMesh &out) {
+	size_t count = mesh.indexCount;
+	out.shortIndices = out.format.shortIndices && mesh.vertexCount <= SHORT_INDEX_VERTEX_LIMIT;
+	if (!out.shortIndices) {
+		out.indices.resize(count * sizeof(unsigned int));
+		std::memcpy(out.indices.data(), mesh.indices, out.indices.size());
+		return;
+	}
+
+	out.indices.resize(count * sizeof(unsigned short));
+	unsigned short *indices = reinterpret_cast<unsigned short *>(out.indices.data());
+	for (size_t i = 0; i < count; i++) {
+		indices[i] = static_cast<unsigned short>(mesh.indices[i]);
+	}
+}
+
+glm::vec4 computeBoundingSphere(const float *vertices, unsigned int vertexCount) {
+	if (vertexCount == 0) {
+		return glm::vec4(0.0f);
+	}
+	glm::vec3 minimum(vertices[0], vertices[1], vertices[2]);
+	glm::vec3 maximum = minimum;
+	for (size_t i = 1; i < vertexCount; i++) {
+		glm::vec3 position(vertices[i * 3 + 0], vertices[i * 3 + 1], vertices[i * 3 + 2]);
+		minimum = glm::min(minimum, position);
+		maximum = glm::max(maximum, position);
+	}
+	glm::vec3 centre = 0.5f * (minimum + maximum);
+	float radius = 0.0f;
+	for (size_t i = 0; i < vertexCount; i++) {
+		glm::vec3 position(vertices[i * 3 + 0], vertices[i * 3 + 1], vertices[i * 3 + 2]);
+		radius = std::max(radius, glm::length(position - centre));
+	}
+	return glm::vec4(centre, radius);
+}
+
+std::vector<MeshLOD> meshLODs(const MeshView &mesh) {
+	if (mesh.lodCount == 0) {
+		return std::vector<MeshLOD>(1, MeshLOD{ 0, mesh.indexCount, 0.0f });
+	}
+	return std::vector<MeshLOD>(mesh.lods, mesh.lods + mesh.lodCount);
+}
+
+EncodedMesh encodeMesh(const MeshView &mesh, const VertexFormat &format) {
+	EncodedMesh out;
+	out.format = format;
+	out.vertexCount = mesh.vertexCount;
+	out.indexCount = mesh.indexCount;
+	out.shortIndices = false;
+	out.positionTransform = glm::mat4(1.0f);
+	out.lods = meshLODs(mesh);
+	out.boundingSphere = computeBoundingSphere(mesh.vertices, mesh.vertexCount);
+	out.boundsMin = glm::vec3(mesh.boundsMin.x, mesh.boundsMin.y, mesh.boundsMin.z);
+	out.boundsMax = glm::vec3(mesh.boundsMax.x, mesh.boundsMax.y, mesh.boundsMax.z);
+
+	encodePositions(mesh, out);
+	encodeNormals(mesh, out);
+	encodeColours(mesh, out);
+	encodeIndices(mesh, out);
+	return out;
+}
@@ -0,0 +1,71 @@
+#pragma once
+
+#include <cstddef>
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include "mesh.hpp"
+
+// Selects how each vertex attribute and the index buffer are stored on the GPU
+struct VertexFormat {
+	// 16-bit normalised positions relative to the mesh bounds instead of 3 floats
+	bool quantisePositions;
+	// 10-10-10-2 signed normalised normals instead of 3 floats
+	bool packNormals;
+	// 8-bit normalised colours instead of 4 floats
+	bool packColours;
+	// 16-bit indices for meshes with at most 65536 vertices
+	bool shortIndices;
+	// One vertex stream with all attributes side by side instead of one stream per attribute
+	bool interleaved;
+
+	// 40 bytes per vertex and 4 per index in separate streams, the original layout
+	static VertexFormat full() { return VertexFormat{ false, false, false, false, false }; }
+	// 16 interleaved bytes per vertex and 2 per index where the mesh allows it
+	static VertexFormat compact() { return VertexFormat{ true, true, true, true, true }; }
+};
+
+// Bytes per vertex of each attribute stream
+#define ENCODED_POSITION_BYTES(format) ((format).quantisePositions ? 4 * sizeof(unsigned short) : 3 * sizeof(float))
+#define ENCODED_NORMAL_BYTES(format) ((format).packNormals ? sizeof(unsigned int) : 3 * sizeof(float))
+#define ENCODED_COLOUR_BYTES(format) ((format).packColours ? 4 * sizeof(unsigned char) : 4 * sizeof(float))
+
+// A mesh converted to the layout it is uploaded in. Positions are padded to four 16-bit
+// components when quantised, so that every vertex starts on a 4 byte boundary.
+struct EncodedMesh {
+	VertexFormat format;
+	std::vector<unsigned char> positions;
+	std::vector<unsigned char> normals;
+	std::vector<unsigned char> colours;
+	std::vector<unsigned char> indices;
+	unsigned int vertexCount;
+	unsigned int indexCount;
+	// Levels of detail within indices. Always holds at least the full mesh.
+	std::vector<MeshLOD> lods;
+	// Centre and radius of a sphere around the mesh, in model space
+	glm::vec4 boundingSphere;
+	// Box around the mesh in model space
+	glm::vec3 boundsMin;
+	glm::vec3 boundsMax;
+	// Whether indices holds 16-bit values; format.shortIndices only asks for them
+	bool shortIndices;
+	// Maps the stored positions back to model space. Identity unless positions are
+	// quantised, in which case it scales and moves the unit cube onto the mesh bounds.
+	glm::mat4 positionTransform;
+
+	size_t byteSize() const {
+		return positions.size() + normals.size() + colours.size() + indices.size();
+	}
+};
+
+// Converts mesh to format. Meshes without colours get none in the result either.
+// Does not touch any GL state, so it can run on a loader thread.
+EncodedMesh encodeMesh(const MeshView &mesh, const VertexFormat &format);
+
+// Returns the centre of the mesh's bounding box and the radius around it that holds every vertex
+glm::vec4 computeBoundingSphere(const float *vertices, unsigned int vertexCount);
+
+// Levels of detail of mesh, or a single level covering all its indices if it has none
+std::vector<MeshLOD> meshLODs(const MeshView &mesh);
+
+// Packs a unit vector into GL_INT_2_10_10_10_REV layout, with w left at 0
+unsigned int packSignedNormalised1010102(float x, float y, float z);
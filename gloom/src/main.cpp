@@ -1,6 +1,8 @@
 // Local headers
 #include "gloom/gloom.hpp"
 #include "program.hpp"
+#include "lib/animation.hpp"
+#include "lib/transformKernel.hpp"
 
 // System headers
 #include <glad/glad.h>
@@ -8,6 +10,24 @@
 
 // Standard headers
 #include <cstdlib>
+#include <cstring>
+#include <exception>
+#include <string>
+
+// Nodes and repetitions of --benchmark-transforms
+#define BENCHMARK_TRANSFORM_NODES 100000
+#define BENCHMARK_TRANSFORM_REPETITIONS 20
+// Channels and repetitions of --benchmark-animation
+#define BENCHMARK_ANIMATION_CHANNELS 100000
+#define BENCHMARK_ANIMATION_REPETITIONS 200
+// Frames the simulation may run ahead of drawing unless --frame-queue-depth says otherwise
+#define DEFAULT_FRAME_QUEUE_DEPTH 2
+#define MAX_FRAME_QUEUE_DEPTH 64
+// Frames a --headless run draws unless --frames says otherwise, and the limits of --frames
+// and --size
+#define DEFAULT_HEADLESS_FRAMES 300
+#define MAX_HEADLESS_FRAMES 1000000
+#define MAX_HEADLESS_SIZE 16384
 
 
 // A callback which allows GLFW to report errors whenever they occur
@@ -17,9 +37,9 @@ static void glfwErrorCallback(int error, const char *description)
 }
 
 
-GLFWwindow* initialise()
+// Starts GLFW, exiting if it can not
+static void startGLFW()
 {
-    // Initialise GLFW
     if (!glfwInit())
     {
         fprintf(stderr, "Could not start GLFW\n");
@@ -28,22 +48,63 @@ GLFWwindow* initialise()
 
     // Set core window options (adjust version numbers if needed)
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 4);
-    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 3);
+    glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 5);
     glfwWindowHint(GLFW_OPENGL_PROFILE, GLFW_OPENGL_CORE_PROFILE);
+}
+
 
+// Creates the invisible window whose context a headless run draws with. GLFW's null
+// platform needs no display at all and gives the window a surfaceless EGL context, which is
+// what Mesa's llvmpipe offers on machines without a GPU. Where GLFW has no null platform,
+// or EGL is missing, a hidden window on the usual platform is used instead.
+static GLFWwindow* createHeadlessWindow()
+{
+#ifdef GLFW_PLATFORM_NULL
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    startGLFW();
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    GLFWwindow* window = glfwCreateWindow(windowWidth, windowHeight, windowTitle.c_str(), nullptr, nullptr);
+    if (window)
+    {
+        printf("[INFO] drawing headless with a surfaceless EGL context\n");
+        return window;
+    }
+    glfwTerminate();
+    printf("[WARNING] could not create a surfaceless EGL context, drawing headless in a hidden window instead\n");
+    glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+#endif
+    startGLFW();
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    return glfwCreateWindow(windowWidth, windowHeight, windowTitle.c_str(), nullptr, nullptr);
+}
+
+
+GLFWwindow* initialise(bool headless)
+{
     // Enable the GLFW runtime error callback function defined previously.
     glfwSetErrorCallback(glfwErrorCallback);
 
-    // Set additional window options
-    glfwWindowHint(GLFW_RESIZABLE, windowResizable);
-    glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
+    GLFWwindow* window = nullptr;
+    if (headless)
+    {
+        window = createHeadlessWindow();
+    }
+    else
+    {
+        startGLFW();
 
-    // Create window using GLFW
-    GLFWwindow* window = glfwCreateWindow(windowWidth,
-                                          windowHeight,
-                                          windowTitle.c_str(),
-                                          nullptr,
-                                          nullptr);
+        // Set additional window options
+        glfwWindowHint(GLFW_RESIZABLE, windowResizable);
+        glfwWindowHint(GLFW_SAMPLES, windowSamples);  // MSAA
+
+        // Create window using GLFW
+        window = glfwCreateWindow(windowWidth,
+                                  windowHeight,
+                                  windowTitle.c_str(),
+                                  nullptr,
+                                  nullptr);
+    }
 
     // Ensure the window is set up correctly
     if (!window)
@@ -67,16 +128,154 @@ GLFWwindow* initialise()
 }
 
 
+// Reads a whole number from 1 to max out of text. Returns false if there is none.
+static bool parseCount(const char* text, unsigned long max, unsigned long &count)
+{
+    char *end = nullptr;
+    count = std::strtoul(text, &end, 10);
+    return end != text && *end == '\0' && count >= 1 && count <= max;
+}
+
+
+// Reads the options of runProgram from the command line. Returns false, after saying why,
+// for options it does not know or values it can not use.
+static bool parseOptions(int argc, char* argb[], ProgramOptions &options)
+{
+    options.frameQueueDepth = DEFAULT_FRAME_QUEUE_DEPTH;
+    options.scenePath = ScenePath::GPUDriven;
+    options.headless = false;
+    options.width = windowWidth;
+    options.height = windowHeight;
+    options.frameCount = 0;
+    bool headlessOnly = false;
+    for (int i = 1; i < argc; i++)
+    {
+        unsigned long value = 0;
+        bool hasValue = i + 1 < argc;
+        if (std::strcmp(argb[i], "--frame-queue-depth") == 0 && hasValue)
+        {
+            if (!parseCount(argb[++i], MAX_FRAME_QUEUE_DEPTH, value))
+            {
+                fprintf(stderr, "--frame-queue-depth takes a number of frames from 1 to %d\n", MAX_FRAME_QUEUE_DEPTH);
+                return false;
+            }
+            options.frameQueueDepth = static_cast<unsigned int>(value);
+        }
+        else if (std::strcmp(argb[i], "--scene-path") == 0 && hasValue)
+        {
+            const char* path = argb[++i];
+            if (std::strcmp(path, "queued") == 0)
+            {
+                options.scenePath = ScenePath::Queued;
+            }
+            else if (std::strcmp(path, "instanced") == 0)
+            {
+                options.scenePath = ScenePath::Instanced;
+            }
+            else if (std::strcmp(path, "gpu") == 0)
+            {
+                options.scenePath = ScenePath::GPUDriven;
+            }
+            else
+            {
+                fprintf(stderr, "--scene-path takes queued, instanced or gpu\n");
+                return false;
+            }
+        }
+        else if (std::strcmp(argb[i], "--headless") == 0)
+        {
+            options.headless = true;
+        }
+        else if (std::strcmp(argb[i], "--frames") == 0 && hasValue)
+        {
+            if (!parseCount(argb[++i], MAX_HEADLESS_FRAMES, value))
+            {
+                fprintf(stderr, "--frames takes a number of frames from 1 to %d\n", MAX_HEADLESS_FRAMES);
+                return false;
+            }
+            options.frameCount = static_cast<unsigned int>(value);
+            headlessOnly = true;
+        }
+        else if (std::strcmp(argb[i], "--size") == 0 && hasValue)
+        {
+            // WIDTHxHEIGHT, such as 1920x1080
+            std::string size = argb[++i];
+            size_t separator = size.find('x');
+            unsigned long width = 0;
+            unsigned long height = 0;
+            if (separator == std::string::npos
+                || !parseCount(size.substr(0, separator).c_str(), MAX_HEADLESS_SIZE, width)
+                || !parseCount(size.substr(separator + 1).c_str(), MAX_HEADLESS_SIZE, height))
+            {
+                fprintf(stderr, "--size takes a width and height from 1 to %d, written as WIDTHxHEIGHT\n", MAX_HEADLESS_SIZE);
+                return false;
+            }
+            options.width = static_cast<int>(width);
+            options.height = static_cast<int>(height);
+            headlessOnly = true;
+        }
+        else if (std::strcmp(argb[i], "--output") == 0 && hasValue)
+        {
+            options.outputDirectory = argb[++i];
+            headlessOnly = true;
+        }
+        else
+        {
+            fprintf(stderr, "Unknown option %s\n", argb[i]);
+            return false;
+        }
+    }
+    if (headlessOnly && !options.headless)
+    {
+        fprintf(stderr, "--frames, --size and --output only apply to --headless\n");
+        return false;
+    }
+    if (options.headless && options.frameCount == 0)
+    {
+        options.frameCount = DEFAULT_HEADLESS_FRAMES;
+    }
+    return true;
+}
+
+
 int main(int argc, char* argb[])
 {
+    // Compares the local transform kernel with composing glm matrices, without opening a window
+    if (argc > 1 && std::strcmp(argb[1], "--benchmark-transforms") == 0)
+    {
+        benchmarkLocalTransforms(BENCHMARK_TRANSFORM_NODES, BENCHMARK_TRANSFORM_REPETITIONS);
+        return EXIT_SUCCESS;
+    }
+    // Times evaluating animation channels, without opening a window
+    if (argc > 1 && std::strcmp(argb[1], "--benchmark-animation") == 0)
+    {
+        benchmarkAnimation(BENCHMARK_ANIMATION_CHANNELS, BENCHMARK_ANIMATION_REPETITIONS);
+        return EXIT_SUCCESS;
+    }
+
+    ProgramOptions options;
+    if (!parseOptions(argc, argb, options))
+    {
+        return EXIT_FAILURE;
+    }
+
     // Initialise window using GLFW
-    GLFWwindow* window = initialise();
+    GLFWwindow* window = initialise(options.headless);
 
-    // Run an OpenGL application using this window
-    runProgram(window);
+    // Run an OpenGL application using this window. Failures end in a status code rather
+    // than an abort, so that scripts running headless can tell what happened.
+    int status = EXIT_FAILURE;
+    try
+    {
+        status = runProgram(window, options);
+    }
+    catch (const std::exception &error)
+    {
+        fprintf(stderr, "%s\n", error.what());
+    }
 
     // Terminate GLFW (no need to call glfwDestroyWindow)
     glfwTerminate();
 
-    return EXIT_SUCCESS;
+    return status;
 }
@@ -0,0 +1,148 @@
+#include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "meshArena.hpp"
+#include "vao.hpp"
+
+// Vertices and indices the arena starts out with room for. It doubles whenever it runs out.
+#define INITIAL_ARENA_VERTICES 65536
+#define INITIAL_ARENA_INDICES 262144
+
+// Colour the shader sees for a disabled colour attribute, given to meshes without colours
+static const unsigned char DEFAULT_PACKED_COLOUR[4] = { 0, 0, 0, 255 };
+static const float DEFAULT_COLOUR[4] = { 0.0f, 0.0f, 0.0f, 1.0f };
+
+// Creates an immutable buffer of byteSize bytes that can be written with glNamedBufferSubData,
+// holding the first copyBytes bytes of previous, if any
+static unsigned int createArenaBuffer(size_t byteSize, unsigned int previous, size_t copyBytes)
+{
+    unsigned int buffer = 0;
+    glCreateBuffers(1, &buffer);
+    glNamedBufferStorage(buffer, GLsizeiptr(byteSize), nullptr, GL_DYNAMIC_STORAGE_BIT);
+    if (previous != 0 && copyBytes > 0) {
+        glCopyNamedBufferSubData(previous, buffer, 0, 0, GLsizeiptr(copyBytes));
+    }
+    return buffer;
+}
+
+MeshArena::MeshArena(const VertexFormat &format)
+    : mFormat(format),
+      mVertexArrayID(0),
+      mVertexBufferID(0),
+      mIndexBufferID(0),
+      mVertexCount(0),
+      mIndexCount(0),
+      mVertexCapacity(0),
+      mIndexCapacity(0) {
+    unsigned int positionBytes = ENCODED_POSITION_BYTES(format);
+    unsigned int colourBytes = ENCODED_COLOUR_BYTES(format);
+    unsigned int normalBytes = ENCODED_NORMAL_BYTES(format);
+    mStride = positionBytes + colourBytes + normalBytes;
+
+    // The same attributes as meshLayout(EncodedMesh), all read from stream 0
+    glCreateVertexArrays(1, &mVertexArrayID);
+    glEnableVertexArrayAttrib(mVertexArrayID, POSITION_LOCATION);
+    glVertexArrayAttribFormat(mVertexArrayID, POSITION_LOCATION, 3, format.quantisePositions ? GL_UNSIGNED_SHORT : GL_FLOAT,
+                              format.quantisePositions ? GL_TRUE : GL_FALSE, 0);
+    glEnableVertexArrayAttrib(mVertexArrayID, COLOR_LOCATION);
+    glVertexArrayAttribFormat(mVertexArrayID, COLOR_LOCATION, 4, format.packColours ? GL_UNSIGNED_BYTE : GL_FLOAT,
+                              format.packColours ? GL_TRUE : GL_FALSE, positionBytes);
+    glEnableVertexArrayAttrib(mVertexArrayID, NORMAL_LOCATION);
+    glVertexArrayAttribFormat(mVertexArrayID, NORMAL_LOCATION, format.packNormals ? 4 : 3,
+                              format.packNormals ? GL_INT_2_10_10_10_REV : GL_FLOAT,
+                              format.packNormals ? GL_TRUE : GL_FALSE, positionBytes + colourBytes);
+    glVertexArrayAttribBinding(mVertexArrayID, POSITION_LOCATION, 0);
+    glVertexArrayAttribBinding(mVertexArrayID, COLOR_LOCATION, 0);
+    glVertexArrayAttribBinding(mVertexArrayID, NORMAL_LOCATION, 0);
+
+    reserve(INITIAL_ARENA_VERTICES, INITIAL_ARENA_INDICES);
+}
+
+MeshArena::~MeshArena() {
+    glDeleteVertexArrays(1, &mVertexArrayID);
+    glDeleteBuffers(1, &mVertexBufferID);
+    glDeleteBuffers(1, &mIndexBufferID);
+}
+
+size_t MeshArena::byteSize() const {
+    return mVertexCapacity * mStride + mIndexCapacity * sizeof(unsigned int);
+}
+
+void MeshArena::reserve(size_t vertexCount, size_t indexCount) {
+    if (mVertexCount + vertexCount > mVertexCapacity) {
+        size_t capacity = std::max(std::max<size_t>(mVertexCapacity * 2, INITIAL_ARENA_VERTICES), mVertexCount + vertexCount);
+        unsigned int buffer = createArenaBuffer(capacity * mStride, mVertexBufferID, mVertexCount * mStride);
+        glDeleteBuffers(1, &mVertexBufferID);
+        mVertexBufferID = buffer;
+        mVertexCapacity = capacity;
+        glVertexArrayVertexBuffer(mVertexArrayID, 0, mVertexBufferID, 0, GLsizei(mStride));
+    }
+    if (mIndexCount + indexCount > mIndexCapacity) {
+        size_t capacity = std::max(std::max<size_t>(mIndexCapacity * 2, INITIAL_ARENA_INDICES), mIndexCount + indexCount);
+        unsigned int buffer = createArenaBuffer(capacity * sizeof(unsigned int), mIndexBufferID,
+                                                mIndexCount * sizeof(unsigned int));
+        glDeleteBuffers(1, &mIndexBufferID);
+        mIndexBufferID = buffer;
+        mIndexCapacity = capacity;
+        glVertexArrayElementBuffer(mVertexArrayID, mIndexBufferID);
+    }
+}
+
+unsigned int MeshArena::add(const EncodedMesh &mesh) {
+    if (mesh.format.quantisePositions != mFormat.quantisePositions || mesh.format.packNormals != mFormat.packNormals ||
+        mesh.format.packColours != mFormat.packColours) {
+        throw std::runtime_error("Mesh does not have the vertex format of the arena it is added to.");
+    }
+    reserve(mesh.vertexCount, mesh.indexCount);
+
+    unsigned int positionBytes = ENCODED_POSITION_BYTES(mFormat);
+    unsigned int colourBytes = ENCODED_COLOUR_BYTES(mFormat);
+    unsigned int normalBytes = ENCODED_NORMAL_BYTES(mFormat);
+    const void *defaultColour = mFormat.packColours ? static_cast<const void *>(DEFAULT_PACKED_COLOUR)
+                                                    : static_cast<const void *>(DEFAULT_COLOUR);
+    std::vector<unsigned char> vertices(size_t(mesh.vertexCount) * mStride, 0);
+    for (size_t v = 0; v < mesh.vertexCount; v++) {
+        unsigned char *vertex = vertices.data() + v * mStride;
+        std::memcpy(vertex, mesh.positions.data() + v * positionBytes, positionBytes);
+        std::memcpy(vertex + positionBytes,
+                    mesh.colours.empty() ? defaultColour : mesh.colours.data() + v * colourBytes, colourBytes);
+        if (!mesh.normals.empty()) {
+            std::memcpy(vertex + positionBytes + colourBytes, mesh.normals.data() + v * normalBytes, normalBytes);
+        }
+    }
+
+    std::vector<unsigned int> indices(mesh.indexCount);
+    if (mesh.shortIndices) {
+        const unsigned short *shortIndices = reinterpret_cast<const unsigned short *>(mesh.indices.data());
+        std::copy(shortIndices, shortIndices + mesh.indexCount, indices.begin());
+    } else if (mesh.indexCount > 0) {
+        std::memcpy(indices.data(), mesh.indices.data(), indices.size() * sizeof(unsigned int));
+    }
+
+    if (!vertices.empty()) {
+        glNamedBufferSubData(mVertexBufferID, GLintptr(mVertexCount * mStride), GLsizeiptr(vertices.size()), vertices.data());
+    }
+    if (!indices.empty()) {
+        glNamedBufferSubData(mIndexBufferID, GLintptr(mIndexCount * sizeof(unsigned int)),
+                             GLsizeiptr(indices.size() * sizeof(unsigned int)), indices.data());
+    }
+
+    ArenaMeshData data;
+    data.positionTransform = mesh.positionTransform;
+    data.boundsMin = glm::vec4(mesh.boundsMin, 0.0f);
+    data.boundsMax = glm::vec4(mesh.boundsMax, 0.0f);
+    data.boundingSphere = mesh.boundingSphere;
+    data.firstLOD = unsigned(mLODs.size());
+    data.lodCount = unsigned(mesh.lods.size());
+    data.baseVertex = int(mVertexCount);
+    data.padding = 0;
+    for (const MeshLOD &lod : mesh.lods) {
+        mLODs.push_back(ArenaLODData{ unsigned(mIndexCount) + lod.indexOffset, lod.indexCount, lod.error, 0 });
+    }
+    mMeshes.push_back(data);
+
+    mVertexCount += mesh.vertexCount;
+    mIndexCount += mesh.indexCount;
+    return unsigned(mMeshes.size() - 1);
+}
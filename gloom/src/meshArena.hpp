@@ -0,0 +1,90 @@
+#ifndef GLOOM_MESH_ARENA_HPP
+#define GLOOM_MESH_ARENA_HPP
+
+#include <vector>
+#include <glm/mat4x4.hpp>
+#include <lib/vertexEncoding.hpp>
+
+// Draw parameters of one mesh in a MeshArena, laid out like ArenaMesh in cull.comp
+struct ArenaMeshData {
+    // Has to be applied to the stored positions before the model matrix, see EncodedMesh
+    glm::mat4 positionTransform;
+    // Box around the mesh in model space, w is unused
+    glm::vec4 boundsMin;
+    glm::vec4 boundsMax;
+    // Centre and radius in model space, used to pick a level of detail
+    glm::vec4 boundingSphere;
+    // Where the mesh's levels of detail start in MeshArena::lods()
+    unsigned int firstLOD;
+    unsigned int lodCount;
+    // Added to every index of the mesh, which are relative to its own first vertex
+    int baseVertex;
+    unsigned int padding;
+};
+
+// One level of detail of a mesh in a MeshArena, laid out like ArenaLOD in cull.comp
+struct ArenaLODData {
+    // Indices of the level, counted from the start of the arena's index buffer
+    unsigned int firstIndex;
+    unsigned int indexCount;
+    // Largest distance, in model units, between this level's surface and the full mesh
+    float error;
+    unsigned int padding;
+};
+
+// One vertex buffer and one index buffer holding many meshes, so that all of them can be
+// drawn through a single VAO with one multi-draw call.
+//
+// Every mesh has to be encoded in the format the arena was created with. Its vertices are
+// interleaved into a single stream, with meshes that lack colours getting the colour a
+// disabled attribute would give the shader, and its indices are widened to 32 bits where
+// they are short, since a multi-draw call takes a single index type. Both buffers are
+// immutable and are replaced by twice as large ones, copied on the GPU, when they run out
+// of room. Meshes stay in the arena until it is destroyed.
+//
+// Must be created, used and destroyed on the GL thread.
+class MeshArena {
+public:
+    explicit MeshArena(const VertexFormat &format);
+    ~MeshArena();
+
+    MeshArena(const MeshArena &) = delete;
+    MeshArena &operator=(const MeshArena &) = delete;
+
+    // Copies mesh to the end of the arena and returns its slot in meshes(). Throws
+    // std::runtime_error if mesh was encoded in another format.
+    unsigned int add(const EncodedMesh &mesh);
+
+    // Draws the arena's vertices with GL_UNSIGNED_INT indices
+    unsigned int vertexArray() const { return mVertexArrayID; }
+
+    // Tables of every mesh and level of detail, in the order they were added
+    const std::vector<ArenaMeshData> &meshes() const { return mMeshes; }
+    const std::vector<ArenaLODData> &lods() const { return mLODs; }
+    // Changes whenever a mesh is added
+    unsigned int version() const { return unsigned(mMeshes.size()); }
+
+    // Video memory taken up by the vertex and index buffers
+    size_t byteSize() const;
+
+private:
+    // Makes room for vertexCount more vertices and indexCount more indices
+    void reserve(size_t vertexCount, size_t indexCount);
+
+    VertexFormat mFormat;
+    // Bytes per vertex of the single interleaved stream
+    unsigned int mStride;
+    unsigned int mVertexArrayID;
+    unsigned int mVertexBufferID;
+    unsigned int mIndexBufferID;
+    // Vertices and indices in use, and the room the buffers have
+    size_t mVertexCount;
+    size_t mIndexCount;
+    size_t mVertexCapacity;
+    size_t mIndexCapacity;
+
+    std::vector<ArenaMeshData> mMeshes;
+    std::vector<ArenaLODData> mLODs;
+};
+
+#endif //GLOOM_MESH_ARENA_HPP
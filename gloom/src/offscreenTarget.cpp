@@ -0,0 +1,60 @@
+#include <stdexcept>
+#include "offscreenTarget.hpp"
+
+#define STB_IMAGE_WRITE_IMPLEMENTATION
+#include <stb_image_write.h>
+
+// Bytes per pixel read back, RGBA
+#define OFFSCREEN_CHANNELS 4
+
+OffscreenTarget::OffscreenTarget(int width, int height)
+    : mFramebufferID(0),
+      mColourBufferID(0),
+      mDepthBufferID(0),
+      mWidth(width),
+      mHeight(height) {
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_RENDERBUFFER_SIZE, &maxSize);
+    if (width <= 0 || height <= 0 || width > maxSize || height > maxSize) {
+        throw std::runtime_error("Offscreen frames have to be between 1 and GL_MAX_RENDERBUFFER_SIZE pixels on each side.");
+    }
+
+    glCreateRenderbuffers(1, &mColourBufferID);
+    glNamedRenderbufferStorage(mColourBufferID, GL_RGBA8, width, height);
+    glCreateRenderbuffers(1, &mDepthBufferID);
+    glNamedRenderbufferStorage(mDepthBufferID, GL_DEPTH_COMPONENT24, width, height);
+    glCreateFramebuffers(1, &mFramebufferID);
+    glNamedFramebufferRenderbuffer(mFramebufferID, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, mColourBufferID);
+    glNamedFramebufferRenderbuffer(mFramebufferID, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, mDepthBufferID);
+    if (glCheckNamedFramebufferStatus(mFramebufferID, GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        glDeleteFramebuffers(1, &mFramebufferID);
+        unsigned int renderbuffers[2] = { mColourBufferID, mDepthBufferID };
+        glDeleteRenderbuffers(2, renderbuffers);
+        throw std::runtime_error("Could not create a complete offscreen framebuffer.");
+    }
+}
+
+OffscreenTarget::~OffscreenTarget() {
+    glDeleteFramebuffers(1, &mFramebufferID);
+    unsigned int renderbuffers[2] = { mColourBufferID, mDepthBufferID };
+    glDeleteRenderbuffers(2, renderbuffers);
+}
+
+void OffscreenTarget::bind() const {
+    glBindFramebuffer(GL_FRAMEBUFFER, mFramebufferID);
+    glViewport(0, 0, mWidth, mHeight);
+}
+
+bool OffscreenTarget::writePNG(const std::string &path) {
+    size_t rowBytes = size_t(mWidth) * OFFSCREEN_CHANNELS;
+    mPixels.resize(rowBytes * size_t(mHeight));
+    glNamedFramebufferReadBuffer(mFramebufferID, GL_COLOR_ATTACHMENT0);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, mFramebufferID);
+    // Rows are tightly packed, whatever the width
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, mWidth, mHeight, GL_RGBA, GL_UNSIGNED_BYTE, mPixels.data());
+
+    // GL reads the bottom row first, images start at the top
+    stbi_flip_vertically_on_write(1);
+    return stbi_write_png(path.c_str(), mWidth, mHeight, OFFSCREEN_CHANNELS, mPixels.data(), int(rowBytes)) != 0;
+}
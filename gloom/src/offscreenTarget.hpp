@@ -0,0 +1,45 @@
+#ifndef GLOOM_OFFSCREEN_TARGET_HPP
+#define GLOOM_OFFSCREEN_TARGET_HPP
+
+#include <string>
+#include <vector>
+#include <glad/glad.h>
+
+// Framebuffer object frames are drawn into when there is no window to show them, such as
+// with a surfaceless EGL context, which has no default framebuffer at all.
+//
+// A colour and a depth renderbuffer of the requested size stay bound as the draw and read
+// framebuffer, so everything drawn after bind() ends up in them. writePNG() reads the colour
+// buffer back, which waits for the frame to finish, and writes it out with stb_image_write.
+//
+// Must be created, used and destroyed on the GL thread.
+class OffscreenTarget {
+public:
+    // Throws std::runtime_error if the driver can not draw into buffers of that size
+    OffscreenTarget(int width, int height);
+    ~OffscreenTarget();
+
+    OffscreenTarget(const OffscreenTarget &) = delete;
+    OffscreenTarget &operator=(const OffscreenTarget &) = delete;
+
+    // Draws into the target from now on, over all of it
+    void bind() const;
+
+    // Writes what was drawn so far to path, top row first. Returns false if the file could
+    // not be written.
+    bool writePNG(const std::string &path);
+
+    int width() const { return mWidth; }
+    int height() const { return mHeight; }
+
+private:
+    unsigned int mFramebufferID;
+    unsigned int mColourBufferID;
+    unsigned int mDepthBufferID;
+    int mWidth;
+    int mHeight;
+    // Kept between frames to reuse the allocation
+    std::vector<unsigned char> mPixels;
+};
+
+#endif //GLOOM_OFFSCREEN_TARGET_HPP
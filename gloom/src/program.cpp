@@ -1,5 +1,12 @@
 // Local headers
 #include <gloom/shader.hpp>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <exception>
+#include <memory>
+#include <thread>
 #include <vector>
 #include "program.hpp"
 #include "gloom/gloom.hpp"
@@ -10,9 +17,20 @@
 #include "lib/toolbox.hpp"
 #include "inputs.hpp"
 #include "vao.hpp"
+#include "asyncLoader.hpp"
+#include "tileManager.hpp"
+#include "instancing.hpp"
+#include "renderQueue.hpp"
+#include "gpuCulling.hpp"
+#include "meshArena.hpp"
+#include "offscreenTarget.hpp"
+#include "lib/animation.hpp"
+#include "lib/fixedStepClock.hpp"
+#include "lib/frustum.hpp"
+#include "lib/spscQueue.hpp"
+#include "lib/taskScheduler.hpp"
 
 #define FOV 40.0f
-#define ASPECT_RATIO (16.0f/9.0f)
 
 #define Z_FAR_PLANE 10000.0f
 #define Z_NEAR_PLANE 1.0f
@@ -21,143 +39,398 @@
 #define TAIL_ROTOR_SPEED 5.0f
 
 #define HELI_TIME_OFFSET 1.6f
+// Width and angular speed of the figure eights the helicopters fly
+#define FIGURE_EIGHT_SIZE 15.0f
+#define FIGURE_EIGHT_SPEED 0.8f
 
 #define CHASE_RADIUS 20.0f
-#define CHASE_SPEED 0.02f
+// Rate, per second, at which the chase camera closes the gap to where it wants to be
+#define CHASE_SPEED 1.2f
 
 #define MAIN_HELI_START_HEIGHT 20.0f
+// Number of threads used to parse OBJ files, 0 uses every hardware thread
+#define LOADER_THREADS 0
+// Background threads loading assets, and how many finished meshes may wait for upload
+#define ASSET_LOADER_WORKERS 2
+#define UPLOAD_QUEUE_CAPACITY 8
+// Time per frame the render loop may spend creating VAOs for loaded meshes
+#define UPLOAD_BUDGET_SECONDS 0.004
+// Upload meshes with quantised positions, packed normals and colours, and 16-bit indices
+#define COMPACT_VERTICES 1
 #define FIGURE_EIGHT_HELI_COUNT 5
+// Grid the terrain is split into, how far around the camera its tiles are streamed in, and
+// how much video memory resident tiles may take up before the least recently used are evicted
+#define TERRAIN_TILES_PER_SIDE 8
+#define TERRAIN_STREAM_RADIUS 300.0f
+#define TERRAIN_TILE_BUDGET_MB 16
+// How often the drawn and culled mesh and draw call counts, the recomputed and reused matrix counts, the
+// state changes of the render queue, and the frame rate and latency of the pipeline are printed
+#define CULLING_REPORT_SECONDS 5.0
+// Largest error, in pixels, that drawing a simplified level of detail may cause on screen
+#define LOD_PIXEL_ERROR 1.0f
+// Threads animating, updating and culling the scene besides the GL thread, 0 uses every
+// other hardware thread
+#define FRAME_WORKER_THREADS 0
+// Animation channels evaluated per task
+#define ANIMATION_BATCH_SIZE 1024
+// The scene is cut into about this many ranges per thread, of at least SCENE_RANGE_MIN_NODES
+#define SCENE_RANGES_PER_THREAD 4
+#define SCENE_RANGE_MIN_NODES 64
+// Material of every queued draw, since the meshes do not have materials of their own yet
+#define DEFAULT_MATERIAL 0
+// Rate the input, the chase camera and the animations are simulated at, whatever the frame
+// rate, and the most steps a frame may take to catch up before time is dropped
+#define SIMULATION_STEP_HZ 60.0
+#define MAX_SIMULATION_STEPS_PER_FRAME 8
+// Time every frame of a headless run advances the simulation by, whatever it takes to draw,
+// so that the same run always draws the same frames
+#define HEADLESS_FRAME_SECONDS (1.0 / 60.0)
+
+// Packets passed from the simulation thread to the render thread
+typedef SPSCQueue<FramePacket> FrameQueue;
+
+SceneHandle addHelicopterNode(SceneStore &scene, SceneHandle parentNode, AnimationSystem &animation, AsyncLoader &loader,
+                              MeshAttachments &attachments)
+{
+    // The nodes are drawn as soon as the simulation has attached the meshes the loader uploaded
+    SceneHandle heliNode = scene.create(parentNode);
+    SceneHandle doorNode = scene.create(heliNode);
+    SceneHandle tailRotorNode = scene.create(heliNode);
+    scene.setReferencePoint(tailRotorNode, glm::vec3(0.35f, 2.3f, 10.4f));
+    SceneHandle mainRotorNode = scene.create(heliNode);
+    loader.loadHelicopter("../gloom/src/resources/helicopter.obj", attachments, heliNode, doorNode, tailRotorNode, mainRotorNode);
+
+    // The main rotor turns about Y, the tail rotor about X
+    animation.addSpin(mainRotorNode, 0, MAIN_ROTOR_SPEED);
+    animation.addSpin(tailRotorNode, 1, TAIL_ROTOR_SPEED);
 
-void spinEntity(SceneNode* rootNode, float speed, double elapsedTime, bool aboutX)
+    return heliNode;
+}
+
+// Creates the terrain node with the helicopters flying over it, and returns the terrain node
+SceneHandle createSceneGraph(SceneStore &scene, AnimationSystem &animation, AsyncLoader &loader, MeshAttachments &attachments)
 {
-    float step = speed * static_cast<float>(elapsedTime);
-    if (aboutX) {
-        rootNode->rotation.x += step;
-    } else {
-        rootNode->rotation.y += step;
+    // The terrain itself is drawn by a TileManager, the node only places it and its children
+    SceneHandle terrainNode = scene.create();
+
+    for (int i = 0; i < FIGURE_EIGHT_HELI_COUNT; i++) {
+        SceneHandle heliNode = addHelicopterNode(scene, terrainNode, animation, loader, attachments);
+        animation.addFigureEight(heliNode, FIGURE_EIGHT_SIZE, FIGURE_EIGHT_SPEED, HELI_TIME_OFFSET * static_cast<float>(i));
     }
+
+    return terrainNode;
 }
 
-void spinMainRotor(AnimatedNode node, double elapsedTime)
+// Picks the coarsest of lods whose error, projected onto the screen at the distance of
+// boundingSphere, stays below LOD_PIXEL_ERROR. model places the mesh in the world.
+MeshLOD selectLOD(const std::vector<MeshLOD> &lods, const glm::vec4 &boundingSphere, const glm::mat4 &model,
+                  const LODSelection &selection)
 {
-    spinEntity(node.sceneNode, MAIN_ROTOR_SPEED, elapsedTime, true);
+    float scale = std::max(glm::length(glm::vec3(model[0])),
+                           std::max(glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2]))));
+    glm::vec3 centre = glm::vec3(model * glm::vec4(glm::vec3(boundingSphere), 1.0f));
+    float distance = glm::length(centre - selection.cameraPosition) - boundingSphere.w * scale;
+    float pixelsPerUnit = selection.pixelsPerUnit / std::max(distance, Z_NEAR_PLANE);
+
+    size_t level = 0;
+    while (level + 1 < lods.size() && lods[level + 1].error * scale * pixelsPerUnit <= LOD_PIXEL_ERROR) {
+        level++;
+    }
+    return lods[level];
 }
 
-void spinTailRotor(AnimatedNode node, double elapsedTime)
+// Appends the meshes in range of scene whose bounds intersect frustum to draws, with the
+// level of detail to draw them at. The nodes are stored depth first, so a subtree entirely
+// outside the frustum is skipped by jumping to its end. Split nodes only test their own
+// mesh, since the ranges after them take care of their descendants.
+void cullSceneRange(const SceneStore &scene, const SceneRange &range, const Frustum &frustum, const LODSelection &selection,
+                    std::vector<DrawItem> &draws, CullingStats &stats)
 {
-    spinEntity(node.sceneNode, TAIL_ROTOR_SPEED, elapsedTime, false);
+    const std::vector<glm::mat4> &worldMatrices = scene.worldMatrices();
+    const std::vector<std::shared_ptr<GPUMesh>> &meshes = scene.meshes();
+    const std::vector<glm::vec3> &worldBoundsMin = scene.worldBoundsMin();
+    const std::vector<glm::vec3> &worldBoundsMax = scene.worldBoundsMax();
+    const std::vector<glm::vec3> &subtreeBoundsMin = scene.subtreeBoundsMin();
+    const std::vector<glm::vec3> &subtreeBoundsMax = scene.subtreeBoundsMax();
+    const std::vector<unsigned int> &subtreeEnds = scene.subtreeEnds();
+
+    size_t node = range.first;
+    while (node < range.end) {
+        if (!range.split && !boxInFrustum(frustum, subtreeBoundsMin[node], subtreeBoundsMax[node])) {
+            stats.culled += scene.subtreeMeshCounts()[node];
+            node = subtreeEnds[node];
+            continue;
+        }
+
+        const GPUMesh *mesh = meshes[node].get();
+        if (mesh != nullptr) {
+            if (boxInFrustum(frustum, worldBoundsMin[node], worldBoundsMax[node])) {
+                stats.drawn++;
+                MeshLOD lod = selectLOD(mesh->lods, mesh->boundingSphere, worldMatrices[node], selection);
+                draws.push_back(DrawItem{mesh, lod, static_cast<unsigned int>(node)});
+            } else {
+                stats.culled++;
+            }
+        }
+        node++;
+    }
 }
 
-void heliFlyFigureEight(AnimatedNode node, double elapsedTime)
+// Advances the animations by steps steps of stepSeconds, updates the scene and, if cull is
+// set, culls it against frustum on the threads of scheduler, leaving the meshes to draw in
+// work.drawLists.
+//
+// The animation channels are evaluated in batches, each taking its channels through every
+// step, and applied to the scene together, alpha of the way from the second to last step to
+// the last. Then the split
+// nodes of the scene are updated, after which every range is updated and culled on its own.
+// Every task writes to data no other task touches, so the results are the same however the
+// tasks are spread over the threads, and drawing the lists in order draws what a serial walk
+// of the scene would.
+void updateAndCullScene(TaskScheduler &scheduler, FrameWork &work, SceneStore &scene, AnimationSystem &animation,
+                        unsigned int steps, double stepSeconds, float alpha, const Frustum &frustum,
+                        const LODSelection &selection, bool cull)
 {
-    Heading heading = simpleHeadingAnimation(node.time);
-    node.sceneNode->position.x = heading.x;
-    node.sceneNode->position.z = heading.z;
-    node.sceneNode->rotation = glm::vec3(heading.yaw, heading.pitch, heading.roll);
+    // The cut only depends on the structure of the scene, which the tasks leave alone
+    size_t rangeNodes = scene.nodeCount() / (scheduler.threadCount() * SCENE_RANGES_PER_THREAD);
+    scene.partition(static_cast<unsigned int>(std::max<size_t>(rangeNodes, SCENE_RANGE_MIN_NODES)));
+    const std::vector<SceneRange> &ranges = scene.ranges();
+    work.drawLists.resize(ranges.size());
+    for (std::vector<DrawItem> &draws : work.drawLists) {
+        draws.clear();
+    }
+    work.cullingStats.assign(ranges.size(), CullingStats{0, 0});
+
+    TaskGraph &graph = work.graph;
+    graph.clear();
+    TaskGraph::Task start = graph.add([]() { });
+    TaskGraph::Task applyAnimation = graph.add([&, alpha]() { animation.apply(scene, alpha); });
+    // Channels do not depend on each other, so a batch can take its own through every step
+    graph.addBatches(animation.channelCount(), ANIMATION_BATCH_SIZE, [&, steps, stepSeconds](size_t begin, size_t end) {
+        for (unsigned int step = 0; step < steps; step++) {
+            animation.evaluate(begin, end, stepSeconds);
+        }
+    }, start, applyAnimation);
+
+    TaskGraph::Task splitNodes = graph.add([&]() { scene.updateSplitNodes(); });
+    graph.precede(applyAnimation, splitNodes);
+    TaskGraph::Task finish = graph.add([&]() { work.transformStats = scene.finishUpdate(); });
+    for (size_t range = 0; range < ranges.size(); range++) {
+        TaskGraph::Task update = graph.add([&scene, range]() { scene.updateRange(range); });
+        graph.precede(splitNodes, update);
+        graph.precede(update, finish);
+        if (!cull) {
+            continue;
+        }
+        // A range has its boxes once it is updated, the subtree boxes finishUpdate() completes
+        // are only needed by split nodes, which are not culled by subtree
+        TaskGraph::Task cull = graph.add([&, range]() {
+            cullSceneRange(scene, ranges[range], frustum, selection, work.drawLists[range], work.cullingStats[range]);
+        });
+        graph.precede(update, cull);
+    }
+    scheduler.run(graph);
 }
 
-SceneNode * addHelicopterNode(SceneNode *&parentNode, std::vector<AnimatedNode> &animated)
+// Queues the meshes in draws, which refer to the nodes of scene, to be drawn by program
+void queueDraws(const SceneSnapshot &scene, const std::vector<DrawItem> &draws, unsigned int program, RenderQueue &queue)
 {
-    Helicopter heli = loadHelicopterModel("../gloom/src/resources/helicopter.obj");
-    SceneNode* heliNode = createSceneNode();
-    heliNode->vertexArrayObjectID = static_cast<int>(VAOFromMesh(heli.body));
-    heliNode->VAOIndexCount = heli.body.indices.size();
-
-    SceneNode* doorNode = createSceneNode();
-    doorNode->vertexArrayObjectID = static_cast<int>(VAOFromMesh(heli.door));
-    doorNode->VAOIndexCount = heli.door.indices.size();
-
-    SceneNode* tailRotorNode = createSceneNode();
-    tailRotorNode->vertexArrayObjectID = static_cast<int>(VAOFromMesh(heli.tailRotor));
-    tailRotorNode->VAOIndexCount = heli.tailRotor.indices.size();
-    tailRotorNode->referencePoint = glm::vec3(0.35f, 2.3f, 10.4f);
-
-    SceneNode* mainRotorNode = createSceneNode();
-    mainRotorNode->vertexArrayObjectID = static_cast<int>(VAOFromMesh(heli.mainRotor));
-    mainRotorNode->VAOIndexCount = heli.mainRotor.indices.size();
-
-    heliNode->children = {doorNode, tailRotorNode, mainRotorNode};
-
-    AnimatedNode mainRotorAnimatedNode = AnimatedNode{mainRotorNode, 0.0f, spinMainRotor};
-    AnimatedNode tailRotorAnimatedNode = AnimatedNode{tailRotorNode, 0.0f, spinTailRotor};
-    animated.push_back(mainRotorAnimatedNode);
-    animated.push_back(tailRotorAnimatedNode);
-
-    parentNode->children.push_back(heliNode);
-
-    return heliNode;
+    const std::vector<glm::mat4> &worldMatrices = scene.worldMatrices;
+    for (const DrawItem &draw : draws) {
+        queue.push(program, DEFAULT_MATERIAL, *draw.mesh, draw.lod, worldMatrices[draw.node]);
+    }
 }
 
-void createSceneGraph(SceneNode *&rootNode, std::vector<AnimatedNode> &animated)
+// Queues the resident terrain tiles that intersect the view frustum, placed by model, to be
+// drawn by program
+void queueTerrainTiles(const TileManager &tiles, const glm::mat4 &model, const glm::mat4 &viewProjection,
+                       const LODSelection &selection, unsigned int program, RenderQueue &queue, CullingStats &stats)
 {
-    Mesh lunarSurface = loadTerrainMesh("../gloom/src/resources/lunarsurface.obj");
-    SceneNode* terrainNode = createSceneNode();
-    terrainNode->vertexArrayObjectID = static_cast<int>(VAOFromMesh(lunarSurface));
-    terrainNode->VAOIndexCount = lunarSurface.indices.size();
-
-    for (int i = 0; i < FIGURE_EIGHT_HELI_COUNT; i++) {
-        SceneNode * heliNode = addHelicopterNode(terrainNode, animated);
-        AnimatedNode heliAnimatedNode = AnimatedNode{heliNode, HELI_TIME_OFFSET * static_cast<float>(i), heliFlyFigureEight};
-        animated.push_back(heliAnimatedNode);
+    std::vector<const GPUMesh *> visible;
+    tiles.collectVisible(extractFrustum(viewProjection * model), visible);
+    stats.drawn += static_cast<unsigned int>(visible.size());
+    stats.culled += static_cast<unsigned int>(tiles.residentCount() - visible.size());
+    for (const GPUMesh *tile : visible) {
+        MeshLOD lod = selectLOD(tile->lods, tile->boundingSphere, model, selection);
+        queue.push(program, DEFAULT_MATERIAL, *tile, lod, model);
     }
-
-    rootNode = createSceneNode();
-    rootNode->children = {terrainNode};
 }
 
-glm::mat4 rotateAroundPoint(glm::vec3 rot, glm::vec3 referencePoint)
+float control(float x, float ref, float rad, float gain)
 {
-    glm::mat4 identity = glm::mat4(1.0f);
-    glm::mat4 translateFromRef = glm::translate(identity, referencePoint);
-    glm::mat4 rotateX = glm::rotate(rot.x, glm::vec3(0.0f, 1.0f, 0.0f));
-    glm::mat4 rotateY = glm::rotate(rot.y, glm::vec3(1.0f, 0.0f, 0.0f));
-    glm::mat4 rotateZ = glm::rotate(rot.z, glm::vec3(0.0f, 0.0f, 1.0f));
-    glm::mat4 translateToRef = glm::translate(identity, -referencePoint);
-
-    return translateFromRef * rotateZ * rotateY * rotateX * translateToRef;
+    return gain * (x - glm::sign(x - ref) * rad - ref);
 }
 
-void updateSceneNode(SceneNode* sceneNode, glm::mat4 transformationThusFar)
+void chase(Camera &cam, const glm::vec3 &target, float stepSeconds)
 {
-    sceneNode->currentTransformationMatrix =
-            transformationThusFar
-            * glm::translate(sceneNode->position)
-            * rotateAroundPoint(sceneNode->rotation, sceneNode->referencePoint);
+    // The part of the gap closed in one step, so that the camera follows as fast at any step rate
+    float gain = 1.0f - std::exp(-CHASE_SPEED * stepSeconds);
+    cam.x -= control(cam.x, target.x, CHASE_RADIUS, gain);
+    cam.y -= gain * (cam.y - CHASE_RADIUS - target.y);
+    cam.z -= control(cam.z, target.z, CHASE_RADIUS, gain);
+}
 
-    for (SceneNode* childNode : sceneNode->children) {
-        updateSceneNode(childNode, sceneNode->currentTransformationMatrix);
+// Advances state by one step of stepSeconds, moving whatever the keys held down move
+void stepSimulation(InputState keys, SimulationState &state, float stepSeconds)
+{
+    if (state.camera.chase) {
+        handleInputsHeli(keys, state.heliPosition, state.heliRotation, stepSeconds);
+        chase(state.camera, state.heliPosition, stepSeconds);
+    } else {
+        handleInputsCamera(keys, state.camera, stepSeconds);
     }
 }
 
-void drawSceneGraph(SceneNode* sceneNode, glm::mat4 viewProjection, GLint tMatUniformLoc, GLint modelMatUniformLoc)
+// The state alpha of the way from previous to current
+SimulationState interpolateStates(const SimulationState &previous, const SimulationState &current, float alpha)
 {
-    glm::mat4 tMat = viewProjection * sceneNode->currentTransformationMatrix;
-    if (sceneNode->vertexArrayObjectID != -1) {
-        glUniformMatrix4fv(tMatUniformLoc, 1, GL_FALSE, glm::value_ptr(tMat));
-        glUniformMatrix4fv(modelMatUniformLoc, 1, GL_FALSE, glm::value_ptr(sceneNode->currentTransformationMatrix));
-        glBindVertexArray(sceneNode->vertexArrayObjectID);
-        glDrawElements(GL_TRIANGLES, sceneNode->VAOIndexCount, GL_UNSIGNED_INT, nullptr);
-    }
+    SimulationState state = current;
+    state.camera.x = glm::mix(previous.camera.x, current.camera.x, alpha);
+    state.camera.y = glm::mix(previous.camera.y, current.camera.y, alpha);
+    state.camera.z = glm::mix(previous.camera.z, current.camera.z, alpha);
+    state.camera.phi = glm::mix(previous.camera.phi, current.camera.phi, alpha);
+    state.camera.theta = glm::mix(previous.camera.theta, current.camera.theta, alpha);
+    state.camera.psi = glm::mix(previous.camera.psi, current.camera.psi, alpha);
+    state.heliPosition = glm::mix(previous.heliPosition, current.heliPosition, alpha);
+    state.heliRotation = glm::mix(previous.heliRotation, current.heliRotation, alpha);
+    return state;
+}
 
-    for (SceneNode* childNode : sceneNode->children) {
-        drawSceneGraph(childNode, viewProjection, tMatUniformLoc, modelMatUniformLoc);
-    }
+SimulationState initialSimulationState()
+{
+    SimulationState state;
+    state.camera = Camera{1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, false};
+    state.heliPosition = glm::vec3(0.0f, MAIN_HELI_START_HEIGHT, 0.0f);
+    state.heliRotation = glm::vec3(0.0f);
+    return state;
 }
 
-float control(float x, float ref, float rad)
+// View matrix of the camera of state, which looks at the helicopter while it chases it
+glm::mat4 cameraView(const SimulationState &state)
 {
-    return CHASE_SPEED * (x - glm::sign(x - ref) * rad - ref);
+    const Camera &cam = state.camera;
+    if (cam.chase) {
+        return glm::lookAt(glm::vec3(cam.x, cam.y, cam.z), state.heliPosition, glm::vec3(0.0f, 1.0f, 0.0f));
+    }
+    glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(cam.x, cam.y, cam.z));
+    glm::mat4 rotateY = glm::rotate(cam.phi, glm::vec3(0.0f, 1.0f, 0.0f)); // Rotation around y
+    glm::mat4 rotateX = glm::rotate(cam.theta, glm::vec3(1.0f, 0.0f, 0.0f)); // Rotation around x
+    glm::mat4 rotateZ = glm::rotate(cam.psi, glm::vec3(0.0f, 0.0f, 1.0f)); // Rotation around z
+
+    return rotateX * rotateY * rotateZ * translate;
 }
 
-void chase(Camera &cam, const SceneNode *sceneNode)
+// Simulates frames until packets is closed, on a thread of its own, which owns scene and
+// animation while it runs.
+//
+// Every frame waits for a free packet, attaches the meshes uploaded since the frame before,
+// advances the fixed step simulation by the real time that passed with the keys sampled
+// last, and updates and culls the scene as of the interpolated state. The packet is then
+// filled with everything the render thread draws the frame from and published, so that the
+// next frame can be simulated while this one is drawn.
+//
+// Frames advance the simulation by fixedFrameSeconds each if it is positive, rather than by
+// the real time between them. The projection and the levels of detail are for a viewport of
+// viewportWidth by viewportHeight pixels.
+void simulate(FrameQueue &packets, const std::atomic<InputState> &keys, MeshAttachments &attachments,
+              TaskScheduler &scheduler, SceneStore &scene, AnimationSystem &animation, SceneHandle terrainNode,
+              SceneHandle mainHeli, bool cull, double fixedFrameSeconds, int viewportWidth,
+              int viewportHeight)
 {
-    cam.x -= control(cam.x, sceneNode->position.x, CHASE_RADIUS);
-    cam.y -= CHASE_SPEED * (cam.y - CHASE_RADIUS - sceneNode->position.y);
-    cam.z -= control(cam.z, sceneNode->position.z, CHASE_RADIUS);
+    FrameWork frameWork;
+    float aspectRatio = float(viewportWidth) / float(viewportHeight);
+
+    // Simulated in fixed steps, and drawn between the last two of them
+    SimulationState state = initialSimulationState();
+    SimulationState previousState = state;
+    FixedStepClock simulationClock(1.0 / SIMULATION_STEP_HZ, MAX_SIMULATION_STEPS_PER_FRAME);
+
+    while (true) {
+        std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+        FramePacket *packet = packets.waitToPush();
+        if (packet == nullptr) {
+            return;
+        }
+        std::chrono::steady_clock::time_point frameStart = std::chrono::steady_clock::now();
+        attachments.apply(scene);
+
+        // The animations take the same steps on the worker threads, in updateAndCullScene
+        double frameTime = getTimeDeltaSeconds();
+        if (fixedFrameSeconds > 0.0) {
+            frameTime = fixedFrameSeconds;
+        }
+        InputState input = keys.load(std::memory_order_relaxed);
+        unsigned int steps = simulationClock.advance(frameTime);
+        float stepSeconds = float(simulationClock.stepSeconds());
+        for (unsigned int step = 0; step < steps; step++) {
+            previousState = state;
+            stepSimulation(input, state, stepSeconds);
+        }
+        handleInputsOther(input, state.camera);
+        SimulationState drawn = interpolateStates(previousState, state, simulationClock.alpha());
+        scene.setPosition(mainHeli, drawn.heliPosition);
+        scene.setRotation(mainHeli, drawn.heliRotation);
+
+        glm::mat4 viewMatrix = cameraView(drawn);
+        glm::mat4 perspective = glm::perspective(glm::radians(FOV), aspectRatio, Z_NEAR_PLANE, Z_FAR_PLANE);
+        glm::mat4 tMat = perspective * viewMatrix;
+        LODSelection lodSelection;
+        lodSelection.cameraPosition = glm::vec3(glm::inverse(viewMatrix)[3]);
+        lodSelection.pixelsPerUnit = float(viewportHeight) / (2.0f * std::tan(glm::radians(FOV) / 2.0f));
+
+        updateAndCullScene(scheduler, frameWork, scene, animation, steps, simulationClock.stepSeconds(),
+                           simulationClock.alpha(), extractFrustum(tMat), lodSelection, cull);
+
+        packet->viewProjection = tMat;
+        packet->lodSelection = lodSelection;
+        packet->terrainModel = scene.worldMatrix(terrainNode);
+        scene.snapshot(packet->scene);
+        scene.takeReleasedMeshes(packet->releasedMeshes);
+        // The lists the packet had before are cleared and refilled by the next frame
+        packet->drawLists.swap(frameWork.drawLists);
+        packet->cullingStats = CullingStats{0, 0};
+        for (const CullingStats &stats : frameWork.cullingStats) {
+            packet->cullingStats.drawn += stats.drawn;
+            packet->cullingStats.culled += stats.culled;
+        }
+        packet->transformStats = frameWork.transformStats;
+        packet->stepCount = simulationClock.stepCount();
+        packet->droppedSeconds = simulationClock.droppedSeconds();
+        packet->inputTime = frameStart;
+        std::chrono::steady_clock::time_point frameEnd = std::chrono::steady_clock::now();
+        packet->simulationSeconds = std::chrono::duration<double>(frameEnd - frameStart).count();
+        packet->waitSeconds = std::chrono::duration<double>(frameStart - waitStart).count();
+        packets.push();
+    }
 }
 
-void runProgram(GLFWwindow* window)
+// Closes the frame queue and waits for the simulation thread however runProgram is left, so
+// that the thread never outlives the scene it updates
+struct SimulationThreadGuard {
+    FrameQueue &packets;
+    std::thread &thread;
+
+    ~SimulationThreadGuard() {
+        packets.close();
+        if (thread.joinable()) {
+            thread.join();
+        }
+    }
+};
+
+int runProgram(GLFWwindow* window, const ProgramOptions &options)
 {
+    // A headless run has no window to draw to, a surfaceless context not even a default framebuffer
+    std::unique_ptr<OffscreenTarget> offscreen;
+    if (options.headless) {
+        offscreen.reset(new OffscreenTarget(options.width, options.height));
+        offscreen->bind();
+        printf("[INFO] drawing %u frames of %dx%d offscreen\n", options.frameCount, options.width, options.height);
+    }
+    // Frames are projected for the size they are drawn at, so none of them is stretched
+    int viewportWidth = options.headless ? options.width : windowWidth;
+    int viewportHeight = options.headless ? options.height : windowHeight;
+
     // Enable depth (Z) buffer (GL_LESS = accept "closest" fragment)
     glEnable(GL_DEPTH_TEST);
 
@@ -172,61 +445,247 @@ void runProgram(GLFWwindow* window)
     // Fix these dumb paths some time
     shader.makeBasicShader("../gloom/shaders/simple.vert",
                            "../gloom/shaders/simple.frag");
+    Gloom::Shader instancedShader;
+    instancedShader.makeBasicShader("../gloom/shaders/simple_instanced.vert",
+                                    "../gloom/shaders/simple.frag");
+
+    VertexFormat vertexFormat = COMPACT_VERTICES ? VertexFormat::compact() : VertexFormat::full();
+    bool gpuDriven = options.scenePath == ScenePath::GPUDriven && GPUSceneRenderer::supported();
+    if (options.scenePath == ScenePath::GPUDriven && !gpuDriven) {
+        printf("[WARNING] the context lacks GL_ARB_shader_draw_parameters, culling the scene on the CPU instead\n");
+    }
+    bool instanced = !gpuDriven && options.scenePath != ScenePath::Queued;
+    if (options.scenePath == ScenePath::Queued) {
+        printf("[INFO] drawing the scene through the render queue, one draw call per node\n");
+    }
+    // Declared before the loader, whose uploads copy the helicopter parts into it
+    std::unique_ptr<MeshArena> meshArena;
+    std::unique_ptr<GPUSceneRenderer> gpuRenderer;
+    if (gpuDriven) {
+        meshArena.reset(new MeshArena(vertexFormat));
+        gpuRenderer.reset(new GPUSceneRenderer("../gloom/shaders/cull.comp", "../gloom/shaders/simple_indirect.vert",
+                                               "../gloom/shaders/simple.frag", LOD_PIXEL_ERROR, Z_NEAR_PLANE));
+        printf("[INFO] culling the scene on the GPU, %s\n", gpuRenderer->usesDrawCount()
+               ? "drawing it with glMultiDrawElementsIndirectCount" : "drawing it with glMultiDrawElementsIndirect");
+    }
 
-    SceneNode* sceneGraph = nullptr;
-    std::vector<AnimatedNode> animatedNodes;
-    createSceneGraph(sceneGraph, animatedNodes);
-    SceneNode* mainHeli = addHelicopterNode(sceneGraph, animatedNodes);
-    mainHeli->position.y = MAIN_HELI_START_HEIGHT;
+    // Declared before the registry, whose upload callbacks add to it
+    MeshAttachments meshAttachments;
+    AssetRegistry assets;
+    AsyncLoader loader(assets, vertexFormat, ASSET_LOADER_WORKERS, UPLOAD_QUEUE_CAPACITY, LOADER_THREADS);
+    // Every mesh in the scene comes from loadHelicopter, so the arena ends up with all of them
+    loader.setMeshArena(meshArena.get());
+    std::chrono::steady_clock::time_point loadStart = std::chrono::steady_clock::now();
+    bool assetsResident = false;
 
-    GLint tMatUniformLoc = shader.getUniformLocation("t_mat");
-    GLint modelMatUniformLoc = shader.getUniformLocation("model_mat");
-    if (tMatUniformLoc == -1 || modelMatUniformLoc == -1) {
+    TileManager terrainTiles(loader, "../gloom/src/resources/lunarsurface.obj", TERRAIN_TILES_PER_SIDE, LOADER_THREADS,
+                             size_t(TERRAIN_TILE_BUDGET_MB) * 1024 * 1024, TERRAIN_STREAM_RADIUS);
+
+    SceneStore scene;
+    AnimationSystem animation;
+    SceneHandle terrainNode = createSceneGraph(scene, animation, loader, meshAttachments);
+    SceneHandle mainHeli = addHelicopterNode(scene, SceneHandle(), animation, loader, meshAttachments);
+
+    TaskScheduler scheduler(FRAME_WORKER_THREADS);
+    printf("[INFO] animating, updating and culling the scene on %u threads\n", scheduler.threadCount());
+
+    if (glGetUniformBlockIndex(shader.get(), "Transforms") == GL_INVALID_INDEX) {
+        throw std::runtime_error("Could not find the Transforms uniform block");
+    }
+    GLint instanceOffsetUniformLoc = instancedShader.getUniformLocation("instance_offset");
+    if (instanceOffsetUniformLoc == -1) {
         throw std::runtime_error("Could not find uniform locations");
     }
+    InstancedRenderer instancedRenderer;
+    RenderQueue renderQueue;
+    unsigned int basicProgram = renderQueue.addProgram(shader.get());
+
+    if (options.headless) {
+        // What the frames show must not depend on how fast assets load, so everything around
+        // the starting point is resident before the first frame is simulated. Nothing moves
+        // the camera in a headless run, so nothing else is loaded later.
+        scene.update();
+        glm::vec3 cameraPosition = glm::vec3(glm::inverse(cameraView(initialSimulationState()))[3]);
+        glm::vec3 terrainCamera = glm::vec3(glm::inverse(scene.worldMatrix(terrainNode)) * glm::vec4(cameraPosition, 1.0f));
+        // The tile manager only has so many loads pending at once, so it is asked again
+        // until it has nothing left to request
+        while (true) {
+            terrainTiles.update(terrainCamera);
+            if (loader.idle()) {
+                break;
+            }
+            loader.processUploads(UPLOAD_BUDGET_SECONDS);
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+    // From here on the scene and the animations belong to the simulation thread, which hands
+    // every frame over through the queue. This thread keeps the GL context and the window.
+    FrameQueue packets(options.frameQueueDepth);
+    std::atomic<InputState> keys(0);
+    std::exception_ptr simulationError;
+    std::thread simulationThread([&]() {
+        try {
+            simulate(packets, keys, meshAttachments, scheduler, scene, animation, terrainNode, mainHeli, !gpuDriven,
+                     options.headless ? HEADLESS_FRAME_SECONDS : 0.0, viewportWidth, viewportHeight);
+        } catch (...) {
+            simulationError = std::current_exception();
+            packets.close();
+        }
+    });
+    SimulationThreadGuard simulationGuard = { packets, simulationThread };
+    printf("[INFO] simulating %.0f steps per second on a thread of its own, up to %u frames ahead of drawing\n",
+           SIMULATION_STEP_HZ, options.frameQueueDepth);
+
+    // Frames drawn since the last report, and how long they took to get through the pipeline
+    std::chrono::steady_clock::time_point reportStart = std::chrono::steady_clock::now();
+    unsigned int reportFrames = 0;
+    double latencySum = 0.0;
+    double latencyMax = 0.0;
+    double simulationSeconds = 0.0;
+    double simulationWaitSeconds = 0.0;
+    double renderWaitSeconds = 0.0;
+    // Totals of a headless run
+    std::chrono::steady_clock::time_point runStart = std::chrono::steady_clock::now();
+    unsigned int framesDrawn = 0;
+    unsigned int failedFrames = 0;
 
-    Camera cam = Camera{1.0f, 1.0f, -1.0f, 0.0f, 0.0f, 0.0f, false};
     // Rendering Loop
-    while (!glfwWindowShouldClose(window)) {
+    while (!glfwWindowShouldClose(window) && (!options.headless || framesDrawn < options.frameCount)) {
         // Clear colour and depth buffers
         glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
-        glm::mat4 viewMatrix;
-        if (cam.chase) {
-            viewMatrix = glm::lookAt(glm::vec3(cam.x, cam.y, cam.z), mainHeli->position, glm::vec3(0.0f, 1.0f, 0.0f));
-            handleInputsHeli(window, mainHeli);
-            chase(cam, mainHeli);
-        } else {
-            handleInputsCamera(window, cam);
-            glm::mat4 translate = glm::translate(glm::mat4(1.0f), glm::vec3(cam.x, cam.y, cam.z));
-            glm::mat4 rotateY = glm::rotate(cam.phi, glm::vec3(0.0f, 1.0f, 0.0f)); // Rotation around y
-            glm::mat4 rotateX = glm::rotate(cam.theta, glm::vec3(1.0f, 0.0f, 0.0f)); // Rotation around x
-            glm::mat4 rotateZ = glm::rotate(cam.psi, glm::vec3(0.0f, 0.0f, 1.0f)); // Rotation around z
+        // Upload the meshes that finished loading, the simulation attaches them to their nodes
+        loader.processUploads(UPLOAD_BUDGET_SECONDS);
 
-            viewMatrix = rotateX * rotateY * rotateZ * translate;
+        std::chrono::steady_clock::time_point waitStart = std::chrono::steady_clock::now();
+        FramePacket *packet = packets.waitForFront();
+        if (packet == nullptr) {
+            // Only the simulation thread closes the queue while this loop runs, when it fails
+            break;
+        }
+        renderWaitSeconds += std::chrono::duration<double>(std::chrono::steady_clock::now() - waitStart).count();
+
+        const glm::mat4 &tMat = packet->viewProjection;
+        const LODSelection &lodSelection = packet->lodSelection;
+        terrainTiles.update(glm::vec3(glm::inverse(packet->terrainModel) * glm::vec4(lodSelection.cameraPosition, 1.0f)));
+        CullingStats cullingStats = packet->cullingStats;
+        // Everything drawn one mesh at a time is collected first, so that the queue can order
+        // it by the state it needs before anything is bound
+        renderQueue.begin(tMat, lodSelection.cameraPosition, Z_FAR_PLANE);
+        queueTerrainTiles(terrainTiles, packet->terrainModel, tMat, lodSelection, basicProgram, renderQueue, cullingStats);
+        if (!gpuDriven && !instanced) {
+            for (const std::vector<DrawItem> &draws : packet->drawLists) {
+                queueDraws(packet->scene, draws, basicProgram, renderQueue);
+            }
         }
 
-        glm::mat4 perspective = glm::perspective(glm::radians(FOV), ASPECT_RATIO, Z_NEAR_PLANE, Z_FAR_PLANE);
-        glm::mat4 tMat = perspective * viewMatrix;
-        shader.activate();
+        // All GL calls for the scene are made here, on this thread
+        RenderQueueStats queueStats = renderQueue.submit();
+        // Every queued mesh takes a draw call of its own
+        unsigned int drawCalls = queueStats.draws;
+        if (gpuDriven) {
+            gpuRenderer->draw(packet->scene, *meshArena, tMat, lodSelection);
+            drawCalls += gpuRenderer->objectCount() > 0 ? 1 : 0;
+        } else if (instanced) {
+            instancedShader.activate();
+            drawCalls += instancedRenderer.draw(packet->scene, packet->drawLists, tMat, instanceOffsetUniformLoc);
+        }
 
-        double elapsedTime = getTimeDeltaSeconds();
-        for (AnimatedNode &node : animatedNodes) {
-            node.time += elapsedTime;
-            node.update(node, elapsedTime);
+        std::chrono::steady_clock::time_point drawEnd = std::chrono::steady_clock::now();
+        double latency = std::chrono::duration<double>(drawEnd - packet->inputTime).count();
+        reportFrames++;
+        latencySum += latency;
+        latencyMax = std::max(latencyMax, latency);
+        simulationSeconds += packet->simulationSeconds;
+        simulationWaitSeconds += packet->waitSeconds;
+
+        double reportTime = std::chrono::duration<double>(drawEnd - reportStart).count();
+        if (reportTime >= CULLING_REPORT_SECONDS) {
+            if (gpuDriven) {
+                // Only read back for the report, since it waits for the GPU to finish culling
+                unsigned int gpuDrawn = gpuRenderer->readDrawCount();
+                cullingStats.drawn += gpuDrawn;
+                cullingStats.culled += gpuRenderer->objectCount() - gpuDrawn;
+            }
+            printf("[INFO] drew %u meshes in %u draw calls, culled %u\n", cullingStats.drawn, drawCalls, cullingStats.culled);
+            printf("[INFO] recomputed %u world matrices, reused %u\n", packet->transformStats.recomputed,
+                   packet->transformStats.skipped);
+            printf("[INFO] render queue made %u program and %u vertex array binds for %u draws, skipped %u redundant binds\n",
+                   queueStats.programBinds, queueStats.vertexArrayBinds, queueStats.draws, queueStats.skippedBinds);
+            printf("[INFO] %u frames so far waited for the GPU to release their uniforms\n", queueStats.stalledFrames);
+            printf("[INFO] simulated %llu steps so far, dropped %.2f s of frames too slow to catch up\n",
+                   packet->stepCount, packet->droppedSeconds);
+            printf("[INFO] drew %.1f frames per second %u frames behind the simulation at most, %.1f ms from input to draw "
+                   "on average, %.1f ms at most\n", double(reportFrames) / reportTime, options.frameQueueDepth,
+                   latencySum * 1000.0 / reportFrames, latencyMax * 1000.0);
+            printf("[INFO] frames took %.2f ms to simulate after waiting %.2f ms for a free packet, drawing waited %.2f ms "
+                   "for them\n", simulationSeconds * 1000.0 / reportFrames, simulationWaitSeconds * 1000.0 / reportFrames,
+                   renderWaitSeconds * 1000.0 / reportFrames);
+            reportStart = drawEnd;
+            reportFrames = 0;
+            latencySum = 0.0;
+            latencyMax = 0.0;
+            simulationSeconds = 0.0;
+            simulationWaitSeconds = 0.0;
+            renderWaitSeconds = 0.0;
+        }
+        // Everything the frame needed has been copied to GL buffers, so the simulation may
+        // refill the packet while the frame is presented. Meshes have to go on this thread.
+        packet->releasedMeshes.clear();
+        packets.pop();
+
+        bool failed = false;
+        if (offscreen && !options.outputDirectory.empty()) {
+            char name[32];
+            snprintf(name, sizeof(name), "/frame_%06u.png", framesDrawn);
+            if (!offscreen->writePNG(options.outputDirectory + name)) {
+                fprintf(stderr, "Could not write %s%s\n", options.outputDirectory.c_str(), name);
+                failed = true;
+            }
+        }
+        framesDrawn++;
+
+        // Checked after the tile manager had its chance to request the tiles around the camera
+        if (!assetsResident && loader.idle()) {
+            assetsResident = true;
+            double loadTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - loadStart).count();
+            printf("[INFO] all assets resident after %.1f ms, %zu meshes taking %.1f MB on the GPU, peak resident %.1f MB\n",
+                   loadTime * 1000.0, assets.residentCount(), double(assets.residentBytes()) / (1024.0 * 1024.0),
+                   double(peakResidentBytes()) / (1024.0 * 1024.0));
+            printf("[INFO] %zu of %zu terrain tiles resident, taking %.1f MB\n", terrainTiles.residentCount(),
+                   terrainTiles.tileCount(), double(terrainTiles.residentBytes()) / (1024.0 * 1024.0));
         }
-        updateSceneNode(sceneGraph, glm::mat4(1.0f));
-        drawSceneGraph(sceneGraph, tMat, tMatUniformLoc, modelMatUniformLoc);
 
         shader.deactivate();
-        printGLError();
+        if (printGLError()) {
+            failed = true;
+        }
+        failedFrames += failed ? 1 : 0;
 
-        // Handle other events
+        // Handle other events, and hand the keys held down to the simulation
         glfwPollEvents();
-        handleInputsOther(window, cam);
+        keys.store(sampleInputs(window), std::memory_order_relaxed);
+        handleInputsWindow(window);
 
-        // Flip buffers
-        glfwSwapBuffers(window);
+        // Flip buffers, of which a headless run has none
+        if (!options.headless) {
+            glfwSwapBuffers(window);
+        }
+    }
+    packets.close();
+    simulationThread.join();
+    if (simulationError) {
+        std::rethrow_exception(simulationError);
     }
     shader.destroy();
+    instancedShader.destroy();
+
+    if (!options.headless) {
+        return EXIT_SUCCESS;
+    }
+    double runTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - runStart).count();
+    printf("[INFO] drew %u frames headless in %.2f s, %.1f frames per second, %u of them failed\n", framesDrawn, runTime,
+           double(framesDrawn) / runTime, failedFrames);
+    return framesDrawn == options.frameCount && failedFrames == 0 ? EXIT_SUCCESS : EXIT_FAILURE;
 }
@@ -6,8 +6,16 @@
 // System headers
 #include <GLFW/glfw3.h>
 #include <glad/glad.h>
+#include <chrono>
+#include <memory>
 #include <string>
-#include <lib/sceneGraph.hpp>
+#include <vector>
+#include <lib/animation.hpp>
+#include <lib/mesh.hpp>
+#include <lib/sceneStore.hpp>
+#include <lib/taskScheduler.hpp>
+
+struct GPUMesh;
 
 
 typedef struct Camera {
@@ -20,20 +28,103 @@ typedef struct Camera {
     bool chase;
 } Camera;
 
-typedef struct AnimatedNode
-{
-    SceneNode* sceneNode;
-    double time;
-    void (*update)(AnimatedNode node, double addedTime);
-} AnimatedNode;
+// What the fixed simulation steps advance besides the animation channels: the camera, and
+// the helicopter flown with the keyboard while the camera chases it
+typedef struct SimulationState {
+    Camera camera;
+    glm::vec3 heliPosition;
+    glm::vec3 heliRotation;
+} SimulationState;
+
+// What drawScene needs to know to pick a level of detail for every node
+typedef struct LODSelection {
+    glm::vec3 cameraPosition;
+    // Height in pixels of something one unit tall, one unit in front of the camera
+    float pixelsPerUnit;
+} LODSelection;
+
+// Meshes drawn and meshes skipped by frustum culling in one frame
+typedef struct CullingStats {
+    unsigned int drawn;
+    unsigned int culled;
+} CullingStats;
+
+// Mesh of a node that survived culling, and the level of detail to draw it at
+typedef struct DrawItem {
+    const GPUMesh *mesh;
+    MeshLOD lod;
+    unsigned int node;
+} DrawItem;
+
+// The part of a frame that runs on the threads of a TaskScheduler, and what it leaves for
+// the FramePacket of the frame. Kept between frames to reuse the allocations.
+typedef struct FrameWork {
+    TaskGraph graph;
+    // One draw list per scene range, in the order of the ranges
+    std::vector<std::vector<DrawItem>> drawLists;
+    std::vector<CullingStats> cullingStats;
+    SceneUpdateStats transformStats;
+} FrameWork;
+
+// One frame as the simulation thread leaves it for the render thread: the camera, the scene
+// as of the frame and what survived culling it. Packets go round a queue and are refilled
+// frame after frame, so their vectors keep their allocations.
+typedef struct FramePacket {
+    glm::mat4 viewProjection;
+    LODSelection lodSelection;
+    glm::mat4 terrainModel;
+    SceneSnapshot scene;
+    // As in FrameWork, empty lists when the scene is culled on the GPU
+    std::vector<std::vector<DrawItem>> drawLists;
+    CullingStats cullingStats;
+    SceneUpdateStats transformStats;
+    // Meshes the scene let go of while the frame was simulated. None of them is drawn by this
+    // packet, and the packets before it that may draw them are drawn first, so the render
+    // thread drops them, on the GL thread, once it has drawn this one.
+    std::vector<std::shared_ptr<GPUMesh>> releasedMeshes;
+    // Simulation clock totals as of the frame
+    unsigned long long stepCount;
+    double droppedSeconds;
+    // When the simulation read the keys the frame was simulated with
+    std::chrono::steady_clock::time_point inputTime;
+    // Time the simulation thread spent on the frame, and spent waiting for the packet before
+    double simulationSeconds;
+    double waitSeconds;
+} FramePacket;
+
+// How the scene nodes are drawn. Queued sends every node through the render queue with a
+// draw call of its own, Instanced draws each mesh and level of detail with one instanced
+// call, and GPUDriven culls the scene on the GPU and draws it with one multi-draw call,
+// falling back to Instanced where the context does not support it.
+enum class ScenePath {
+    Queued,
+    Instanced,
+    GPUDriven
+};
+
+// Settings of runProgram given on the command line
+typedef struct ProgramOptions {
+    // Frames the simulation thread may be ahead of the frame being drawn, at least 1
+    unsigned int frameQueueDepth;
+    ScenePath scenePath;
+    // Draw frameCount frames into an offscreen framebuffer of width by height instead of the
+    // window, with the simulation clock stepping by the same time every frame, then return.
+    // Every frame is written as a PNG to outputDirectory, which has to exist, unless it is empty.
+    bool headless;
+    int width;
+    int height;
+    unsigned int frameCount;
+    std::string outputDirectory;
+} ProgramOptions;
 
-// Main OpenGL program
-void runProgram(GLFWwindow* window);
+// Main OpenGL program. Returns the status to exit with, which for a headless run is
+// EXIT_FAILURE if a frame could not be written or raised an OpenGL error.
+int runProgram(GLFWwindow* window, const ProgramOptions &options);
 
 
 // Checks for whether an OpenGL error occurred. If one did,
-// it prints out the error type and ID
-inline void printGLError() {
+// it prints out the error type and ID, and returns true
+inline bool printGLError() {
     int errorID = glGetError();
 
     if(errorID != GL_NO_ERROR) {
@@ -65,7 +156,9 @@ inline void printGLError() {
 
         fprintf(stderr, "An OpenGL error occurred (%i): %s.\n",
                 errorID, errorString.c_str());
+        return true;
     }
+    return false;
 }
 
 
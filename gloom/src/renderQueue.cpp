@@ -0,0 +1,141 @@
+#include <algorithm>
+#include "renderQueue.hpp"
+#include "vao.hpp"
+
+#define SORT_KEY_DEPTH_SHIFT 0
+#define SORT_KEY_VERTEX_ARRAY_SHIFT (SORT_KEY_DEPTH_SHIFT + SORT_KEY_DEPTH_BITS)
+#define SORT_KEY_MATERIAL_SHIFT (SORT_KEY_VERTEX_ARRAY_SHIFT + SORT_KEY_VERTEX_ARRAY_BITS)
+#define SORT_KEY_PROGRAM_SHIFT (SORT_KEY_MATERIAL_SHIFT + SORT_KEY_MATERIAL_BITS)
+
+// Bits sorted by each radix sort pass
+#define RADIX_BITS 8
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+
+static uint64_t keyField(unsigned int value, unsigned int bits, unsigned int shift)
+{
+    // Values too large for their field wrap around. That only makes the order less ideal,
+    // since submit() compares the actual state before binding anything.
+    return (uint64_t(value) & ((uint64_t(1) << bits) - 1)) << shift;
+}
+
+RenderQueue::RenderQueue()
+    : mTransforms(INITIAL_QUEUED_DRAWS * sizeof(DrawTransforms)),
+      mViewProjection(1.0f),
+      mCameraPosition(0.0f),
+      mFarPlane(1.0f) {
+}
+
+unsigned int RenderQueue::addProgram(GLuint program) {
+    mPrograms.push_back(program);
+    return unsigned(mPrograms.size() - 1);
+}
+
+void RenderQueue::begin(const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, float farPlane) {
+    mViewProjection = viewProjection;
+    mCameraPosition = cameraPosition;
+    mFarPlane = farPlane;
+    mDraws.clear();
+    mSorted.clear();
+}
+
+void RenderQueue::push(unsigned int program, unsigned int material, const GPUMesh &mesh, const MeshLOD &lod,
+                       const glm::mat4 &model) {
+    Draw draw;
+    draw.program = program;
+    draw.vertexArray = mesh.vertexArrayObjectID;
+    draw.shortIndices = mesh.shortIndices;
+    draw.lod = lod;
+    // Dequantisation only applies to positions, normals just need the model matrix
+    draw.transforms.tMat = mViewProjection * model * mesh.positionTransform;
+    draw.transforms.model = model;
+
+    glm::vec3 centre = glm::vec3(model * glm::vec4(glm::vec3(mesh.boundingSphere), 1.0f));
+    float depth = std::min(glm::length(centre - mCameraPosition) / mFarPlane, 1.0f);
+    unsigned int depthBucket = unsigned(depth * float((1u << SORT_KEY_DEPTH_BITS) - 1));
+
+    SortEntry entry;
+    entry.key = keyField(program, SORT_KEY_PROGRAM_BITS, SORT_KEY_PROGRAM_SHIFT)
+              | keyField(material, SORT_KEY_MATERIAL_BITS, SORT_KEY_MATERIAL_SHIFT)
+              | keyField(draw.vertexArray, SORT_KEY_VERTEX_ARRAY_BITS, SORT_KEY_VERTEX_ARRAY_SHIFT)
+              | keyField(depthBucket, SORT_KEY_DEPTH_BITS, SORT_KEY_DEPTH_SHIFT);
+    entry.draw = unsigned(mDraws.size());
+    mDraws.push_back(draw);
+    mSorted.push_back(entry);
+}
+
+void RenderQueue::radixSort() {
+    if (mSorted.size() < 2) {
+        return;
+    }
+    // Bytes where every key agrees do not change the order, so their passes are skipped
+    uint64_t allOnes = ~uint64_t(0);
+    uint64_t allZeros = 0;
+    for (const SortEntry &entry : mSorted) {
+        allOnes &= entry.key;
+        allZeros |= entry.key;
+    }
+    uint64_t varying = allOnes ^ allZeros;
+
+    mScratch.resize(mSorted.size());
+    size_t counts[RADIX_BUCKETS];
+    for (unsigned int shift = 0; shift < 64; shift += RADIX_BITS) {
+        if (((varying >> shift) & (RADIX_BUCKETS - 1)) == 0) {
+            continue;
+        }
+        std::fill(counts, counts + RADIX_BUCKETS, 0);
+        for (const SortEntry &entry : mSorted) {
+            counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++;
+        }
+        size_t offset = 0;
+        for (size_t bucket = 0; bucket < RADIX_BUCKETS; bucket++) {
+            size_t count = counts[bucket];
+            counts[bucket] = offset;
+            offset += count;
+        }
+        for (const SortEntry &entry : mSorted) {
+            mScratch[counts[(entry.key >> shift) & (RADIX_BUCKETS - 1)]++] = entry;
+        }
+        mSorted.swap(mScratch);
+    }
+}
+
+RenderQueueStats RenderQueue::submit() {
+    RenderQueueStats stats = RenderQueueStats{ 0, 0, 0, 0, 0 };
+    radixSort();
+    mTransforms.beginFrame(mSorted.size() * mTransforms.sliceSize(sizeof(DrawTransforms)));
+
+    // Whatever was bound before is unknown, so the first draw always binds both
+    bool first = true;
+    GLuint boundProgram = 0;
+    unsigned int boundVertexArray = 0;
+    for (const SortEntry &entry : mSorted) {
+        const Draw &draw = mDraws[entry.draw];
+        GLuint program = mPrograms[draw.program];
+        if (first || boundProgram != program) {
+            glUseProgram(program);
+            stats.programBinds++;
+        } else {
+            stats.skippedBinds++;
+        }
+        if (first || boundVertexArray != draw.vertexArray) {
+            glBindVertexArray(draw.vertexArray);
+            stats.vertexArrayBinds++;
+        } else {
+            stats.skippedBinds++;
+        }
+        boundProgram = program;
+        boundVertexArray = draw.vertexArray;
+        first = false;
+
+        GLintptr offset = mTransforms.write(&draw.transforms, sizeof(DrawTransforms));
+        glBindBufferRange(GL_UNIFORM_BUFFER, TRANSFORM_BLOCK_BINDING, mTransforms.buffer(), offset,
+                          GLsizeiptr(sizeof(DrawTransforms)));
+        size_t indexSize = draw.shortIndices ? sizeof(unsigned short) : sizeof(unsigned int);
+        glDrawElements(GL_TRIANGLES, draw.lod.indexCount, draw.shortIndices ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT,
+                       reinterpret_cast<const void *>(draw.lod.indexOffset * indexSize));
+        stats.draws++;
+    }
+    mTransforms.endFrame();
+    stats.stalledFrames = mTransforms.stalledFrames();
+    return stats;
+}
@@ -0,0 +1,108 @@
+#ifndef GLOOM_RENDER_QUEUE_HPP
+#define GLOOM_RENDER_QUEUE_HPP
+
+#include <cstdint>
+#include <vector>
+#include <glad/glad.h>
+#include <glm/mat4x4.hpp>
+#include <lib/mesh.hpp>
+#include "uniformRing.hpp"
+
+struct GPUMesh;
+
+// Bits of a RenderQueue sort key given to each part, from the most significant down. Draws
+// are grouped by program first, then by material and vertex array, and go front to back
+// within a group.
+#define SORT_KEY_PROGRAM_BITS 8
+#define SORT_KEY_MATERIAL_BITS 12
+#define SORT_KEY_VERTEX_ARRAY_BITS 24
+#define SORT_KEY_DEPTH_BITS 20
+
+// Uniform block binding the Transforms of each draw are read from, see simple.vert
+#define TRANSFORM_BLOCK_BINDING 0
+// Draws the uniform ring starts out with room for, before their slices are padded to the
+// offset alignment. It grows whenever a frame needs more.
+#define INITIAL_QUEUED_DRAWS 1024
+
+// Uniforms of one draw, laid out like the Transforms block in simple.vert
+struct DrawTransforms {
+    glm::mat4 tMat;
+    glm::mat4 model;
+};
+
+// GL state a RenderQueue changed in one submit(), and the draws it made
+struct RenderQueueStats {
+    unsigned int draws;
+    unsigned int programBinds;
+    unsigned int vertexArrayBinds;
+    // Binds left out because the state was already set
+    unsigned int skippedBinds;
+    // Frames so far that waited for the GPU before writing their uniforms
+    unsigned int stalledFrames;
+};
+
+// Collects the draws of a frame and submits them in an order that changes as little GL state
+// as possible.
+//
+// push() only records a draw, together with a 64-bit sort key packing its program, material,
+// vertex array and depth bucket, so collecting does not touch GL at all. submit() then radix
+// sorts the keys and makes the draws in key order, binding a program or vertex array only
+// when it differs from the one bound before. The sort is stable, so draws with equal keys
+// keep the order they were pushed in.
+//
+// The matrices of every draw are written in that order to a UniformRing, and each draw binds
+// its slice to TRANSFORM_BLOCK_BINDING, instead of setting loose uniforms.
+//
+// Must be created and submitted on the GL thread.
+class RenderQueue {
+public:
+    RenderQueue();
+
+    // Adds a program draws can use and returns its index for push(). The program has to read
+    // its matrices from a Transforms block like simple.vert.
+    unsigned int addProgram(GLuint program);
+
+    // Drops the draws of the previous frame. Depth buckets measure the distance from
+    // cameraPosition up to farPlane, everything beyond shares the last bucket.
+    void begin(const glm::mat4 &viewProjection, const glm::vec3 &cameraPosition, float farPlane);
+
+    // Queues lod of mesh, placed in the world by model, to be drawn by program. material
+    // only orders the draws for now, since there are no material bindings to switch yet.
+    void push(unsigned int program, unsigned int material, const GPUMesh &mesh, const MeshLOD &lod, const glm::mat4 &model);
+
+    // Sorts the queued draws and makes them. Leaves the last program and vertex array bound.
+    RenderQueueStats submit();
+
+    size_t size() const { return mDraws.size(); }
+
+private:
+    struct Draw {
+        unsigned int program;
+        unsigned int vertexArray;
+        bool shortIndices;
+        MeshLOD lod;
+        DrawTransforms transforms;
+    };
+
+    // Sort key of a draw and its index in mDraws
+    struct SortEntry {
+        uint64_t key;
+        unsigned int draw;
+    };
+
+    // Sorts mSorted by key, least significant byte first, skipping bytes all keys share
+    void radixSort();
+
+    std::vector<GLuint> mPrograms;
+    UniformRing mTransforms;
+    glm::mat4 mViewProjection;
+    glm::vec3 mCameraPosition;
+    float mFarPlane;
+
+    // Kept between frames to reuse the allocations
+    std::vector<Draw> mDraws;
+    std::vector<SortEntry> mSorted;
+    std::vector<SortEntry> mScratch;
+};
+
+#endif //GLOOM_RENDER_QUEUE_HPP
@@ -0,0 +1,163 @@
+#include <algorithm>
+#include <cstdio>
+#include <utility>
+#include <lib/terrainTiles.hpp>
+#include "tileManager.hpp"
+
+// Tiles being loaded at the same time. Keeps the nearest tiles from queueing up behind far ones
+// when the camera moves quickly.
+#define TILE_MAX_PENDING_LOADS 4
+
+TileManager::TileManager(AsyncLoader &loader, std::string const &srcFile, unsigned int tilesPerSide,
+                         unsigned int parseThreads, size_t budgetBytes, float streamRadius)
+    : mLoader(loader),
+      mSrcFile(srcFile),
+      mBudgetBytes(budgetBytes),
+      mStreamRadius(streamRadius),
+      mResidentBytes(0),
+      mPendingBytes(0),
+      mPendingCount(0),
+      mFrame(0),
+      mBudgetWarned(false)
+{
+    mLoader.submit([this, srcFile, tilesPerSide, parseThreads]() {
+        std::shared_ptr<MeshCache> cache = std::make_shared<MeshCache>();
+        openTerrainTileCache(*cache, srcFile, tilesPerSide, parseThreads);
+        mLoader.queueUpload([this, cache]() { tilesOpened(cache); });
+    });
+}
+
+void TileManager::tilesOpened(const std::shared_ptr<MeshCache> &cache)
+{
+    mCache = cache;
+    const VertexFormat &format = mLoader.format();
+    const std::vector<MeshView> &views = mCache->meshes();
+    for (size_t i = 0; i < views.size(); i++) {
+        const MeshView &view = views[i];
+        // Empty tiles only keep the grid complete, there is nothing to draw
+        if (view.indexCount == 0) {
+            continue;
+        }
+
+        Tile tile;
+        tile.index = i;
+        tile.boundsMin = glm::vec3(view.boundsMin.x, view.boundsMin.y, view.boundsMin.z);
+        tile.boundsMax = glm::vec3(view.boundsMax.x, view.boundsMax.y, view.boundsMax.z);
+        bool shortIndices = format.shortIndices && view.vertexCount <= 65536;
+        tile.estimatedBytes = size_t(view.vertexCount) * (ENCODED_POSITION_BYTES(format) + ENCODED_NORMAL_BYTES(format)
+                                                          + (view.colours != nullptr ? ENCODED_COLOUR_BYTES(format) : 0))
+                              + size_t(view.indexCount) * (shortIndices ? sizeof(unsigned short) : sizeof(unsigned int));
+        tile.loading = false;
+        tile.lastWanted = 0;
+        mTiles.push_back(tile);
+    }
+}
+
+void TileManager::tileUploaded(size_t tile, const std::shared_ptr<GPUMesh> &mesh)
+{
+    Tile &uploaded = mTiles[tile];
+    uploaded.loading = false;
+    uploaded.mesh = mesh;
+    mPendingCount--;
+    mPendingBytes -= uploaded.estimatedBytes;
+    mResidentBytes += mesh->byteSize;
+}
+
+void TileManager::tileFailed(size_t tile)
+{
+    // Gives back what update() counted against the load, so the tile is tried again when wanted
+    Tile &failed = mTiles[tile];
+    failed.loading = false;
+    mPendingCount--;
+    mPendingBytes -= failed.estimatedBytes;
+}
+
+bool TileManager::evictLeastRecentlyUsed()
+{
+    Tile *oldest = nullptr;
+    for (Tile &tile : mTiles) {
+        if (tile.mesh && tile.lastWanted != mFrame && (oldest == nullptr || tile.lastWanted < oldest->lastWanted)) {
+            oldest = &tile;
+        }
+    }
+    if (oldest == nullptr) {
+        return false;
+    }
+    // Dropping the last reference releases the tile's VAO and buffer
+    mResidentBytes -= oldest->mesh->byteSize;
+    oldest->mesh.reset();
+    return true;
+}
+
+void TileManager::update(const glm::vec3 &cameraPosition)
+{
+    mFrame++;
+    if (!mCache) {
+        return;
+    }
+
+    std::vector<std::pair<float, size_t>> requests;
+    for (size_t i = 0; i < mTiles.size(); i++) {
+        Tile &tile = mTiles[i];
+        glm::vec3 outside = glm::max(glm::max(tile.boundsMin - cameraPosition, cameraPosition - tile.boundsMax), glm::vec3(0.0f));
+        float distance = glm::length(outside);
+        if (distance > mStreamRadius) {
+            continue;
+        }
+        tile.lastWanted = mFrame;
+        if (!tile.mesh && !tile.loading) {
+            requests.push_back(std::make_pair(distance, i));
+        }
+    }
+    std::sort(requests.begin(), requests.end());
+
+    for (const std::pair<float, size_t> &request : requests) {
+        if (mPendingCount >= TILE_MAX_PENDING_LOADS) {
+            break;
+        }
+        size_t tile = request.second;
+        size_t neededBytes = mTiles[tile].estimatedBytes;
+        while (mResidentBytes + mPendingBytes + neededBytes > mBudgetBytes && evictLeastRecentlyUsed()) {
+        }
+        if (mResidentBytes + mPendingBytes + neededBytes > mBudgetBytes) {
+            if (!mBudgetWarned) {
+                mBudgetWarned = true;
+                printf("[WARNING] the terrain tiles within %.0f units of the camera need more than the %.1f MB tile budget\n",
+                       mStreamRadius, double(mBudgetBytes) / (1024.0 * 1024.0));
+            }
+            break;
+        }
+
+        mTiles[tile].loading = true;
+        mPendingCount++;
+        mPendingBytes += neededBytes;
+        // Runs right away if the tile is still resident through the registry
+        mLoader.loadTile(mCache, mSrcFile, mTiles[tile].index,
+                         [this, tile](const std::shared_ptr<GPUMesh> &mesh) { tileUploaded(tile, mesh); },
+                         [this, tile]() { tileFailed(tile); });
+    }
+
+    // Uploaded tiles can turn out larger than estimated
+    while (mResidentBytes > mBudgetBytes && evictLeastRecentlyUsed()) {
+    }
+}
+
+void TileManager::collectVisible(const Frustum &frustum, std::vector<const GPUMesh *> &visible) const
+{
+    for (const Tile &tile : mTiles) {
+        if (tile.mesh && boxInFrustum(frustum, tile.boundsMin, tile.boundsMax)) {
+            visible.push_back(tile.mesh.get());
+        }
+    }
+}
+
+size_t TileManager::residentCount() const
+{
+    size_t count = 0;
+    for (const Tile &tile : mTiles) {
+        if (tile.mesh) {
+            count++;
+        }
+    }
+    return count;
+}
@@ -0,0 +1,77 @@
+#ifndef GLOOM_TILE_MANAGER_HPP
+#define GLOOM_TILE_MANAGER_HPP
+
+#include <memory>
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+#include <lib/frustum.hpp>
+#include <lib/meshCache.hpp>
+#include "asyncLoader.hpp"
+#include "vao.hpp"
+
+// Streams the tiles of a terrain in and out of video memory around the camera.
+//
+// The tiles come from a tile cache (see terrainTiles.hpp), which is built on a loader thread
+// the first time and only mapped afterwards, so from then on the terrain never has to fit
+// in memory at once. Every frame, tiles whose bounds are within the stream radius of the camera are
+// requested nearest first. Uploaded tiles stay resident until the memory budget runs out,
+// at which point the least recently wanted tiles are evicted to make room.
+//
+// All functions must be called on the GL thread.
+class TileManager {
+public:
+    // Starts opening the tile cache of srcFile on a loader thread, splitting the terrain into
+    // tilesPerSide by tilesPerSide tiles with parseThreads if the cache has to be built first
+    TileManager(AsyncLoader &loader, std::string const &srcFile, unsigned int tilesPerSide,
+                unsigned int parseThreads, size_t budgetBytes, float streamRadius);
+
+    TileManager(const TileManager &) = delete;
+    TileManager &operator=(const TileManager &) = delete;
+
+    // Requests and evicts tiles for a camera at cameraPosition, given in the terrain's model space
+    void update(const glm::vec3 &cameraPosition);
+
+    // Appends the resident tiles that intersect frustum, which has to be in model space
+    void collectVisible(const Frustum &frustum, std::vector<const GPUMesh *> &visible) const;
+
+    size_t tileCount() const { return mTiles.size(); }
+    size_t residentCount() const;
+    size_t residentBytes() const { return mResidentBytes; }
+
+private:
+    struct Tile {
+        size_t index;
+        glm::vec3 boundsMin;
+        glm::vec3 boundsMax;
+        // Video memory the tile is expected to take up before it has been uploaded
+        size_t estimatedBytes;
+        std::shared_ptr<GPUMesh> mesh;
+        bool loading;
+        // Frame in which the tile was last within the stream radius
+        unsigned long long lastWanted;
+    };
+
+    void tilesOpened(const std::shared_ptr<MeshCache> &cache);
+    void tileUploaded(size_t tile, const std::shared_ptr<GPUMesh> &mesh);
+    void tileFailed(size_t tile);
+    // Evicts the least recently wanted resident tile that is not wanted this frame.
+    // Returns false if there is none.
+    bool evictLeastRecentlyUsed();
+
+    AsyncLoader &mLoader;
+    std::string mSrcFile;
+    size_t mBudgetBytes;
+    float mStreamRadius;
+
+    // Empty until the tile cache has been opened
+    std::shared_ptr<MeshCache> mCache;
+    std::vector<Tile> mTiles;
+    size_t mResidentBytes;
+    size_t mPendingBytes;
+    unsigned int mPendingCount;
+    unsigned long long mFrame;
+    bool mBudgetWarned;
+};
+
+#endif //GLOOM_TILE_MANAGER_HPP
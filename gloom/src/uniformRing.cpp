@@ -0,0 +1,118 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "uniformRing.hpp"
+
+// How long a single wait for a fence may take before it is retried, in nanoseconds
+#define FENCE_WAIT_TIMEOUT 1000000000ull
+
+// Waits until fence is signalled. Returns whether it was not signalled already.
+static bool waitForFence(GLsync fence)
+{
+    GLenum result = glClientWaitSync(fence, 0, 0);
+    if (result == GL_ALREADY_SIGNALED || result == GL_CONDITION_SATISFIED) {
+        return false;
+    }
+    // Flushing makes sure the fence reaches the GPU, or the wait could last forever
+    while (result != GL_ALREADY_SIGNALED && result != GL_CONDITION_SATISFIED) {
+        if (result == GL_WAIT_FAILED) {
+            throw std::runtime_error("Waiting for the GPU to finish with a uniform buffer failed.");
+        }
+        result = glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, FENCE_WAIT_TIMEOUT);
+    }
+    return true;
+}
+
+UniformRing::UniformRing(size_t bytesPerFrame)
+    : mBufferID(0),
+      mMapped(nullptr),
+      mFrameBytes(0),
+      mAlignment(1),
+      mFrame(0),
+      mOffset(0),
+      mReserved(0),
+      mStalledFrames(0) {
+    GLint alignment = 0;
+    glGetIntegerv(GL_UNIFORM_BUFFER_OFFSET_ALIGNMENT, &alignment);
+    mAlignment = std::max<size_t>(size_t(alignment), 1);
+    std::fill(mFences, mFences + UNIFORM_RING_FRAMES, nullptr);
+    allocate(bytesPerFrame);
+}
+
+UniformRing::~UniformRing() {
+    release();
+}
+
+size_t UniformRing::sliceSize(size_t size) const {
+    return (size + mAlignment - 1) / mAlignment * mAlignment;
+}
+
+void UniformRing::allocate(size_t bytesPerFrame) {
+    mFrameBytes = sliceSize(std::max<size_t>(bytesPerFrame, 1));
+    GLsizeiptr totalBytes = GLsizeiptr(mFrameBytes * UNIFORM_RING_FRAMES);
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glCreateBuffers(1, &mBufferID);
+    glNamedBufferStorage(mBufferID, totalBytes, nullptr, flags);
+    mMapped = static_cast<unsigned char *>(glMapNamedBufferRange(mBufferID, 0, totalBytes, flags));
+    if (mMapped == nullptr) {
+        glDeleteBuffers(1, &mBufferID);
+        mBufferID = 0;
+        throw std::runtime_error("Could not map a uniform buffer persistently.");
+    }
+}
+
+void UniformRing::release() {
+    for (GLsync &fence : mFences) {
+        if (fence != nullptr) {
+            waitForFence(fence);
+            glDeleteSync(fence);
+            fence = nullptr;
+        }
+    }
+    if (mBufferID != 0) {
+        glUnmapNamedBuffer(mBufferID);
+        glDeleteBuffers(1, &mBufferID);
+        mBufferID = 0;
+    }
+    mMapped = nullptr;
+}
+
+void UniformRing::beginFrame(size_t bytes) {
+    mFrame = (mFrame + 1) % UNIFORM_RING_FRAMES;
+    mOffset = 0;
+    mReserved = bytes;
+    if (bytes > mFrameBytes) {
+        // Every region is replaced, so all frames in flight have to finish first
+        release();
+        allocate(std::max(bytes, mFrameBytes * 2));
+        return;
+    }
+    GLsync &fence = mFences[mFrame];
+    if (fence != nullptr) {
+        if (waitForFence(fence)) {
+            mStalledFrames++;
+        }
+        glDeleteSync(fence);
+        fence = nullptr;
+    }
+}
+
+GLintptr UniformRing::write(const void *data, size_t size) {
+    size_t slice = sliceSize(size);
+    if (mOffset + slice > std::min(mReserved, mFrameBytes)) {
+        throw std::runtime_error("Wrote more uniforms in a frame than were reserved for it.");
+    }
+    size_t offset = mFrame * mFrameBytes + mOffset;
+    // Coherent, so the GPU sees the data without an explicit flush
+    std::memcpy(mMapped + offset, data, size);
+    mOffset += slice;
+    return GLintptr(offset);
+}
+
+void UniformRing::endFrame() {
+    GLsync &fence = mFences[mFrame];
+    if (fence != nullptr) {
+        glDeleteSync(fence);
+    }
+    fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+}
@@ -0,0 +1,65 @@
+#ifndef GLOOM_UNIFORM_RING_HPP
+#define GLOOM_UNIFORM_RING_HPP
+
+#include <cstddef>
+#include <glad/glad.h>
+
+// Frames whose uniforms a UniformRing holds at once, i.e. how far the CPU may run ahead of
+// the GPU before it has to wait
+#define UNIFORM_RING_FRAMES 3
+
+// Streams per draw uniform data to the GPU without a driver call per value.
+//
+// One buffer is mapped persistently and coherently for the lifetime of the ring, and split
+// into a region per frame in flight. A frame writes its uniforms one after another into its
+// region, and draws bind their slice with glBindBufferRange. endFrame() places a fence
+// behind the frame's draws, and before a region is written again beginFrame() waits for the
+// fence of the frame that used it last, so the CPU never overwrites data the GPU may still
+// read. With UNIFORM_RING_FRAMES regions that wait only blocks when the GPU falls that many
+// frames behind.
+//
+// Must be created, used and destroyed on the GL thread.
+class UniformRing {
+public:
+    // Starts with room for bytesPerFrame bytes in every frame
+    explicit UniformRing(size_t bytesPerFrame);
+    ~UniformRing();
+
+    UniformRing(const UniformRing &) = delete;
+    UniformRing &operator=(const UniformRing &) = delete;
+
+    // Moves on to the next region, waiting for the GPU to finish with it first, and makes
+    // sure it has room for bytes bytes, slices padded to the offset alignment included
+    void beginFrame(size_t bytes);
+    // Copies size bytes into the current frame's region, and returns the offset to bind them
+    // at. Throws std::runtime_error if the room asked for by beginFrame() has run out.
+    GLintptr write(const void *data, size_t size);
+    // Fences the draws made since beginFrame(), which must all have been issued
+    void endFrame();
+
+    unsigned int buffer() const { return mBufferID; }
+    // Size of a slice of size bytes once padded to the alignment glBindBufferRange needs
+    size_t sliceSize(size_t size) const;
+    // Frames that had to wait for the GPU before reusing their region
+    unsigned int stalledFrames() const { return mStalledFrames; }
+
+private:
+    // Creates and maps a buffer with room for bytesPerFrame bytes per frame
+    void allocate(size_t bytesPerFrame);
+    // Waits for every frame in flight, then unmaps and deletes the buffer
+    void release();
+
+    unsigned int mBufferID;
+    unsigned char *mMapped;
+    size_t mFrameBytes;
+    size_t mAlignment;
+    // Region being written, and how far into it
+    unsigned int mFrame;
+    size_t mOffset;
+    size_t mReserved;
+    // Fence behind the last draws reading each region, if any
+    GLsync mFences[UNIFORM_RING_FRAMES];
+    unsigned int mStalledFrames;
+};
+
+#endif //GLOOM_UNIFORM_RING_HPP
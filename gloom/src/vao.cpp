@@ -1,59 +1,207 @@
 #include <glad/glad.h>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <lib/frustum.hpp>
 #include "vao.hpp"
 
 #define NUM_COORDINATES 3
 #define NUM_COLOR_COORDINATES 4
 
-unsigned int createVAO(
-        std::vector<float> vertices,
-        std::vector<unsigned int> indices,
-        std::vector<float> colors,
-        std::vector<float> normals,
-        unsigned int numPoints)
-{
-    unsigned int VAO = 0;
-    glGenVertexArrays(1, &VAO);
-    glBindVertexArray(VAO);
-
-    int num_vbos = 3;
-    unsigned int VBO[3];
-    unsigned int vertexIndex = 0;
-    unsigned int colorIndex = 1;
-    unsigned int normalIndex = 2;
-    glGenBuffers(num_vbos, VBO);
-
-    // Vertices
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[vertexIndex]);
-    glBufferData(GL_ARRAY_BUFFER, NUM_COORDINATES * numPoints * sizeof(float), &vertices[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(vertexIndex, NUM_COORDINATES, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glEnableVertexAttribArray(vertexIndex);
-
-    // Colors
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[colorIndex]);
-    glBufferData(GL_ARRAY_BUFFER, NUM_COLOR_COORDINATES * numPoints * sizeof(float), &colors[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(colorIndex, 4, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glEnableVertexAttribArray(colorIndex);
-
-    // Normals
-    glBindBuffer(GL_ARRAY_BUFFER, VBO[normalIndex]);
-    glBufferData(GL_ARRAY_BUFFER, NUM_COORDINATES * numPoints * sizeof(float), &normals[0], GL_STATIC_DRAW);
-    glVertexAttribPointer(normalIndex, NUM_COORDINATES, GL_FLOAT, GL_FALSE, 0, nullptr);
-    glEnableVertexAttribArray(normalIndex);
-
-    // IBO
-    unsigned int IBO = 0;
-    glGenBuffers(1, &IBO );
-    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, IBO);
-    glBufferData(GL_ELEMENT_ARRAY_BUFFER, NUM_COORDINATES * numPoints * sizeof(unsigned int), &indices[0], GL_STATIC_DRAW);
-    return VAO;
-}
-
-unsigned int VAOFromMesh(Mesh mesh)
-{
-    return createVAO(
-            mesh.vertices,
-            mesh.indices,
-            mesh.colours,
-            mesh.normals,
-            mesh.vertexCount());
+// Alignment of every stream inside a mesh's buffer
+#define STREAM_ALIGNMENT 16
+
+static size_t alignUp(size_t value, size_t alignment)
+{
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+static unsigned int attributeBytes(unsigned int type, int components)
+{
+    switch (type) {
+        case GL_INT_2_10_10_10_REV:
+        case GL_UNSIGNED_INT_2_10_10_10_REV:
+            // Packed types hold all components in one 32-bit value
+            return 4;
+        case GL_BYTE:
+        case GL_UNSIGNED_BYTE:
+            return components;
+        case GL_SHORT:
+        case GL_UNSIGNED_SHORT:
+        case GL_HALF_FLOAT:
+            return components * 2;
+        default:
+            return components * 4;
+    }
+}
+
+VertexLayout &VertexLayout::attribute(unsigned int location, int components, unsigned int type, bool normalised,
+                                      const void *data, unsigned int stream, unsigned int size)
+{
+    if (data == nullptr) {
+        return *this;
+    }
+    VertexAttribute attribute;
+    attribute.location = location;
+    attribute.components = components;
+    attribute.type = type;
+    attribute.normalised = normalised;
+    attribute.size = size != 0 ? size : attributeBytes(type, components);
+    attribute.data = data;
+    attribute.stream = stream;
+    mAttributes.push_back(attribute);
+    return *this;
+}
+
+VertexLayout &VertexLayout::indices(const void *data, unsigned int count, bool shortIndices)
+{
+    mIndices = data;
+    mIndexCount = count;
+    mShortIndices = shortIndices;
+    return *this;
+}
+
+// Where a stream lives inside a mesh's buffer
+struct StreamPlacement {
+    unsigned int binding;
+    size_t offset;
+    unsigned int stride;
+};
+
+GPUMesh buildMesh(const VertexLayout &layout)
+{
+    const std::vector<VertexAttribute> &attributes = layout.attributes();
+    size_t vertexCount = layout.vertexCount();
+
+    // The indices go first, so that glDrawElements can keep using offset 0
+    size_t indexBytes = size_t(layout.indexCount()) * (layout.shortIndices() ? sizeof(unsigned short) : sizeof(unsigned int));
+
+    std::vector<StreamPlacement> streams;
+    std::vector<size_t> streamOf(attributes.size());
+    std::vector<unsigned int> relativeOffsets(attributes.size());
+    for (size_t i = 0; i < attributes.size(); i++) {
+        size_t s = 0;
+        while (s < streams.size() && streams[s].binding != attributes[i].stream) {
+            s++;
+        }
+        if (s == streams.size()) {
+            StreamPlacement stream = { attributes[i].stream, 0, 0 };
+            streams.push_back(stream);
+        }
+        streamOf[i] = s;
+        relativeOffsets[i] = streams[s].stride;
+        streams[s].stride += static_cast<unsigned int>(alignUp(attributes[i].size, 4));
+    }
+
+    size_t totalBytes = alignUp(indexBytes, STREAM_ALIGNMENT);
+    for (StreamPlacement &stream : streams) {
+        stream.offset = totalBytes;
+        totalBytes = alignUp(totalBytes + stream.stride * vertexCount, STREAM_ALIGNMENT);
+    }
+    // Empty buffers can not be created, and an empty mesh is still a valid mesh
+    totalBytes = std::max<size_t>(totalBytes, STREAM_ALIGNMENT);
+
+    GPUMesh mesh;
+    glCreateBuffers(1, &mesh.bufferID);
+    glNamedBufferStorage(mesh.bufferID, totalBytes, nullptr, GL_MAP_WRITE_BIT);
+
+    // Everything is written straight from the caller's arrays into the mapped buffer,
+    // interleaving on the way where streams hold more than one attribute
+    unsigned char *target = static_cast<unsigned char *>(glMapNamedBufferRange(
+            mesh.bufferID, 0, totalBytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT));
+    if (target == nullptr) {
+        glDeleteBuffers(1, &mesh.bufferID);
+        throw std::runtime_error("Could not map a vertex buffer for writing.");
+    }
+    if (indexBytes > 0) {
+        std::memcpy(target, layout.indexData(), indexBytes);
+    }
+    for (size_t i = 0; i < attributes.size(); i++) {
+        const VertexAttribute &attribute = attributes[i];
+        const StreamPlacement &stream = streams[streamOf[i]];
+        const unsigned char *source = static_cast<const unsigned char *>(attribute.data);
+        unsigned char *destination = target + stream.offset + relativeOffsets[i];
+        if (stream.stride == attribute.size) {
+            std::memcpy(destination, source, vertexCount * attribute.size);
+            continue;
+        }
+        for (size_t v = 0; v < vertexCount; v++) {
+            std::memcpy(destination + v * stream.stride, source + v * attribute.size, attribute.size);
+        }
+    }
+    if (glUnmapNamedBuffer(mesh.bufferID) == GL_FALSE) {
+        glDeleteBuffers(1, &mesh.bufferID);
+        throw std::runtime_error("The contents of a vertex buffer were lost while uploading it.");
+    }
+
+    glCreateVertexArrays(1, &mesh.vertexArrayObjectID);
+    glVertexArrayElementBuffer(mesh.vertexArrayObjectID, mesh.bufferID);
+    for (const StreamPlacement &stream : streams) {
+        glVertexArrayVertexBuffer(mesh.vertexArrayObjectID, stream.binding, mesh.bufferID,
+                                  static_cast<GLintptr>(stream.offset), static_cast<GLsizei>(stream.stride));
+    }
+    for (size_t i = 0; i < attributes.size(); i++) {
+        const VertexAttribute &attribute = attributes[i];
+        glEnableVertexArrayAttrib(mesh.vertexArrayObjectID, attribute.location);
+        glVertexArrayAttribFormat(mesh.vertexArrayObjectID, attribute.location, attribute.components, attribute.type,
+                                  attribute.normalised ? GL_TRUE : GL_FALSE, relativeOffsets[i]);
+        glVertexArrayAttribBinding(mesh.vertexArrayObjectID, attribute.location, attribute.stream);
+    }
+
+    mesh.indexCount = layout.indexCount();
+    mesh.shortIndices = layout.shortIndices();
+    mesh.positionTransform = glm::mat4(1.0f);
+    mesh.lods.assign(1, MeshLOD{ 0, layout.indexCount(), 0.0f });
+    mesh.boundingSphere = glm::vec4(0.0f);
+    mesh.boundsMin = glm::vec3(EMPTY_BOUNDS);
+    mesh.boundsMax = glm::vec3(-EMPTY_BOUNDS);
+    mesh.byteSize = totalBytes;
+    mesh.arenaMesh = NO_ARENA_MESH;
+    return mesh;
+}
+
+void deleteMesh(GPUMesh &mesh)
+{
+    glDeleteVertexArrays(1, &mesh.vertexArrayObjectID);
+    glDeleteBuffers(1, &mesh.bufferID);
+    mesh.vertexArrayObjectID = 0;
+    mesh.bufferID = 0;
+}
+
+VertexLayout meshLayout(const EncodedMesh &mesh)
+{
+    const VertexFormat &format = mesh.format;
+    bool interleaved = format.interleaved;
+    VertexLayout layout(mesh.vertexCount);
+
+    // Quantised positions are padded to 4 components, but only the first 3 are read
+    layout.attribute(POSITION_LOCATION, NUM_COORDINATES, format.quantisePositions ? GL_UNSIGNED_SHORT : GL_FLOAT,
+                     format.quantisePositions, mesh.positions.empty() ? nullptr : mesh.positions.data(),
+                     interleaved ? 0 : POSITION_LOCATION, ENCODED_POSITION_BYTES(format));
+    layout.attribute(COLOR_LOCATION, NUM_COLOR_COORDINATES, format.packColours ? GL_UNSIGNED_BYTE : GL_FLOAT,
+                     format.packColours, mesh.colours.empty() ? nullptr : mesh.colours.data(),
+                     interleaved ? 0 : COLOR_LOCATION, ENCODED_COLOUR_BYTES(format));
+    // GL_INT_2_10_10_10_REV always has 4 components, the shader only reads xyz
+    layout.attribute(NORMAL_LOCATION, format.packNormals ? 4 : NUM_COORDINATES, format.packNormals ? GL_INT_2_10_10_10_REV : GL_FLOAT,
+                     format.packNormals, mesh.normals.empty() ? nullptr : mesh.normals.data(),
+                     interleaved ? 0 : NORMAL_LOCATION, ENCODED_NORMAL_BYTES(format));
+    layout.indices(mesh.indices.data(), mesh.indexCount, mesh.shortIndices);
+    return layout;
+}
+
+static void deleteSharedMesh(GPUMesh *mesh)
+{
+    deleteMesh(*mesh);
+    delete mesh;
+}
+
+std::shared_ptr<GPUMesh> uploadMesh(const EncodedMesh &mesh)
+{
+    GPUMesh *gpuMesh = new GPUMesh(buildMesh(meshLayout(mesh)));
+    gpuMesh->positionTransform = mesh.positionTransform;
+    gpuMesh->lods = mesh.lods;
+    gpuMesh->boundingSphere = mesh.boundingSphere;
+    gpuMesh->boundsMin = mesh.boundsMin;
+    gpuMesh->boundsMax = mesh.boundsMax;
+    return std::shared_ptr<GPUMesh>(gpuMesh, deleteSharedMesh);
 }
@@ -1,15 +1,96 @@
 #ifndef GLOOM_VAO_HPP
 #define GLOOM_VAO_HPP
 
+#include <memory>
 #include <vector>
+#include <glm/mat4x4.hpp>
 #include <lib/mesh.hpp>
+#include <lib/vertexEncoding.hpp>
 
-unsigned int createVAO(
-        std::vector<float> vertices,
-        std::vector<unsigned int> indices,
-        std::vector<float> colors,
-        std::vector<float> normals,
-        unsigned int numPoints);
+// Attribute locations used by the shaders
+#define POSITION_LOCATION 0
+#define COLOR_LOCATION 1
+#define NORMAL_LOCATION 2
+
+// GPUMesh::arenaMesh of meshes that are not in a MeshArena
+#define NO_ARENA_MESH 0xFFFFFFFFu
+
+// One vertex attribute, read from a tightly packed array in caller memory
+struct VertexAttribute {
+    unsigned int location;
+    int components;
+    // GL_FLOAT, GL_UNSIGNED_SHORT, GL_INT_2_10_10_10_REV, ...
+    unsigned int type;
+    bool normalised;
+    // Bytes per vertex in data. Rounded up to 4 in the vertex buffer.
+    unsigned int size;
+    const void *data;
+    // Vertex buffer binding the attribute is read from. Attributes sharing a stream are
+    // interleaved, attributes in different streams each get their own region of the buffer.
+    unsigned int stream;
+};
+
+// Declarative description of a mesh's vertex and index data for buildMesh
+class VertexLayout {
+public:
+    explicit VertexLayout(unsigned int vertexCount)
+        : mVertexCount(vertexCount), mIndices(nullptr), mIndexCount(0), mShortIndices(false) { }
+
+    // Adds an attribute. size defaults to components times the size of type. Attributes
+    // without data are left out, so that the shader sees their default value.
+    VertexLayout &attribute(unsigned int location, int components, unsigned int type, bool normalised,
+                            const void *data, unsigned int stream, unsigned int size = 0);
+    VertexLayout &indices(const void *data, unsigned int count, bool shortIndices);
+
+    unsigned int vertexCount() const { return mVertexCount; }
+    const std::vector<VertexAttribute> &attributes() const { return mAttributes; }
+    const void *indexData() const { return mIndices; }
+    unsigned int indexCount() const { return mIndexCount; }
+    bool shortIndices() const { return mShortIndices; }
+
+private:
+    unsigned int mVertexCount;
+    std::vector<VertexAttribute> mAttributes;
+    const void *mIndices;
+    unsigned int mIndexCount;
+    bool mShortIndices;
+};
+
+// GL objects holding one uploaded mesh. The loaders hand these out through std::shared_ptr,
+// whose deleter releases the VAO and its buffer, so it must be dropped on the GL thread.
+struct GPUMesh {
+    unsigned int vertexArrayObjectID;
+    // Immutable buffer holding the indices, followed by every vertex stream
+    unsigned int bufferID;
+    unsigned int indexCount;
+    // Whether the indices are GL_UNSIGNED_SHORT rather than GL_UNSIGNED_INT
+    bool shortIndices;
+    // Has to be applied to the stored positions before the model matrix, see EncodedMesh
+    glm::mat4 positionTransform;
+    // Index ranges drawing the mesh at decreasing detail, the first one is the full mesh
+    std::vector<MeshLOD> lods;
+    // Centre and radius in model space, used to pick a level of detail
+    glm::vec4 boundingSphere;
+    // Box around the mesh in model space, used for culling. Empty (min above max) if unknown.
+    glm::vec3 boundsMin;
+    glm::vec3 boundsMax;
+    // Video memory taken up by the buffer
+    size_t byteSize;
+    // Slot of the copy of the mesh in the MeshArena of the GPU driven renderer, or NO_ARENA_MESH
+    unsigned int arenaMesh;
+};
+
+// Creates an immutable buffer and a VAO for layout with direct state access, copying the
+// caller's arrays into the buffer exactly once. Must be called on the GL thread. The caller
+// owns the result and releases it with deleteMesh.
+GPUMesh buildMesh(const VertexLayout &layout);
+void deleteMesh(GPUMesh &mesh);
+
+// Positions, colours and normals in the encoding mesh.format picked, at the attribute
+// locations the shaders expect
+VertexLayout meshLayout(const EncodedMesh &mesh);
+
+// Uploads mesh into a reference-counted GPUMesh. Must be called on the GL thread.
+std::shared_ptr<GPUMesh> uploadMesh(const EncodedMesh &mesh);
 
-unsigned int VAOFromMesh(Mesh mesh);
 #endif //GLOOM_VAO_HPP